@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+
+# Test that Recognizer.accept_waveform() gives the same result for all
+# supported input types
+
+import wave
+
+import numpy as np
+import sherpa_ncnn
+
+d = "./sherpa-ncnn-conv-emformer-transducer-2022-12-06"
+
+
+def create_recognizer():
+    return sherpa_ncnn.Recognizer(
+        tokens=f"{d}/tokens.txt",
+        encoder_param=f"{d}/encoder_jit_trace-pnnx.ncnn.param",
+        encoder_bin=f"{d}/encoder_jit_trace-pnnx.ncnn.bin",
+        decoder_param=f"{d}/decoder_jit_trace-pnnx.ncnn.param",
+        decoder_bin=f"{d}/decoder_jit_trace-pnnx.ncnn.bin",
+        joiner_param=f"{d}/joiner_jit_trace-pnnx.ncnn.param",
+        joiner_bin=f"{d}/joiner_jit_trace-pnnx.ncnn.bin",
+        num_threads=2,
+    )
+
+
+def read_wave(filename: str) -> bytes:
+    with wave.open(filename) as f:
+        assert f.getframerate() == 16000, f.getframerate()
+        assert f.getnchannels() == 1, f.getnchannels()
+        assert f.getsampwidth() == 2, f.getsampwidth()  # it is in bytes
+        return f.readframes(f.getnframes())
+
+
+def decode(recognizer, waveforms) -> str:
+    """Decode the waveforms as consecutive chunks of one utterance."""
+    stream = recognizer.create_stream()
+    for w in waveforms:
+        stream.accept_waveform(stream.sample_rate, w)
+
+    tail_paddings = np.zeros(int(stream.sample_rate * 0.5), dtype=np.float32)
+    stream.accept_waveform(stream.sample_rate, tail_paddings)
+    stream.input_finished()
+
+    return stream.text
+
+
+def main():
+    recognizer = create_recognizer()
+
+    samples = read_wave(f"{d}/test_wavs/1.wav")
+    samples_int16 = np.frombuffer(samples, dtype=np.int16)
+    samples_float32 = samples_int16.astype(np.float32) / 32768
+
+    expected = decode(recognizer, [samples_float32])
+    print(expected)
+    assert expected != "", expected
+
+    # int16 samples are scaled by 1/32768 like the float32 ones above
+    assert decode(recognizer, [samples_int16]) == expected
+    assert decode(recognizer, [samples]) == expected
+    assert decode(recognizer, [bytearray(samples)]) == expected
+    assert decode(recognizer, [memoryview(samples)]) == expected
+
+    # Non-contiguous arrays, e.g., one channel of a stereo recording
+    stereo = np.stack([samples_int16, np.zeros_like(samples_int16)], axis=1)
+    assert not stereo[:, 0].flags.c_contiguous
+    assert decode(recognizer, [stereo[:, 0]]) == expected
+
+    stereo = np.stack([samples_float32, samples_float32], axis=1)
+    assert decode(recognizer, [stereo[:, 1]]) == expected
+
+    # Other types are converted to float32
+    assert decode(recognizer, [samples_float32.astype(np.float64)]) == expected
+    assert decode(recognizer, [samples_float32.tolist()]) == expected
+
+    # Chunks of bytes, including ones that are not aligned to 4 bytes
+    chunk = 3202
+    chunks = [samples[i : i + chunk] for i in range(0, len(samples), chunk)]
+    assert decode(recognizer, chunks) == expected
+
+    # The recognizer created first is not changed by its streams
+    assert recognizer.text == "", recognizer.text
+
+    stream = recognizer.create_stream()
+    try:
+        stream.accept_waveform(stream.sample_rate, samples[:-1])
+        assert False, "Odd number of bytes should raise ValueError"
+    except ValueError as e:
+        print(e)
+
+    try:
+        stream.accept_waveform(stream.sample_rate, stereo)
+        assert False, "2-D waveforms should raise ValueError"
+    except ValueError as e:
+        print(e)
+
+    print("Passed!")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+
+# Test that decode_files() and decode_batch() give the same results as
+# decoding each utterance with its own stream
+
+import wave
+
+import numpy as np
+import sherpa_ncnn
+
+d = "./sherpa-ncnn-conv-emformer-transducer-2022-12-06"
+
+
+def create_recognizer():
+    return sherpa_ncnn.Recognizer(
+        tokens=f"{d}/tokens.txt",
+        encoder_param=f"{d}/encoder_jit_trace-pnnx.ncnn.param",
+        encoder_bin=f"{d}/encoder_jit_trace-pnnx.ncnn.bin",
+        decoder_param=f"{d}/decoder_jit_trace-pnnx.ncnn.param",
+        decoder_bin=f"{d}/decoder_jit_trace-pnnx.ncnn.bin",
+        joiner_param=f"{d}/joiner_jit_trace-pnnx.ncnn.param",
+        joiner_bin=f"{d}/joiner_jit_trace-pnnx.ncnn.bin",
+        num_threads=1,
+    )
+
+
+def read_wave(filename: str) -> np.ndarray:
+    with wave.open(filename) as f:
+        assert f.getframerate() == 16000, f.getframerate()
+        assert f.getnchannels() == 1, f.getnchannels()
+        assert f.getsampwidth() == 2, f.getsampwidth()  # it is in bytes
+        samples = f.readframes(f.getnframes())
+
+    samples_int16 = np.frombuffer(samples, dtype=np.int16)
+    return samples_int16.astype(np.float32) / 32768
+
+
+def decode(recognizer, samples: np.ndarray, tail_padding: float) -> str:
+    stream = recognizer.create_stream()
+    stream.accept_waveform(stream.sample_rate, samples)
+
+    tail_paddings = np.zeros(
+        int(stream.sample_rate * tail_padding), dtype=np.float32
+    )
+    stream.accept_waveform(stream.sample_rate, tail_paddings)
+    stream.input_finished()
+
+    return stream.text
+
+
+def main():
+    recognizer = create_recognizer()
+
+    # A file may appear more than once
+    filenames = [
+        f"{d}/test_wavs/1.wav",
+        f"{d}/test_wavs/5.wav",
+        f"{d}/test_wavs/1.wav",
+    ]
+    waveforms = [read_wave(f) for f in filenames]
+
+    expected = [decode(recognizer, w, tail_padding=0.3) for w in waveforms]
+    print(expected)
+    assert expected[0] != expected[1], expected
+
+    for num_threads in [1, 2, 0]:
+        results = sherpa_ncnn.decode_files(
+            recognizer, filenames, num_threads=num_threads
+        )
+        assert [r.text for r in results] == expected, (num_threads, results)
+
+        results = sherpa_ncnn.decode_batch(
+            recognizer, waveforms, num_threads=num_threads
+        )
+        assert [r.text for r in results] == expected, (num_threads, results)
+
+    for r in results:
+        assert len(r.tokens) == len(r.timestamps), r
+        assert r.timestamps == sorted(r.timestamps), r
+
+    # float64 waveforms are converted to float32
+    results = sherpa_ncnn.decode_batch(
+        recognizer, [w.astype(np.float64) for w in waveforms]
+    )
+    assert [r.text for r in results] == expected, results
+
+    assert sherpa_ncnn.decode_files(recognizer, []) == []
+    assert sherpa_ncnn.decode_batch(recognizer, []) == []
+
+    # The state of the given recognizer is not changed
+    assert recognizer.text == "", recognizer.text
+
+    try:
+        sherpa_ncnn.decode_files(recognizer, [filenames[0], f"{d}/tokens.txt"])
+        assert False, "Reading a non-wave file should raise ValueError"
+    except ValueError as e:
+        print(e)
+
+    print("Passed!")
+
+
+if __name__ == "__main__":
+    main()
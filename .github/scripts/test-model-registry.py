@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+
+# Test replacing the model of a ModelRegistry while streams are decoding
+
+import gc
+import tempfile
+import threading
+import wave
+from pathlib import Path
+
+import numpy as np
+import sherpa_ncnn
+
+d = "./sherpa-ncnn-conv-emformer-transducer-2022-12-06"
+
+model_files = dict(
+    tokens=f"{d}/tokens.txt",
+    encoder_param=f"{d}/encoder_jit_trace-pnnx.ncnn.param",
+    encoder_bin=f"{d}/encoder_jit_trace-pnnx.ncnn.bin",
+    decoder_param=f"{d}/decoder_jit_trace-pnnx.ncnn.param",
+    decoder_bin=f"{d}/decoder_jit_trace-pnnx.ncnn.bin",
+    joiner_param=f"{d}/joiner_jit_trace-pnnx.ncnn.param",
+    joiner_bin=f"{d}/joiner_jit_trace-pnnx.ncnn.bin",
+)
+
+
+def read_wave(filename: str) -> bytes:
+    with wave.open(filename) as f:
+        assert f.getframerate() == 16000, f.getframerate()
+        assert f.getnchannels() == 1, f.getnchannels()
+        assert f.getsampwidth() == 2, f.getsampwidth()  # it is in bytes
+        return f.readframes(f.getnframes())
+
+
+def finish(stream) -> str:
+    tail_paddings = np.zeros(int(stream.sample_rate * 0.5), dtype=np.float32)
+    stream.accept_waveform(stream.sample_rate, tail_paddings)
+    stream.input_finished()
+    return stream.text
+
+
+def main():
+    samples = read_wave(f"{d}/test_wavs/1.wav")
+    half = len(samples) // 4 * 2
+
+    recognizer = sherpa_ncnn.Recognizer(**model_files, num_threads=2)
+    recognizer.accept_waveform(recognizer.sample_rate, samples)
+    expected = finish(recognizer)
+    print(expected)
+
+    registry = sherpa_ncnn.ModelRegistry()
+    assert registry.version == 0, registry.version
+    assert registry.live_versions == [], registry.live_versions
+
+    try:
+        registry.create_stream()
+        assert False, "create_stream() without a model should raise"
+    except RuntimeError as e:
+        print(e)
+
+    assert registry.load(**model_files, num_threads=2) == 1
+    assert registry.live_versions == [1], registry.live_versions
+
+    s1 = registry.create_stream()
+    assert s1.model_version == 1, s1.model_version
+    s1.accept_waveform(s1.sample_rate, samples[:half])
+
+    # Load a new version while s1 keeps decoding
+    versions = []
+    t = threading.Thread(
+        target=lambda: versions.append(
+            registry.load(**model_files, num_threads=2)
+        )
+    )
+    t.start()
+    s1.accept_waveform(s1.sample_rate, samples[half:])
+    t.join()
+
+    assert versions == [2], versions
+    assert registry.version == 2, registry.version
+    assert registry.live_versions == [1, 2], registry.live_versions
+
+    s2 = registry.create_stream(decoding_method="modified_beam_search")
+    assert s2.model_version == 2, s2.model_version
+    s2.accept_waveform(s2.sample_rate, samples)
+
+    assert finish(s1) == expected
+    assert finish(s2) != ""
+
+    # Streams created from a stream share its model
+    s3 = s1.create_stream()
+    s3.accept_waveform(s3.sample_rate, samples)
+    assert finish(s3) == expected
+
+    # Version 1 is freed with its last stream
+    del s1
+    gc.collect()
+    assert registry.live_versions == [1, 2], registry.live_versions
+
+    del s3
+    gc.collect()
+    assert registry.live_versions == [2], registry.live_versions
+
+    # Failed loads keep the current version
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        empty = Path(tmp_dir) / "empty.txt"
+        empty.write_text("")
+
+        garbage = Path(tmp_dir) / "garbage.ncnn.param"
+        garbage.write_text("garbage\n")
+
+        bad_files = dict(model_files, tokens=str(empty))
+        assert registry.load(**bad_files) == -1
+
+        bad_files = dict(model_files, encoder_param=str(garbage))
+        assert registry.load(**bad_files) == -1
+
+        bad_files = dict(model_files, joiner_bin=str(empty))
+        assert registry.load(**bad_files) == -1
+
+    assert registry.version == 2, registry.version
+    assert registry.live_versions == [2], registry.live_versions
+
+    s4 = registry.create_stream()
+    assert s4.model_version == 2, s4.model_version
+    s4.accept_waveform(s4.sample_rate, samples)
+    assert finish(s4) == expected
+
+    print("Passed!")
+
+
+if __name__ == "__main__":
+    main()
@@ -121,8 +121,7 @@ class MainActivity : AppCompatActivity() {
         while (isRecording) {
             val ret = audioRecord?.read(buffer, 0, buffer.size)
             if (ret != null && ret > 0) {
-                val samples = FloatArray(ret) { buffer[it] / 32768.0f }
-                model.decodeSamples(samples)
+                model.decodeSamples(buffer, ret)
                 runOnUiThread {
                     val isEndpoint = model.isEndpoint()
                     val text = model.text
@@ -1,6 +1,9 @@
 package com.k2fsa.sherpa.ncnn
 
 import android.content.res.AssetManager
+import java.nio.ByteOrder
+import java.nio.FloatBuffer
+import java.nio.ShortBuffer
 
 data class EndpointRule(
     var mustContainNonSilence: Boolean,
@@ -68,16 +71,67 @@ data class ModelConfig(
     var useGPU: Boolean = true, // If there is a GPU and useGPU true, we will use GPU
 )
 
-class SherpaNcnn(
+// The new text is the first `offset` characters of the previous text
+// followed by `text`
+data class TextDelta(
+    val offset: Int,
+    val text: String,
+)
+
+// A loaded model that can be shared by many SherpaNcnn instances
+class SherpaNcnnModel(
     assetManager: AssetManager,
     modelConfig: ModelConfig,
-    decoderConfig: DecoderConfig,
-    var fbankConfig: FbankOptions,
 ) {
-    private val ptr: Long
+    internal val ptr: Long
 
     init {
-        ptr = new(assetManager, modelConfig, decoderConfig, fbankConfig)
+        ptr = new(assetManager, modelConfig)
+        check(ptr != 0L) { "Failed to load the model. Please see logcat for details" }
+    }
+
+    protected fun finalize() {
+        delete(ptr)
+    }
+
+    private external fun new(assetManager: AssetManager, modelConfig: ModelConfig): Long
+    private external fun delete(ptr: Long)
+
+    companion object {
+        init {
+            System.loadLibrary("sherpa-ncnn-jni")
+        }
+    }
+}
+
+// If decodeInBackground is true, decodeSamples() only queues the samples
+// and returns immediately. They are decoded by a native thread.
+class SherpaNcnn {
+    private val ptr: Long
+    var fbankConfig: FbankOptions
+
+    constructor(
+        assetManager: AssetManager,
+        modelConfig: ModelConfig,
+        decoderConfig: DecoderConfig,
+        fbankConfig: FbankOptions,
+        decodeInBackground: Boolean = false,
+    ) {
+        this.fbankConfig = fbankConfig
+        ptr = new(assetManager, modelConfig, decoderConfig, fbankConfig, decodeInBackground)
+    }
+
+    // Share a loaded model with other instances. It is much cheaper than
+    // loading the model again. The model stays alive as long as any
+    // instance created from it.
+    constructor(
+        model: SherpaNcnnModel,
+        decoderConfig: DecoderConfig,
+        fbankConfig: FbankOptions,
+        decodeInBackground: Boolean = false,
+    ) {
+        this.fbankConfig = fbankConfig
+        ptr = newFromModel(model.ptr, decoderConfig, fbankConfig, decodeInBackground)
     }
 
     protected fun finalize() {
@@ -87,6 +141,31 @@ class SherpaNcnn(
     fun decodeSamples(samples: FloatArray) =
         decodeSamples(ptr, samples, sampleRate = fbankConfig.frameOpts.sampFreq)
 
+    // samples are 16-bit PCM, e.g., from AudioRecord.read()
+    fun decodeSamples(samples: ShortArray, n: Int = samples.size) {
+        require(n in 0..samples.size)
+        decodeShortSamples(ptr, samples, n, sampleRate = fbankConfig.frameOpts.sampFreq)
+    }
+
+    // The remaining samples of a direct buffer in the native byte order are
+    // decoded without copying, e.g., a buffer from
+    // ByteBuffer.allocateDirect(n).order(ByteOrder.nativeOrder()).asFloatBuffer()
+    fun decodeSamples(samples: FloatBuffer) {
+        require(samples.isDirect && samples.order() == ByteOrder.nativeOrder())
+        decodeFloatBuffer(
+            ptr, samples, samples.position(), samples.remaining(),
+            sampleRate = fbankConfig.frameOpts.sampFreq
+        )
+    }
+
+    fun decodeSamples(samples: ShortBuffer) {
+        require(samples.isDirect && samples.order() == ByteOrder.nativeOrder())
+        decodeShortBuffer(
+            ptr, samples, samples.position(), samples.remaining(),
+            sampleRate = fbankConfig.frameOpts.sampFreq
+        )
+    }
+
     fun inputFinished() = inputFinished(ptr)
     fun reset() = reset(ptr)
     fun isEndpoint(): Boolean = isEndpoint(ptr)
@@ -94,17 +173,58 @@ class SherpaNcnn(
     val text: String
         get() = getText(ptr)
 
+    // Return null if the text has not changed since the previous call.
+    // Unlike `text`, it creates a new string only for the changed part,
+    // so it is cheaper to poll frequently.
+    fun getTextDelta(): TextDelta? {
+        val delta = getTextDelta(ptr, deltaOffset) ?: return null
+        return TextDelta(offset = deltaOffset[0], text = delta)
+    }
+
+    private val deltaOffset = IntArray(1)
+
     private external fun new(
         assetManager: AssetManager,
         modelConfig: ModelConfig,
         decoderConfig: DecoderConfig,
-        fbankConfig: FbankOptions
+        fbankConfig: FbankOptions,
+        decodeInBackground: Boolean,
+    ): Long
+
+    private external fun newFromModel(
+        modelPtr: Long,
+        decoderConfig: DecoderConfig,
+        fbankConfig: FbankOptions,
+        decodeInBackground: Boolean,
     ): Long
 
     private external fun delete(ptr: Long)
     private external fun decodeSamples(ptr: Long, samples: FloatArray, sampleRate: Float)
+    private external fun decodeShortSamples(
+        ptr: Long,
+        samples: ShortArray,
+        n: Int,
+        sampleRate: Float
+    )
+
+    private external fun decodeFloatBuffer(
+        ptr: Long,
+        samples: FloatBuffer,
+        offset: Int,
+        n: Int,
+        sampleRate: Float
+    )
+
+    private external fun decodeShortBuffer(
+        ptr: Long,
+        samples: ShortBuffer,
+        offset: Int,
+        n: Int,
+        sampleRate: Float
+    )
     private external fun inputFinished(ptr: Long)
     private external fun getText(ptr: Long): String
+    private external fun getTextDelta(ptr: Long, offset: IntArray): String?
     private external fun reset(ptr: Long)
     private external fun isEndpoint(ptr: Long): Boolean
 
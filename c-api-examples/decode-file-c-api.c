@@ -100,11 +100,11 @@ int32_t main(int32_t argc, char *argv[]) {
       }
       AcceptWaveform(recognizer, 16000, samples, n);
       Decode(recognizer);
-      SherpaNcnnResult *r = GetResult(recognizer);
-      if (strlen(r->text)) {
+      // The result is owned by the recognizer, so we don't free it
+      const SherpaNcnnResult *r = GetResultView(recognizer);
+      if (r->changed && strlen(r->text)) {
         fprintf(stderr, "%s\n", r->text);
       }
-      DestroyResult(r);
     }
   }
   fclose(fp);
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+
+"""
+This file demonstrates how to use sherpa-ncnn Python API to recognize
+many files in parallel.
+
+Usage:
+
+    ./python-api-examples/decode-files.py /path/to/foo.wav /path/to/bar.wav
+
+Please refer to
+https://k2-fsa.github.io/sherpa/ncnn/index.html
+to install sherpa-ncnn and to download the pre-trained models
+used in this file.
+"""
+
+import sys
+import time
+
+import sherpa_ncnn
+
+
+def main():
+    recognizer = sherpa_ncnn.Recognizer(
+        tokens="./sherpa-ncnn-conv-emformer-transducer-2022-12-06/tokens.txt",
+        encoder_param="./sherpa-ncnn-conv-emformer-transducer-2022-12-06/encoder_jit_trace-pnnx.ncnn.param",
+        encoder_bin="./sherpa-ncnn-conv-emformer-transducer-2022-12-06/encoder_jit_trace-pnnx.ncnn.bin",
+        decoder_param="./sherpa-ncnn-conv-emformer-transducer-2022-12-06/decoder_jit_trace-pnnx.ncnn.param",
+        decoder_bin="./sherpa-ncnn-conv-emformer-transducer-2022-12-06/decoder_jit_trace-pnnx.ncnn.bin",
+        joiner_param="./sherpa-ncnn-conv-emformer-transducer-2022-12-06/joiner_jit_trace-pnnx.ncnn.param",
+        joiner_bin="./sherpa-ncnn-conv-emformer-transducer-2022-12-06/joiner_jit_trace-pnnx.ncnn.bin",
+        # Files are decoded in parallel, so each one uses a single thread
+        num_threads=1,
+    )
+
+    filenames = sys.argv[1:]
+
+    start = time.time()
+    results = sherpa_ncnn.decode_files(recognizer, filenames)
+    elapsed = time.time() - start
+
+    for filename, result in zip(filenames, results):
+        print(f"{filename}: {result.text}")
+
+    print(f"Decoded {len(filenames)} files in {elapsed:.3f} s")
+
+
+if __name__ == "__main__":
+    main()
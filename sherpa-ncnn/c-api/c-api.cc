@@ -21,7 +21,10 @@
 #include <algorithm>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "sherpa-ncnn/csrc/metrics.h"
 #include "sherpa-ncnn/csrc/model.h"
 #include "sherpa-ncnn/csrc/recognizer.h"
 
@@ -32,12 +35,25 @@
 SHERPA_NCNN_EXTERN_C
 struct SherpaNcnnRecognizer {
   std::unique_ptr<sherpa_ncnn::Recognizer> recognizer;
+
+  // Filled in place by GetResultView() so that polling does not allocate
+  sherpa_ncnn::RecognitionResult current;
+
+  // Buffers of the result returned by GetResultView()
+  std::string text;
+  std::vector<int32_t> tokens;
+  std::vector<float> timestamps;
+  SherpaNcnnResult result = {};
 };
 
-SherpaNcnnRecognizer *CreateRecognizer(
-    const SherpaNcnnModelConfig *in_model_config,
-    const SherpaNcnnDecoderConfig *in_decoder_config) {
-  // model_config
+SHERPA_NCNN_EXTERN_C
+struct SherpaNcnnModel {
+  std::shared_ptr<sherpa_ncnn::Model> model;
+  std::shared_ptr<const sherpa_ncnn::SymbolTable> sym;
+};
+
+static sherpa_ncnn::ModelConfig GetModelConfig(
+    const SherpaNcnnModelConfig *in_model_config) {
   sherpa_ncnn::ModelConfig model_config;
   model_config.encoder_param = in_model_config->encoder_param;
   model_config.encoder_bin = in_model_config->encoder_bin;
@@ -57,7 +73,11 @@ SherpaNcnnRecognizer *CreateRecognizer(
   model_config.decoder_opt.num_threads = num_threads;
   model_config.joiner_opt.num_threads = num_threads;
 
-  // decoder_config
+  return model_config;
+}
+
+static sherpa_ncnn::DecoderConfig GetDecoderConfig(
+    const SherpaNcnnDecoderConfig *in_decoder_config) {
   sherpa_ncnn::DecoderConfig decoder_config;
   decoder_config.method = in_decoder_config->decoding_method;
   decoder_config.num_active_paths = in_decoder_config->num_active_paths;
@@ -77,6 +97,10 @@ SherpaNcnnRecognizer *CreateRecognizer(
 
   decoder_config.endpoint_config = endpoint_config;
 
+  return decoder_config;
+}
+
+static knf::FbankOptions GetFbankOptions() {
   float expected_sampling_rate = 16000;
   knf::FbankOptions fbank_opts;
   fbank_opts.frame_opts.dither = 0;
@@ -84,9 +108,47 @@ SherpaNcnnRecognizer *CreateRecognizer(
   fbank_opts.frame_opts.samp_freq = expected_sampling_rate;
   fbank_opts.mel_opts.num_bins = 80;
 
+  return fbank_opts;
+}
+
+SherpaNcnnRecognizer *CreateRecognizer(
+    const SherpaNcnnModelConfig *in_model_config,
+    const SherpaNcnnDecoderConfig *in_decoder_config) {
   auto ans = new SherpaNcnnRecognizer;
   ans->recognizer = std::make_unique<sherpa_ncnn::Recognizer>(
-      decoder_config, model_config, fbank_opts);
+      GetDecoderConfig(in_decoder_config), GetModelConfig(in_model_config),
+      GetFbankOptions());
+  return ans;
+}
+
+SherpaNcnnModel *CreateModel(const SherpaNcnnModelConfig *in_model_config) {
+  sherpa_ncnn::ModelConfig model_config = GetModelConfig(in_model_config);
+
+  auto sym = std::make_shared<sherpa_ncnn::SymbolTable>(model_config.tokens);
+  if (sym->NumSymbols() == 0) {
+    NCNN_LOGE("Failed to load %s", model_config.tokens.c_str());
+    return nullptr;
+  }
+
+  std::shared_ptr<sherpa_ncnn::Model> model =
+      sherpa_ncnn::Model::Create(model_config);
+  if (!model) return nullptr;
+
+  auto ans = new SherpaNcnnModel;
+  ans->model = std::move(model);
+  ans->sym = std::move(sym);
+  return ans;
+}
+
+void DestroyModel(SherpaNcnnModel *model) { delete model; }
+
+SherpaNcnnRecognizer *CreateStream(
+    const SherpaNcnnModel *model,
+    const SherpaNcnnDecoderConfig *in_decoder_config) {
+  auto ans = new SherpaNcnnRecognizer;
+  ans->recognizer = std::make_unique<sherpa_ncnn::Recognizer>(
+      GetDecoderConfig(in_decoder_config), model->model, model->sym,
+      GetFbankOptions());
   return ans;
 }
 
@@ -99,19 +161,102 @@ void AcceptWaveform(SherpaNcnnRecognizer *p, float sample_rate,
 
 void Decode(SherpaNcnnRecognizer *p) { p->recognizer->Decode(); }
 
+int32_t IsReady(SherpaNcnnRecognizer *p) { return p->recognizer->IsReady(); }
+
+void DecodeMultipleStreams(SherpaNcnnRecognizer **p, int32_t n,
+                           int32_t num_threads) {
+  std::vector<sherpa_ncnn::Recognizer *> recognizers(n);
+  for (int32_t i = 0; i != n; ++i) {
+    recognizers[i] = p[i]->recognizer.get();
+  }
+
+  sherpa_ncnn::DecodeMultipleStreams(recognizers.data(), n, num_threads);
+}
+
 SherpaNcnnResult *GetResult(SherpaNcnnRecognizer *p) {
-  std::string text = p->recognizer->GetResult().text;
+  sherpa_ncnn::RecognitionResult result = p->recognizer->GetResult();
+  const std::string &text = result.text;
 
   auto r = new SherpaNcnnResult;
   r->text = new char[text.size() + 1];
   std::copy(text.begin(), text.end(), const_cast<char *>(r->text));
   const_cast<char *>(r->text)[text.size()] = 0;
 
+  int32_t count = static_cast<int32_t>(result.timestamps.size());
+  auto tokens = new int32_t[count];
+  auto timestamps = new float[count];
+
+  // Skip the leading blanks
+  std::copy(result.tokens.end() - count, result.tokens.end(), tokens);
+  for (int32_t i = 0; i != count; ++i) {
+    timestamps[i] =
+        result.timestamps[i] * sherpa_ncnn::kSecondsPerOutputFrame;
+  }
+
+  r->tokens = tokens;
+  r->timestamps = timestamps;
+  r->count = count;
+  r->stable_count = result.num_stable_tokens;
+  r->stable_text_length = result.stable_text_length;
+  r->changed = 1;
+  r->text_delta_offset = 0;
+
   return r;
 }
 
+const SherpaNcnnResult *GetResultView(SherpaNcnnRecognizer *p) {
+  sherpa_ncnn::RecognitionResult &result = p->current;
+  p->recognizer->GetResult(&result);
+
+  int32_t count = static_cast<int32_t>(result.timestamps.size());
+  auto tokens_begin = result.tokens.end() - count;
+
+  bool changed =
+      result.text != p->text || count != p->tokens.size() ||
+      !std::equal(tokens_begin, result.tokens.end(), p->tokens.begin()) ||
+      result.num_stable_tokens != p->result.stable_count;
+
+  size_t k = 0;
+  if (changed) {
+    size_t n = std::min(result.text.size(), p->text.size());
+    while (k < n && result.text[k] == p->text[k]) ++k;
+
+    // Don't split a UTF-8 character
+    while (k > 0 && k < result.text.size() &&
+           (result.text[k] & 0xc0) == 0x80) {
+      --k;
+    }
+
+    // Both strings keep their capacity for later calls
+    p->text.swap(result.text);
+
+    // assign() reuses the existing capacity
+    p->tokens.assign(tokens_begin, result.tokens.end());
+
+    p->timestamps.resize(count);
+    for (int32_t i = 0; i != count; ++i) {
+      p->timestamps[i] =
+          result.timestamps[i] * sherpa_ncnn::kSecondsPerOutputFrame;
+    }
+  }
+
+  SherpaNcnnResult &r = p->result;
+  r.text = p->text.c_str();
+  r.tokens = p->tokens.data();
+  r.timestamps = p->timestamps.data();
+  r.count = count;
+  r.stable_count = result.num_stable_tokens;
+  r.stable_text_length = result.stable_text_length;
+  r.changed = changed;
+  r.text_delta_offset = static_cast<int32_t>(changed ? k : p->text.size());
+
+  return &r;
+}
+
 void DestroyResult(const SherpaNcnnResult *r) {
   delete[] r->text;
+  delete[] r->tokens;
+  delete[] r->timestamps;
   delete r;
 }
 
@@ -122,3 +267,33 @@ void InputFinished(SherpaNcnnRecognizer *p) { p->recognizer->InputFinished(); }
 int32_t IsEndpoint(SherpaNcnnRecognizer *p) {
   return p->recognizer->IsEndpoint();
 }
+
+void GetMemoryStats(SherpaNcnnRecognizer *p, SherpaNcnnMemoryStats *stats) {
+  sherpa_ncnn::MemoryStats s = p->recognizer->GetMemoryStats();
+
+  stats->encoder_weight_bytes = s.model.encoder.weight_bytes;
+  stats->decoder_weight_bytes = s.model.decoder.weight_bytes;
+  stats->joiner_weight_bytes = s.model.joiner.weight_bytes;
+
+  stats->encoder_peak_bytes =
+      s.model.encoder.peak_blob_bytes + s.model.encoder.peak_workspace_bytes;
+  stats->decoder_peak_bytes =
+      s.model.decoder.peak_blob_bytes + s.model.decoder.peak_workspace_bytes;
+  stats->joiner_peak_bytes =
+      s.model.joiner.peak_blob_bytes + s.model.joiner.peak_workspace_bytes;
+
+  stats->feature_bytes = s.stream.feature_bytes;
+  stats->encoder_state_bytes = s.stream.encoder_state_bytes;
+  stats->hyp_bytes = s.stream.hyp_bytes;
+}
+
+static sherpa_ncnn::MetricsServer *GetMetricsServer() {
+  static sherpa_ncnn::MetricsServer server;
+  return &server;
+}
+
+int32_t StartMetricsServer(int32_t port) {
+  return GetMetricsServer()->Start(port);
+}
+
+void StopMetricsServer() { GetMetricsServer()->Stop(); }
@@ -96,12 +96,94 @@ typedef struct SherpaNcnnDecoderConfig {
 } SherpaNcnnDecoderConfig;
 
 typedef struct SherpaNcnnResult {
+  /// Recognized text. It is null-terminated.
   const char *text;
-  // TODO: Add more fields
+
+  /// Token IDs of the recognized text, excluding blanks.
+  /// It contains `count` entries.
+  const int32_t *tokens;
+
+  /// timestamps[i] is the time in seconds, counted from the start of the
+  /// stream, at which tokens[i] is decoded.
+  /// It contains `count` entries.
+  const float *timestamps;
+
+  /// Number of entries in tokens and timestamps
+  int32_t count;
+
+  /// The first stable_count tokens and the first stable_text_length bytes
+  /// of text won't change in later results until an endpoint is detected
+  /// or the recognizer is reset.
+  int32_t stable_count;
+  int32_t stable_text_length;
+
+  /// Used only by GetResultView(). It is 1 if the result is different
+  /// from the one returned by the previous call to GetResultView();
+  /// it is 0 otherwise. It is always 1 for GetResult().
+  int32_t changed;
+
+  /// Used only by GetResultView(). The first text_delta_offset bytes of
+  /// text are the same as in the previous view, so only the text after
+  /// them needs to be processed again. It is 0 for GetResult().
+  int32_t text_delta_offset;
 } SherpaNcnnResult;
 
+/// Memory used by a recognizer. All values are in bytes.
+typedef struct SherpaNcnnMemoryStats {
+  /// Size of encoder.ncnn.bin, decoder.ncnn.bin, and joiner.ncnn.bin
+  int64_t encoder_weight_bytes;
+  int64_t decoder_weight_bytes;
+  int64_t joiner_weight_bytes;
+
+  /// High-water mark of the intermediate blobs and workspace of each
+  /// network. They are shared by all streams using the same model.
+  int64_t encoder_peak_bytes;
+  int64_t decoder_peak_bytes;
+  int64_t joiner_peak_bytes;
+
+  /// Memory used by this recognizer only, i.e., the cost of one more stream
+  int64_t feature_bytes;
+  int64_t encoder_state_bytes;
+  int64_t hyp_bytes;
+} SherpaNcnnMemoryStats;
+
 typedef struct SherpaNcnnRecognizer SherpaNcnnRecognizer;
 
+/// A loaded model, i.e., the neural networks and tokens.txt, that can be
+/// shared by many recognizers.
+typedef struct SherpaNcnnModel SherpaNcnnModel;
+
+/// Load a model.
+///
+/// @param model_config  Config for the model.
+/// @return Return a pointer to the model or NULL on error. The user has to
+///         invoke DestroyModel() to free it to avoid memory leak.
+SherpaNcnnModel *CreateModel(const SherpaNcnnModelConfig *model_config);
+
+/// Free a pointer returned by CreateModel().
+///
+/// Recognizers created from the model by CreateStream() keep using it.
+/// Its memory is released after all of them are destroyed.
+///
+/// @param model A pointer returned by CreateModel()
+void DestroyModel(SherpaNcnnModel *model);
+
+/// Create a recognizer that shares the given model with other recognizers.
+/// It is much cheaper than CreateRecognizer() since the model is not
+/// loaded again.
+///
+/// Recognizers sharing a model can be used from different threads at the
+/// same time, but a single recognizer must not be used from multiple
+/// threads concurrently.
+///
+/// @param model  A pointer returned by CreateModel().
+/// @param decoder_config Config for decoding.
+/// @return Return a pointer to the recognizer. The user has to invoke
+//          DestroyRecognizer() to free it to avoid memory leak.
+SherpaNcnnRecognizer *CreateStream(
+    const SherpaNcnnModel *model,
+    const SherpaNcnnDecoderConfig *decoder_config);
+
 /// Create a recognizer.
 ///
 /// @param model_config  Config for the model.
@@ -133,6 +215,29 @@ void AcceptWaveform(SherpaNcnnRecognizer *p, float sample_rate,
 /// computation and decoding. Otherwise, it is a no-op.
 void Decode(SherpaNcnnRecognizer *p);
 
+/// Return 1 if there are enough feature frames for Decode() to run the
+/// neural network. Return 0 otherwise.
+///
+/// @param p A pointer returned by CreateRecognizer() or CreateStream().
+int32_t IsReady(SherpaNcnnRecognizer *p);
+
+/// Run Decode() on the ready ones of the given recognizers in parallel.
+///
+/// The models have a fixed batch size of 1, so each ready recognizer is
+/// decoded by one of a pool of threads instead of stacking them into one
+/// batch. The threads are created once and reused by later calls. For the
+/// best throughput, create the recognizers with CreateStream() from a model
+/// whose num_threads is 1. Otherwise, reduce num_threads accordingly so
+/// that the CPU cores are not oversubscribed.
+///
+/// @param p An array of recognizers. Each one must appear only once.
+/// @param n Number of entries in p.
+/// @param num_threads Number of threads to use, including the calling
+///                    thread. If it is not positive, the number of CPU
+///                    cores is used.
+void DecodeMultipleStreams(SherpaNcnnRecognizer **p, int32_t n,
+                           int32_t num_threads);
+
 /// Get the decoding results so far.
 ///
 /// @param p A pointer returned by CreateRecognizer().
@@ -140,6 +245,19 @@ void Decode(SherpaNcnnRecognizer *p);
 ///         DestroyResult() to free the returned pointer to avoid memory leak.
 SherpaNcnnResult *GetResult(SherpaNcnnRecognizer *p);
 
+/// Get the decoding results so far without allocating memory.
+///
+/// Unlike GetResult(), the returned result is owned by the recognizer.
+/// It and all the pointers it contains stay valid until the next call to
+/// GetResultView() or the recognizer is destroyed. Check its `changed`
+/// field to skip processing results that haven't changed.
+///
+/// Caution: Do NOT pass the returned pointer to DestroyResult().
+///
+/// @param p A pointer returned by CreateRecognizer().
+/// @return A pointer owned by p.
+const SherpaNcnnResult *GetResultView(SherpaNcnnRecognizer *p);
+
 /// Destroy the pointer returned by GetResult().
 ///
 /// @param r A pointer returned by GetResult()
@@ -165,6 +283,27 @@ void InputFinished(SherpaNcnnRecognizer *p);
 /// @return Return 1 if an endpoint is detected. Return 0 otherwise.
 int32_t IsEndpoint(SherpaNcnnRecognizer *p);
 
+/// Get the memory used by the model and by the given recognizer.
+///
+/// @param p A pointer returned by CreateRecognizer()
+/// @param stats On return, it contains the memory statistics.
+void GetMemoryStats(SherpaNcnnRecognizer *p, SherpaNcnnMemoryStats *stats);
+
+/// Start an HTTP server on 127.0.0.1:port that serves metrics of all
+/// recognizers in this process in the Prometheus text format, e.g.,
+///
+///   curl http://127.0.0.1:port/metrics
+///
+/// It also enables the collection of metrics. It is not supported
+/// on Windows.
+///
+/// @param port The port to listen on.
+/// @return Return 1 on success and 0 on error.
+int32_t StartMetricsServer(int32_t port);
+
+/// Stop the server started by StartMetricsServer().
+void StopMetricsServer();
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
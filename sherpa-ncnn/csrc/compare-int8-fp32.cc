@@ -0,0 +1,537 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This program compares an int8 model produced by
+// generate-int8-scale-table + ncnn2int8 with its fp32 counterpart.
+//
+// It reports
+//  - the word error rate (WER) of each model on a test set and their delta
+//  - the cosine similarity between the fp32 and int8 outputs of every
+//    Convolution/ConvolutionDepthWise/InnerProduct layer
+//  - the real time factor (RTF) and memory usage of each model
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "net.h"  // NOLINT
+#include "sherpa-ncnn/csrc/features.h"
+#include "sherpa-ncnn/csrc/model.h"
+#include "sherpa-ncnn/csrc/recognizer.h"
+#include "sherpa-ncnn/csrc/wave-reader.h"
+
+namespace {
+
+constexpr float kSampleRate = 16000;
+
+struct Utterance {
+  std::string filename;
+  std::string reference;
+};
+
+struct DecodeStats {
+  std::vector<std::string> hyps;
+  float elapsed_seconds = 0;
+  float audio_seconds = 0;
+};
+
+// Accumulated statistics for the cosine similarity of a layer
+struct CosineStat {
+  double dot = 0;
+  double norm_a = 0;
+  double norm_b = 0;
+
+  double Value() const {
+    if (norm_a == 0 || norm_b == 0) return norm_a == norm_b ? 1 : 0;
+    return dot / (std::sqrt(norm_a) * std::sqrt(norm_b));
+  }
+};
+
+// Layers of an fp32 net whose outputs are compared with the int8 net
+struct LayerPair {
+  std::string name;
+  std::string type;
+  int32_t fp32_blob;
+  int32_t int8_blob;
+  CosineStat stat;
+};
+
+std::vector<Utterance> ReadTestSet(const std::string &filename) {
+  std::ifstream is(filename);
+  std::vector<Utterance> ans;
+  std::string line;
+  while (std::getline(is, line)) {
+    std::istringstream iss(line);
+    Utterance u;
+    if (!(iss >> u.filename)) continue;
+
+    std::getline(iss, u.reference);
+    ans.push_back(std::move(u));
+  }
+  return ans;
+}
+
+// Split text into units for computing the error rate.
+//
+// Words are separated by spaces. Each non-ASCII character, e.g., a Chinese
+// character, is a unit on its own, so the result is the character error
+// rate for Chinese and the word error rate for English.
+std::vector<std::string> SplitUnits(const std::string &text) {
+  std::vector<std::string> ans;
+  std::string word;
+
+  auto flush = [&ans, &word]() {
+    if (!word.empty()) {
+      ans.push_back(std::move(word));
+      word.clear();
+    }
+  };
+
+  for (size_t i = 0; i < text.size();) {
+    auto c = static_cast<uint8_t>(text[i]);
+    if (c < 0x80) {
+      if (isspace(c)) {
+        flush();
+      } else {
+        word.push_back(static_cast<char>(toupper(c)));
+      }
+      ++i;
+      continue;
+    }
+
+    flush();
+
+    int32_t n = 1;
+    if ((c & 0xe0) == 0xc0) {
+      n = 2;
+    } else if ((c & 0xf0) == 0xe0) {
+      n = 3;
+    } else if ((c & 0xf8) == 0xf0) {
+      n = 4;
+    }
+    ans.push_back(text.substr(i, n));
+    i += n;
+  }
+  flush();
+
+  return ans;
+}
+
+int32_t EditDistance(const std::vector<std::string> &a,
+                     const std::vector<std::string> &b) {
+  std::vector<int32_t> prev(b.size() + 1);
+  std::vector<int32_t> cur(b.size() + 1);
+  for (size_t j = 0; j <= b.size(); ++j) prev[j] = j;
+
+  for (size_t i = 1; i <= a.size(); ++i) {
+    cur[0] = i;
+    for (size_t j = 1; j <= b.size(); ++j) {
+      int32_t sub = prev[j - 1] + (a[i - 1] != b[j - 1]);
+      cur[j] = std::min({prev[j] + 1, cur[j - 1] + 1, sub});
+    }
+    std::swap(prev, cur);
+  }
+
+  return prev[b.size()];
+}
+
+// Return the error rate in percent
+float ErrorRate(const std::vector<Utterance> &utterances,
+                const std::vector<std::string> &hyps) {
+  int64_t num_errors = 0;
+  int64_t num_units = 0;
+  for (size_t i = 0; i != utterances.size(); ++i) {
+    auto ref = SplitUnits(utterances[i].reference);
+    num_errors += EditDistance(ref, SplitUnits(hyps[i]));
+    num_units += ref.size();
+  }
+
+  return num_units ? 100.f * num_errors / num_units : 0;
+}
+
+knf::FbankOptions GetFbankOptions() {
+  knf::FbankOptions fbank_opts;
+  fbank_opts.frame_opts.dither = 0;
+  fbank_opts.frame_opts.snip_edges = false;
+  fbank_opts.frame_opts.samp_freq = kSampleRate;
+  fbank_opts.mel_opts.num_bins = 80;
+  return fbank_opts;
+}
+
+int64_t FileSize(const std::string &filename) {
+  std::ifstream is(filename, std::ios::binary | std::ios::ate);
+  return is ? static_cast<int64_t>(is.tellg()) : 0;
+}
+
+DecodeStats Decode(sherpa_ncnn::Recognizer *recognizer,
+                   const std::vector<Utterance> &utterances) {
+  DecodeStats stats;
+  std::vector<float> tail_paddings(static_cast<int>(0.3 * kSampleRate));
+
+  for (const auto &u : utterances) {
+    bool is_ok = false;
+    std::vector<float> samples =
+        sherpa_ncnn::ReadWave(u.filename, kSampleRate, &is_ok);
+    if (!is_ok) {
+      fprintf(stderr, "Failed to read %s\n", u.filename.c_str());
+      stats.hyps.emplace_back();
+      continue;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+
+    recognizer->Reset();
+    recognizer->AcceptWaveform(kSampleRate, samples.data(), samples.size());
+    recognizer->AcceptWaveform(kSampleRate, tail_paddings.data(),
+                               tail_paddings.size());
+    recognizer->InputFinished();
+    recognizer->Decode();
+    stats.hyps.push_back(recognizer->GetResult().text);
+
+    auto end = std::chrono::steady_clock::now();
+    stats.elapsed_seconds +=
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - begin)
+            .count() /
+        1000.;
+    stats.audio_seconds += samples.size() / kSampleRate;
+  }
+
+  return stats;
+}
+
+// Pair Convolution/ConvolutionDepthWise/InnerProduct layers of the two
+// nets by name.
+std::vector<LayerPair> PairLayers(const ncnn::Net &fp32,
+                                  const ncnn::Net &int8) {
+  std::map<std::string, int32_t> int8_blobs;
+  for (const ncnn::Layer *layer : int8.layers()) {
+    if (!layer->tops.empty()) {
+      int8_blobs[layer->name] = layer->tops[0];
+    }
+  }
+
+  std::vector<LayerPair> ans;
+  for (const ncnn::Layer *layer : fp32.layers()) {
+    if (layer->type != "Convolution" && layer->type != "ConvolutionDepthWise" &&
+        layer->type != "InnerProduct") {
+      continue;
+    }
+
+    auto it = int8_blobs.find(layer->name);
+    if (it == int8_blobs.end() || layer->tops.empty()) continue;
+
+    ans.push_back({layer->name, layer->type, layer->tops[0], it->second, {}});
+  }
+
+  return ans;
+}
+
+void UpdateCosine(ncnn::Extractor *fp32_ex, ncnn::Extractor *int8_ex,
+                  std::vector<LayerPair> *pairs) {
+  for (auto &p : *pairs) {
+    ncnn::Mat a;
+    ncnn::Mat b;
+    fp32_ex->extract(p.fp32_blob, a);
+    int8_ex->extract(p.int8_blob, b);
+
+    if (a.total() != b.total()) {
+      fprintf(stderr, "Shape mismatch for layer %s. Skip it\n",
+              p.name.c_str());
+      continue;
+    }
+
+    int32_t size = a.w * a.h;
+    for (int32_t c = 0; c != a.c; ++c) {
+      const float *pa = a.channel(c);
+      const float *pb = b.channel(c);
+      for (int32_t i = 0; i != size; ++i) {
+        p.stat.dot += pa[i] * pb[i];
+        p.stat.norm_a += pa[i] * pa[i];
+        p.stat.norm_b += pb[i] * pb[i];
+      }
+    }
+  }
+}
+
+// Run the encoder, decoder, and joiner of both models on the given
+// utterances and accumulate the cosine similarity of each layer output.
+//
+// The decoder is fed with blanks and the joiner with the output of the
+// encoder of the same model, so the errors of the int8 encoder propagate
+// into the joiner the same way as they do during decoding.
+void ComputeCosine(sherpa_ncnn::Model *fp32, sherpa_ncnn::Model *int8,
+                   const std::vector<Utterance> &utterances,
+                   std::vector<LayerPair> *encoder_pairs,
+                   std::vector<LayerPair> *decoder_pairs,
+                   std::vector<LayerPair> *joiner_pairs) {
+  int32_t segment = fp32->Segment();
+  int32_t offset = fp32->Offset();
+  int32_t context_size = fp32->ContextSize();
+
+  ncnn::Mat decoder_input(context_size);
+  for (int32_t i = 0; i != context_size; ++i) {
+    static_cast<int32_t *>(decoder_input)[i] = fp32->BlankId();
+  }
+
+  ncnn::Extractor fp32_decoder_ex = fp32->GetDecoder().create_extractor();
+  ncnn::Extractor int8_decoder_ex = int8->GetDecoder().create_extractor();
+  fp32_decoder_ex.set_light_mode(false);
+  int8_decoder_ex.set_light_mode(false);
+
+  ncnn::Mat fp32_decoder_out =
+      fp32->RunDecoder(decoder_input, &fp32_decoder_ex);
+  ncnn::Mat int8_decoder_out =
+      int8->RunDecoder(decoder_input, &int8_decoder_ex);
+  UpdateCosine(&fp32_decoder_ex, &int8_decoder_ex, decoder_pairs);
+
+  for (const auto &u : utterances) {
+    bool is_ok = false;
+    std::vector<float> samples =
+        sherpa_ncnn::ReadWave(u.filename, kSampleRate, &is_ok);
+    if (!is_ok) continue;
+
+    sherpa_ncnn::FeatureExtractor feature_extractor(GetFbankOptions());
+    feature_extractor.AcceptWaveform(kSampleRate, samples.data(),
+                                     samples.size());
+    feature_extractor.InputFinished();
+
+    std::vector<ncnn::Mat> fp32_states;
+    std::vector<ncnn::Mat> int8_states;
+    ncnn::Mat fp32_encoder_out;
+    ncnn::Mat int8_encoder_out;
+
+    int32_t num_processed = 0;
+    while (feature_extractor.NumFramesReady() - num_processed >= segment) {
+      ncnn::Mat features = feature_extractor.GetFrames(num_processed, segment);
+      num_processed += offset;
+
+      ncnn::Extractor fp32_ex = fp32->GetEncoder().create_extractor();
+      ncnn::Extractor int8_ex = int8->GetEncoder().create_extractor();
+      fp32_ex.set_light_mode(false);
+      int8_ex.set_light_mode(false);
+
+      std::tie(fp32_encoder_out, fp32_states) =
+          fp32->RunEncoder(features, fp32_states, &fp32_ex);
+      std::tie(int8_encoder_out, int8_states) =
+          int8->RunEncoder(features, int8_states, &int8_ex);
+
+      UpdateCosine(&fp32_ex, &int8_ex, encoder_pairs);
+
+      for (int32_t t = 0; t != fp32_encoder_out.h; ++t) {
+        ncnn::Mat fp32_row(fp32_encoder_out.w, fp32_encoder_out.row(t));
+        ncnn::Mat int8_row(int8_encoder_out.w, int8_encoder_out.row(t));
+
+        ncnn::Extractor fp32_joiner_ex = fp32->GetJoiner().create_extractor();
+        ncnn::Extractor int8_joiner_ex = int8->GetJoiner().create_extractor();
+        fp32_joiner_ex.set_light_mode(false);
+        int8_joiner_ex.set_light_mode(false);
+
+        fp32->RunJoiner(fp32_row, fp32_decoder_out, &fp32_joiner_ex);
+        int8->RunJoiner(int8_row, int8_decoder_out, &int8_joiner_ex);
+
+        UpdateCosine(&fp32_joiner_ex, &int8_joiner_ex, joiner_pairs);
+      }
+    }
+  }
+}
+
+void PrintCosine(const char *name, std::vector<LayerPair> pairs) {
+  // Show the layers that differ most first
+  std::sort(pairs.begin(), pairs.end(),
+            [](const LayerPair &a, const LayerPair &b) {
+              return a.stat.Value() < b.stat.Value();
+            });
+
+  fprintf(stderr, "----------%s----------\n", name);
+  for (const auto &p : pairs) {
+    fprintf(stderr, "%-40s %-22s cosine = %.6f\n", p.name.c_str(),
+            p.type.c_str(), p.stat.Value());
+  }
+}
+
+void PrintNetMemory(const char *name, const sherpa_ncnn::NetMemoryStats &s) {
+  fprintf(stderr,
+          "    %s: weights %.2f, peak blobs %.2f, peak workspace %.2f\n",
+          name, s.weight_bytes / 1048576., s.peak_blob_bytes / 1048576.,
+          s.peak_workspace_bytes / 1048576.);
+}
+
+void PrintVariant(const char *name, const sherpa_ncnn::ModelConfig &config,
+                  const sherpa_ncnn::ModelMemoryStats &memory,
+                  const DecodeStats &stats, float wer) {
+  int64_t weight_bytes = FileSize(config.encoder_bin) +
+                         FileSize(config.decoder_bin) +
+                         FileSize(config.joiner_bin);
+  float rtf =
+      stats.audio_seconds > 0 ? stats.elapsed_seconds / stats.audio_seconds : 0;
+
+  fprintf(stderr, "%s:\n", name);
+  fprintf(stderr, "  WER (%%): %.2f\n", wer);
+  fprintf(stderr, "  RTF: %.3f / %.3f = %.3f\n", stats.elapsed_seconds,
+          stats.audio_seconds, rtf);
+  fprintf(stderr, "  model file size (MB): %.2f\n", weight_bytes / 1048576.);
+  fprintf(stderr, "  memory (MB): %.2f\n", memory.TotalBytes() / 1048576.);
+  PrintNetMemory("encoder", memory.encoder);
+  PrintNetMemory("decoder", memory.decoder);
+  PrintNetMemory("joiner", memory.joiner);
+}
+
+}  // namespace
+
+int32_t main(int32_t argc, char *argv[]) {
+  if (argc < 15 || argc > 16) {
+    const char *usage = R"usage(
+Usage:
+  ./bin/compare-int8-fp32 \
+    /path/to/tokens.txt \
+    /path/to/encoder.ncnn.param \
+    /path/to/encoder.ncnn.bin \
+    /path/to/decoder.ncnn.param \
+    /path/to/decoder.ncnn.bin \
+    /path/to/joiner.ncnn.param \
+    /path/to/joiner.ncnn.bin \
+    /path/to/encoder.ncnn.int8.param \
+    /path/to/encoder.ncnn.int8.bin \
+    /path/to/decoder.ncnn.int8.param \
+    /path/to/decoder.ncnn.int8.bin \
+    /path/to/joiner.ncnn.int8.param \
+    /path/to/joiner.ncnn.int8.bin \
+    /path/to/test-set.txt [num_threads]
+
+Each line in test-set.txt contains the path to a 16 kHz mono wave file
+followed by its transcript, e.g.,
+
+  /path/to/foo.wav HELLO WORLD
+
+If a model is not quantized, e.g., the decoder, pass its fp32 files
+in place of the int8 files.
+
+The fp32 and int8 models decode the test set one after the other so that
+their RTFs are comparable. Each of them uses num_threads threads, which
+defaults to 2.
+)usage";
+    fprintf(stderr, "%s\n", usage);
+
+    return 0;
+  }
+
+  int32_t num_threads = 2;
+  if (argc == 16 && atoi(argv[15]) > 0) {
+    num_threads = atoi(argv[15]);
+  }
+
+  sherpa_ncnn::ModelConfig fp32_conf;
+  fp32_conf.tokens = argv[1];
+  fp32_conf.encoder_param = argv[2];
+  fp32_conf.encoder_bin = argv[3];
+  fp32_conf.decoder_param = argv[4];
+  fp32_conf.decoder_bin = argv[5];
+  fp32_conf.joiner_param = argv[6];
+  fp32_conf.joiner_bin = argv[7];
+  fp32_conf.use_vulkan_compute = false;
+  fp32_conf.encoder_opt.num_threads = num_threads;
+  fp32_conf.decoder_opt.num_threads = num_threads;
+  fp32_conf.joiner_opt.num_threads = num_threads;
+
+  sherpa_ncnn::ModelConfig int8_conf = fp32_conf;
+  int8_conf.encoder_param = argv[8];
+  int8_conf.encoder_bin = argv[9];
+  int8_conf.decoder_param = argv[10];
+  int8_conf.decoder_bin = argv[11];
+  int8_conf.joiner_param = argv[12];
+  int8_conf.joiner_bin = argv[13];
+
+  std::vector<Utterance> utterances = ReadTestSet(argv[14]);
+  if (utterances.empty()) {
+    fprintf(stderr, "No utterances found in %s\n", argv[14]);
+    return -1;
+  }
+  fprintf(stderr, "Number of utterances: %d\n",
+          static_cast<int32_t>(utterances.size()));
+
+  sherpa_ncnn::DecoderConfig decoder_conf;
+  decoder_conf.method = "greedy_search";
+
+  sherpa_ncnn::Recognizer fp32_recognizer(decoder_conf, fp32_conf,
+                                          GetFbankOptions());
+  sherpa_ncnn::Recognizer int8_recognizer(decoder_conf, int8_conf,
+                                          GetFbankOptions());
+
+  // Decode with one model at a time so that they don't compete for the
+  // CPU cores and the RTFs are comparable
+  DecodeStats fp32_stats = Decode(&fp32_recognizer, utterances);
+  DecodeStats int8_stats = Decode(&int8_recognizer, utterances);
+
+  // Memory of each network is tracked separately, so the two models
+  // don't affect each other. Peak blob bytes are known after decoding.
+  sherpa_ncnn::ModelMemoryStats fp32_memory =
+      fp32_recognizer.GetMemoryStats().model;
+  sherpa_ncnn::ModelMemoryStats int8_memory =
+      int8_recognizer.GetMemoryStats().model;
+
+  float fp32_wer = ErrorRate(utterances, fp32_stats.hyps);
+  float int8_wer = ErrorRate(utterances, int8_stats.hyps);
+
+  // Nets with light mode disabled are needed to extract
+  // intermediate outputs.
+  fp32_conf.encoder_opt.lightmode = false;
+  fp32_conf.decoder_opt.lightmode = false;
+  fp32_conf.joiner_opt.lightmode = false;
+  int8_conf.encoder_opt.lightmode = false;
+  int8_conf.decoder_opt.lightmode = false;
+  int8_conf.joiner_opt.lightmode = false;
+
+  auto fp32_model = sherpa_ncnn::Model::Create(fp32_conf);
+  auto int8_model = sherpa_ncnn::Model::Create(int8_conf);
+  if (!fp32_model || !int8_model) {
+    fprintf(stderr, "Failed to create the models\n");
+    return -1;
+  }
+
+  auto encoder_pairs =
+      PairLayers(fp32_model->GetEncoder(), int8_model->GetEncoder());
+  auto decoder_pairs =
+      PairLayers(fp32_model->GetDecoder(), int8_model->GetDecoder());
+  auto joiner_pairs =
+      PairLayers(fp32_model->GetJoiner(), int8_model->GetJoiner());
+
+  ComputeCosine(fp32_model.get(), int8_model.get(), utterances,
+                &encoder_pairs, &decoder_pairs, &joiner_pairs);
+
+  fprintf(stderr, "Per-layer cosine similarity between fp32 and int8\n");
+  PrintCosine("encoder", encoder_pairs);
+  PrintCosine("decoder", decoder_pairs);
+  PrintCosine("joiner", joiner_pairs);
+
+  fprintf(stderr, "----------summary----------\n");
+  PrintVariant("fp32", fp32_conf, fp32_memory, fp32_stats, fp32_wer);
+  PrintVariant("int8", int8_conf, int8_memory, int8_stats, int8_wer);
+  fprintf(stderr, "WER delta (int8 - fp32) (%%): %.2f\n", int8_wer - fp32_wer);
+
+  return 0;
+}
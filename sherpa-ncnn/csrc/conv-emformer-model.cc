@@ -15,11 +15,16 @@
 
 namespace sherpa_ncnn {
 
-ConvEmformerModel::ConvEmformerModel(const ModelConfig &config) {
+ConvEmformerModel::ConvEmformerModel(const ModelConfig &config,
+                                     bool encoder_only) {
   encoder_.opt = config.encoder_opt;
   decoder_.opt = config.decoder_opt;
   joiner_.opt = config.joiner_opt;
 
+  ApplyPrecision(config.encoder_precision, &encoder_.opt);
+  ApplyPrecision(config.decoder_precision, &decoder_.opt);
+  ApplyPrecision(config.joiner_precision, &joiner_.opt);
+
   bool has_gpu = false;
 #if NCNN_VULKAN
   has_gpu = ncnn::get_gpu_count() > 0;
@@ -37,21 +42,29 @@ ConvEmformerModel::ConvEmformerModel(const ModelConfig &config) {
   }
 
   InitEncoder(config.encoder_param, config.encoder_bin);
+  InitEncoderInputOutputIndexes();
+
+  if (encoder_only) return;
+
   InitDecoder(config.decoder_param, config.decoder_bin);
   InitJoiner(config.joiner_param, config.joiner_bin);
 
-  InitEncoderInputOutputIndexes();
   InitDecoderInputOutputIndexes();
   InitJoinerInputOutputIndexes();
 }
 
 #if __ANDROID_API__ >= 9
 ConvEmformerModel::ConvEmformerModel(AAssetManager *mgr,
-                                     const ModelConfig &config) {
+                                     const ModelConfig &config,
+                                     bool encoder_only) {
   encoder_.opt = config.encoder_opt;
   decoder_.opt = config.decoder_opt;
   joiner_.opt = config.joiner_opt;
 
+  ApplyPrecision(config.encoder_precision, &encoder_.opt);
+  ApplyPrecision(config.decoder_precision, &decoder_.opt);
+  ApplyPrecision(config.joiner_precision, &joiner_.opt);
+
   bool has_gpu = false;
 #if NCNN_VULKAN
   has_gpu = ncnn::get_gpu_count() > 0;
@@ -69,10 +82,13 @@ ConvEmformerModel::ConvEmformerModel(AAssetManager *mgr,
   }
 
   InitEncoder(mgr, config.encoder_param, config.encoder_bin);
+  InitEncoderInputOutputIndexes();
+
+  if (encoder_only) return;
+
   InitDecoder(mgr, config.decoder_param, config.decoder_bin);
   InitJoiner(mgr, config.joiner_param, config.joiner_bin);
 
-  InitEncoderInputOutputIndexes();
   InitDecoderInputOutputIndexes();
   InitJoinerInputOutputIndexes();
 }
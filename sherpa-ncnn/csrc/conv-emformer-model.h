@@ -16,9 +16,13 @@ namespace sherpa_ncnn {
 // for how the model is converted from icefall to ncnn
 class ConvEmformerModel : public Model {
  public:
-  explicit ConvEmformerModel(const ModelConfig &config);
+  // If encoder_only is true, only the encoder is loaded. It is used for
+  // latency modes. See Model::GetLatencyMode().
+  explicit ConvEmformerModel(const ModelConfig &config,
+                             bool encoder_only = false);
 #if __ANDROID_API__ >= 9
-  ConvEmformerModel(AAssetManager *mgr, const ModelConfig &config);
+  ConvEmformerModel(AAssetManager *mgr, const ModelConfig &config,
+                    bool encoder_only = false);
 #endif
 
   ncnn::Net &GetEncoder() override { return encoder_; }
@@ -43,12 +47,12 @@ class ConvEmformerModel : public Model {
                       ncnn::Extractor *extractor) override;
 
   int32_t Segment() const override {
-    // chunk_length 32
-    // right_context 8
-    // subsampling factor 4
+    // Both chunk_length_ and right_context_length_ are read from the
+    // meta data of the encoder. The subsampling factor is 4.
     //
+    // For chunk_length 32 and right_context 8,
     // segment = 32 + (8 + 2 * 4 + 3) = 32 + 19 = 51
-    return 51;
+    return chunk_length_ + right_context_length_ + 2 * 4 + 3;
   }
 
   // Advance the feature extract by this number of frames after
@@ -70,6 +70,18 @@ ncnn::Mat FeatureExtractor::GetFrames(int32_t frame_index, int32_t n) const {
   return features;
 }
 
+int64_t FeatureExtractor::NumBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t num_frames = fbank_->NumFramesReady();
+
+  int32_t max_frames = opts_.frame_opts.max_feature_vectors;
+  if (max_frames > 0) {
+    num_frames = std::min<int64_t>(num_frames, max_frames);
+  }
+
+  return num_frames * fbank_->Dim() * sizeof(float);
+}
+
 void FeatureExtractor::Reset() {
   fbank_ = std::make_unique<knf::OnlineFbank>(opts_);
 }
@@ -65,6 +65,9 @@ class FeatureExtractor {
 
   void Reset();
 
+  // Return the number of bytes of the feature frames kept in memory
+  int64_t NumBytes() const;
+
  private:
   std::unique_ptr<knf::OnlineFbank> fbank_;
   knf::FbankOptions opts_;
@@ -23,7 +23,15 @@
 #include <float.h>
 #include <stdio.h>  // for FLT_MAX
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <fstream>
+#include <functional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "kaldi-native-fbank/csrc/online-feature.h"
@@ -244,208 +252,299 @@ float compute_kl_threshold(QuantBlobStat &stat, int num_histogram_bins = 2048) {
   return scale;
 }
 
-class QuantNet : public ncnn::Net {
- public:
-  QuantNet(sherpa_ncnn::Model *model);
+// See
+// https://github.com/Tencent/ncnn/blob/master/tools/quantize/ncnn2table.cpp
+// and https://arxiv.org/abs/1810.05723
+static float compute_aciq_gaussian_clip(float absmax, int N,
+                                        int num_bits = 8) {
+  const float alpha_gaussian[8] = {0,          1.71063519, 2.15159277,
+                                   2.55913646, 2.93620062, 3.28691474,
+                                   3.6151146,  3.92403714};
 
-  sherpa_ncnn::Model *model;
-  std::vector<ncnn::Layer *> &encoder_layers;
-  std::vector<ncnn::Layer *> &joiner_layers;
+  const double gaussian_const =
+      (0.5 * 0.35) * (1 + sqrt(3.14159265358979323846 * log(4)));
 
- public:
-  int init();
-  void print_quant_info() const;
-  int save_table_encoder(const char *tablepath);
-  int save_table_joiner(const char *tablepath);
-  int quantize_KL(const std::vector<std::string> &wave_filenames);
-  int quantize_ACIQ();
-  int quantize_EQ();
+  double std = (absmax * 2 * gaussian_const) / sqrt(2 * log(N));
 
- private:
-  int init_encoder();
-  int init_joiner();
+  return (float)(alpha_gaussian[num_bits - 1] * std);
+}
 
-  void quantize_encoder_weight();
-  void quantize_joiner_weight();
+float compute_aciq_threshold(QuantBlobStat &stat) {
+  float threshold = compute_aciq_gaussian_clip(stat.absmax, stat.total);
+  stat.threshold = std::min(stat.absmax, threshold);
 
- public:
-  std::vector<int> encoder_conv_layers;
-  std::vector<int> encoder_conv_bottom_blobs;
+  float scale = 127 / stat.threshold;
 
-  std::vector<int> joiner_conv_layers;
-  std::vector<int> joiner_conv_bottom_blobs;
+  return scale;
+}
 
-  // result
-  std::vector<QuantBlobStat> encoder_quant_blob_stats;
-  std::vector<ncnn::Mat> encoder_weight_scales;
-  std::vector<ncnn::Mat> encoder_bottom_blob_scales;
+// Use the given percentile of the absolute values as threshold
+float compute_percentile_threshold(QuantBlobStat &stat, float percentile,
+                                   int num_histogram_bins = 2048) {
+  uint64_t sum = 0;
+  for (int j = 0; j < num_histogram_bins; j++) {
+    sum += stat.histogram[j];
+  }
 
-  std::vector<QuantBlobStat> joiner_quant_blob_stats;
-  std::vector<ncnn::Mat> joiner_weight_scales;
-  std::vector<ncnn::Mat> joiner_bottom_blob_scales;
-};
+  const double target = sum * (percentile / 100.0);
 
-QuantNet::QuantNet(sherpa_ncnn::Model *model)
-    : model(model),
-      encoder_layers(model->GetEncoder().mutable_layers()),
-      joiner_layers(model->GetJoiner().mutable_layers()) {}
+  int target_bin = num_histogram_bins - 1;
+  uint64_t acc = 0;
+  for (int j = 0; j < num_histogram_bins; j++) {
+    acc += stat.histogram[j];
+    if (acc >= target) {
+      target_bin = j;
+      break;
+    }
+  }
 
-int QuantNet::init_encoder() {
-  // find all encoder conv layers
-  for (int i = 0; i < (int)encoder_layers.size(); i++) {
-    const ncnn::Layer *layer = encoder_layers[i];
-    if (layer->type == "Convolution" || layer->type == "ConvolutionDepthWise" ||
-        layer->type == "InnerProduct") {
-      encoder_conv_layers.push_back(i);
-      encoder_conv_bottom_blobs.push_back(layer->bottoms[0]);
+  stat.threshold = (target_bin + 1) * stat.absmax / num_histogram_bins;
+  float scale = 127 / stat.threshold;
+
+  return scale;
+}
+
+// Return max(abs(p[i])) for 0 <= i < n.
+//
+// The 8 independent accumulators let the compiler vectorize the loop
+// without requiring -ffast-math.
+static float compute_absmax(const float *p, int n) {
+  float m[8] = {0};
+  int k = 0;
+  for (; k + 8 <= n; k += 8) {
+    for (int i = 0; i != 8; ++i) {
+      m[i] = std::max(m[i], std::fabs(p[k + i]));
     }
   }
 
-  fprintf(stderr, "num encoder conv layers: %d\n",
-          static_cast<int32_t>(encoder_conv_layers.size()));
+  float absmax = 0.f;
+  for (int i = 0; i != 8; ++i) {
+    absmax = std::max(absmax, m[i]);
+  }
 
-  const int encoder_conv_layer_count = (int)encoder_conv_layers.size();
-  const int encoder_conv_bottom_blob_count =
-      (int)encoder_conv_bottom_blobs.size();
+  for (; k < n; ++k) {
+    absmax = std::max(absmax, std::fabs(p[k]));
+  }
 
-  encoder_quant_blob_stats.resize(encoder_conv_bottom_blob_count);
-  encoder_weight_scales.resize(encoder_conv_layer_count);
-  encoder_bottom_blob_scales.resize(encoder_conv_bottom_blob_count);
+  return absmax;
+}
 
-  return 0;
+static float compute_absmax(const ncnn::Mat &m) {
+  float absmax = 0.f;
+
+  const int outsize = m.w * m.h;
+  for (int p = 0; p < m.c; p++) {
+    absmax = std::max(absmax, compute_absmax(m.channel(p), outsize));
+  }
+
+  return absmax;
 }
 
-int QuantNet::init_joiner() {
-  // find all joiner conv layers
-  for (int i = 0; i < (int)joiner_layers.size(); i++) {
-    const ncnn::Layer *layer = joiner_layers[i];
-    if (layer->type == "Convolution" || layer->type == "ConvolutionDepthWise" ||
-        layer->type == "InnerProduct") {
-      joiner_conv_layers.push_back(i);
-      joiner_conv_bottom_blobs.push_back(layer->bottoms[0]);
+// Add the elements of m to histogram, which has num_histogram_bins bins
+// covering [0, absmax]. Zeros are ignored.
+static void update_histogram(const ncnn::Mat &m, float absmax,
+                             int num_histogram_bins, uint64_t *histogram) {
+  if (absmax == 0.f) return;
+
+  const float scale = num_histogram_bins / absmax;
+  const float max_index = static_cast<float>(num_histogram_bins - 1);
+
+  const int outsize = m.w * m.h;
+  for (int p = 0; p < m.c; p++) {
+    const float *ptr = m.channel(p);
+
+    // Compute the bin indexes of 8 elements at a time in a loop that can be
+    // vectorized and scatter them afterwards.
+    int index[8];
+    int k = 0;
+    for (; k + 8 <= outsize; k += 8) {
+      for (int i = 0; i != 8; ++i) {
+        float f = std::min(std::fabs(ptr[k + i]) * scale, max_index);
+        index[i] = static_cast<int>(f);
+      }
+
+      for (int i = 0; i != 8; ++i) {
+        histogram[index[i]] += (ptr[k + i] != 0.f);
+      }
+    }
+
+    for (; k < outsize; ++k) {
+      if (ptr[k] == 0.f) continue;
+
+      histogram[static_cast<int>(std::min(std::fabs(ptr[k]) * scale,
+                                          max_index))] += 1;
     }
   }
+}
 
-  fprintf(stderr, "num joiner conv layers: %d\n",
-          static_cast<int32_t>(joiner_conv_layers.size()));
+// Quantization info for one of the encoder, decoder, and joiner networks
+struct QuantNetInfo {
+  QuantNetInfo(const char *name, ncnn::Net &net)
+      : name(name), layers(net.mutable_layers()) {}
 
-  const int joiner_conv_layer_count = (int)joiner_conv_layers.size();
-  const int joiner_conv_bottom_blob_count =
-      (int)joiner_conv_bottom_blobs.size();
+  std::string name;
+  std::vector<ncnn::Layer *> &layers;
 
-  joiner_quant_blob_stats.resize(joiner_conv_bottom_blob_count);
-  joiner_weight_scales.resize(joiner_conv_layer_count);
-  joiner_bottom_blob_scales.resize(joiner_conv_bottom_blob_count);
+  // If false, no statistics are collected for this network
+  bool enabled = true;
 
-  return 0;
-}
+  std::vector<int> conv_layers;
+  std::vector<int> conv_bottom_blobs;
 
-int QuantNet::init() {
-  init_encoder();
-  init_joiner();
+  // result
+  std::vector<QuantBlobStat> quant_blob_stats;
+  std::vector<ncnn::Mat> weight_scales;
+  std::vector<ncnn::Mat> bottom_blob_scales;
+};
 
-  return 0;
-}
+// Statistics of one network collected by a single calibration thread
+struct QuantThreadNetStat {
+  std::vector<float> absmax;
+  std::vector<int> total;
+  std::vector<std::vector<uint64_t>> histograms;
+};
 
-void QuantNet::quantize_encoder_weight() {
-  const int encoder_conv_layer_count = (int)encoder_conv_layers.size();
+// Statistics collected by a single calibration thread. They are merged
+// after all threads have finished.
+struct QuantThreadStat {
+  QuantThreadNetStat encoder;
+  QuantThreadNetStat decoder;
+  QuantThreadNetStat joiner;
 
-  for (int i = 0; i < encoder_conv_layer_count; i++) {
-    const ncnn::Layer *layer = encoder_layers[encoder_conv_layers[i]];
-    if (layer->type == "Convolution") {
-      const ncnn::Convolution *convolution = (const ncnn::Convolution *)layer;
-      const int num_output = convolution->num_output;
-      const int kernel_w = convolution->kernel_w;
-      const int kernel_h = convolution->kernel_h;
-      const int dilation_w = convolution->dilation_w;
-      const int dilation_h = convolution->dilation_h;
-      const int stride_w = convolution->stride_w;
-      const int stride_h = convolution->stride_h;
+  ncnn::UnlockedPoolAllocator blob_allocator;
+  ncnn::UnlockedPoolAllocator workspace_allocator;
+};
 
-      const int weight_data_size_output =
-          convolution->weight_data_size / num_output;
+// Invoke func(thread_index, filename) for each file in filenames using
+// num_threads threads.
+static void parallel_for_files(
+    const std::vector<std::string> &filenames, int num_threads,
+    const std::function<void(int, const std::string &)> &func) {
+  std::atomic<int> next(0);
+
+  auto worker = [&](int thread_index) {
+    int i;
+    while ((i = next++) < static_cast<int>(filenames.size())) {
+      func(thread_index, filenames[i]);
+    }
+  };
 
-      // int8 winograd F43 needs weight data to use 6bit quantization
-      // TODO proper condition for winograd 3x3 int8
-      bool quant_6bit = false;
-      if (kernel_w == 3 && kernel_h == 3 && dilation_w == 1 &&
-          dilation_h == 1 && stride_w == 1 && stride_h == 1) {
-        quant_6bit = true;
-      }
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; ++i) {
+    threads.emplace_back(worker, i);
+  }
+  worker(0);
 
-      encoder_weight_scales[i].create(num_output);
-      for (int n = 0; n < num_output; n++) {
-        const ncnn::Mat weight_data_n = convolution->weight_data.range(
-            weight_data_size_output * n, weight_data_size_output);
+  for (auto &t : threads) {
+    t.join();
+  }
+}
 
-        float absmax = 0.f;
-        for (int k = 0; k < weight_data_size_output; k++) {
-          absmax = std::max(absmax, (float)fabs(weight_data_n[k]));
-        }
+class QuantNet {
+ public:
+  explicit QuantNet(sherpa_ncnn::Model *model);
 
-        if (quant_6bit) {
-          encoder_weight_scales[i][n] = 31 / absmax;
-        } else {
-          encoder_weight_scales[i][n] = 127 / absmax;
-        }
-      }
-    }  // if (layer->type == "Convolution")
+  sherpa_ncnn::Model *model;
+  int quantize_num_threads = 1;
 
-    if (layer->type == "ConvolutionDepthWise") {
-      const ncnn::ConvolutionDepthWise *convolutiondepthwise =
-          (const ncnn::ConvolutionDepthWise *)layer;
+  // Supported values: kl, aciq, percentile
+  std::string method = "kl";
 
-      const int group = convolutiondepthwise->group;
-      const int weight_data_size_output =
-          convolutiondepthwise->weight_data_size / group;
+  // Used only when method is percentile
+  float percentile = 99.99f;
 
-      std::vector<float> scales;
+  // Names of layers to keep in fp32. They are not written to the table.
+  std::set<std::string> skip_layers;
 
-      encoder_weight_scales[i].create(group);
+  static constexpr int num_histogram_bins = 2048;
 
-      for (int n = 0; n < group; n++) {
-        const ncnn::Mat weight_data_n = convolutiondepthwise->weight_data.range(
-            weight_data_size_output * n, weight_data_size_output);
+  QuantNetInfo encoder;
+  QuantNetInfo decoder;
+  QuantNetInfo joiner;
 
-        float absmax = 0.f;
-        for (int k = 0; k < weight_data_size_output; k++) {
-          absmax = std::max(absmax, (float)fabs(weight_data_n[k]));
-        }
+ public:
+  int init();
+  void print_quant_info() const;
+  int save_table(const QuantNetInfo &info, const char *tablepath) const;
+  int quantize(const std::vector<std::string> &wave_filenames);
 
-        encoder_weight_scales[i][n] = 127 / absmax;
+ private:
+  void init_net(QuantNetInfo *info);
+  void quantize_weight(QuantNetInfo *info);
+
+  // Run greedy search on the given wave file and update thread_stat with
+  // the bottom blobs of the conv layers of all enabled networks.
+  //
+  // If build_histogram is false, it updates the absmax of each blob;
+  // otherwise, it updates the histogram of each blob, which requires the
+  // absmax of all files.
+  int forward_file(const std::string &filename, bool build_histogram,
+                   QuantThreadStat *thread_stat) const;
+
+  // Update thread_net_stat with the conv bottom blobs of the network
+  // described by info. The blobs are extracted from ex.
+  void update_stat(const QuantNetInfo &info, ncnn::Extractor *ex,
+                   bool build_histogram,
+                   QuantThreadNetStat *thread_net_stat) const;
+
+  void init_thread_stat(const QuantNetInfo &info, bool build_histogram,
+                        QuantThreadNetStat *thread_net_stat) const;
+
+  void merge_thread_stat(const QuantThreadNetStat &thread_net_stat,
+                         bool build_histogram, QuantNetInfo *info) const;
+
+  void compute_scales(QuantNetInfo *info);
+};
+
+QuantNet::QuantNet(sherpa_ncnn::Model *model)
+    : model(model),
+      encoder("encoder", model->GetEncoder()),
+      decoder("decoder", model->GetDecoder()),
+      joiner("joiner", model->GetJoiner()) {}
+
+void QuantNet::init_net(QuantNetInfo *info) {
+  // find all conv layers
+  for (int i = 0; i < (int)info->layers.size(); i++) {
+    const ncnn::Layer *layer = info->layers[i];
+    if (layer->type == "Convolution" || layer->type == "ConvolutionDepthWise" ||
+        layer->type == "InnerProduct") {
+      if (skip_layers.count(layer->name)) {
+        fprintf(stderr, "skip %s layer %s\n", info->name.c_str(),
+                layer->name.c_str());
+        continue;
       }
-    }  // if (layer->type == "ConvolutionDepthWise")
 
-    if (layer->type == "InnerProduct") {
-      const ncnn::InnerProduct *innerproduct =
-          (const ncnn::InnerProduct *)layer;
+      info->conv_layers.push_back(i);
+      info->conv_bottom_blobs.push_back(layer->bottoms[0]);
+    }
+  }
 
-      const int num_output = innerproduct->num_output;
-      const int weight_data_size_output =
-          innerproduct->weight_data_size / num_output;
+  fprintf(stderr, "num %s conv layers: %d\n", info->name.c_str(),
+          static_cast<int32_t>(info->conv_layers.size()));
 
-      encoder_weight_scales[i].create(num_output);
+  const int conv_layer_count = (int)info->conv_layers.size();
+  const int conv_bottom_blob_count = (int)info->conv_bottom_blobs.size();
 
-      for (int n = 0; n < num_output; n++) {
-        const ncnn::Mat weight_data_n = innerproduct->weight_data.range(
-            weight_data_size_output * n, weight_data_size_output);
+  info->quant_blob_stats.resize(conv_bottom_blob_count);
+  info->weight_scales.resize(conv_layer_count);
+  info->bottom_blob_scales.resize(conv_bottom_blob_count);
+}
 
-        float absmax = 0.f;
-        for (int k = 0; k < weight_data_size_output; k++) {
-          absmax = std::max(absmax, (float)fabs(weight_data_n[k]));
-        }
+int QuantNet::init() {
+  init_net(&encoder);
+  if (decoder.enabled) {
+    init_net(&decoder);
+  }
+  init_net(&joiner);
 
-        encoder_weight_scales[i][n] = 127 / absmax;
-      }
-    }  // if (layer->type == "InnerProduct")
-  }    // for (int i = 0; i < encoder_conv_layer_count; i++)
+  return 0;
 }
 
-void QuantNet::quantize_joiner_weight() {
-  const int joiner_conv_layer_count = (int)joiner_conv_layers.size();
+void QuantNet::quantize_weight(QuantNetInfo *info) {
+  const int conv_layer_count = (int)info->conv_layers.size();
 
-  for (int i = 0; i < joiner_conv_layer_count; i++) {
-    const ncnn::Layer *layer = joiner_layers[joiner_conv_layers[i]];
+  for (int i = 0; i < conv_layer_count; i++) {
+    const ncnn::Layer *layer = info->layers[info->conv_layers[i]];
     if (layer->type == "Convolution") {
       const ncnn::Convolution *convolution = (const ncnn::Convolution *)layer;
       const int num_output = convolution->num_output;
@@ -467,20 +566,17 @@ void QuantNet::quantize_joiner_weight() {
         quant_6bit = true;
       }
 
-      joiner_weight_scales[i].create(num_output);
+      info->weight_scales[i].create(num_output);
       for (int n = 0; n < num_output; n++) {
         const ncnn::Mat weight_data_n = convolution->weight_data.range(
             weight_data_size_output * n, weight_data_size_output);
 
-        float absmax = 0.f;
-        for (int k = 0; k < weight_data_size_output; k++) {
-          absmax = std::max(absmax, (float)fabs(weight_data_n[k]));
-        }
+        float absmax = compute_absmax(weight_data_n, weight_data_size_output);
 
         if (quant_6bit) {
-          joiner_weight_scales[i][n] = 31 / absmax;
+          info->weight_scales[i][n] = 31 / absmax;
         } else {
-          joiner_weight_scales[i][n] = 127 / absmax;
+          info->weight_scales[i][n] = 127 / absmax;
         }
       }
     }  // if (layer->type == "Convolution")
@@ -493,20 +589,15 @@ void QuantNet::quantize_joiner_weight() {
       const int weight_data_size_output =
           convolutiondepthwise->weight_data_size / group;
 
-      std::vector<float> scales;
-
-      joiner_weight_scales[i].create(group);
+      info->weight_scales[i].create(group);
 
       for (int n = 0; n < group; n++) {
         const ncnn::Mat weight_data_n = convolutiondepthwise->weight_data.range(
             weight_data_size_output * n, weight_data_size_output);
 
-        float absmax = 0.f;
-        for (int k = 0; k < weight_data_size_output; k++) {
-          absmax = std::max(absmax, (float)fabs(weight_data_n[k]));
-        }
+        float absmax = compute_absmax(weight_data_n, weight_data_size_output);
 
-        joiner_weight_scales[i][n] = 127 / absmax;
+        info->weight_scales[i][n] = 127 / absmax;
       }
     }  // if (layer->type == "ConvolutionDepthWise")
 
@@ -518,433 +609,301 @@ void QuantNet::quantize_joiner_weight() {
       const int weight_data_size_output =
           innerproduct->weight_data_size / num_output;
 
-      joiner_weight_scales[i].create(num_output);
+      info->weight_scales[i].create(num_output);
 
       for (int n = 0; n < num_output; n++) {
         const ncnn::Mat weight_data_n = innerproduct->weight_data.range(
             weight_data_size_output * n, weight_data_size_output);
 
-        float absmax = 0.f;
-        for (int k = 0; k < weight_data_size_output; k++) {
-          absmax = std::max(absmax, (float)fabs(weight_data_n[k]));
-        }
+        float absmax = compute_absmax(weight_data_n, weight_data_size_output);
 
-        joiner_weight_scales[i][n] = 127 / absmax;
+        info->weight_scales[i][n] = 127 / absmax;
       }
     }  // if (layer->type == "InnerProduct")
-  }    // for (int i = 0; i < joiner_conv_layer_count; i++)
+  }    // for (int i = 0; i < conv_layer_count; i++)
 }
 
-int QuantNet::quantize_KL(const std::vector<std::string> &wave_filenames) {
-  const int encoder_conv_bottom_blob_count =
-      (int)encoder_conv_bottom_blobs.size();
-
-  const int joiner_conv_bottom_blob_count =
-      (int)joiner_conv_bottom_blobs.size();
-
-  fprintf(stderr, "num files: %d\n", (int)wave_filenames.size());
+void QuantNet::init_thread_stat(const QuantNetInfo &info,
+                                bool build_histogram,
+                                QuantThreadNetStat *thread_net_stat) const {
+  const int conv_bottom_blob_count = (int)info.conv_bottom_blobs.size();
+  if (build_histogram) {
+    thread_net_stat->histograms.assign(
+        conv_bottom_blob_count, std::vector<uint64_t>(num_histogram_bins, 0));
+  } else {
+    thread_net_stat->absmax.assign(conv_bottom_blob_count, 0.f);
+    thread_net_stat->total.assign(conv_bottom_blob_count, 0);
+  }
+}
 
-  const int num_histogram_bins = 2048;
-  std::vector<ncnn::UnlockedPoolAllocator> blob_allocators(1);
-  std::vector<ncnn::UnlockedPoolAllocator> workspace_allocators(1);
+void QuantNet::merge_thread_stat(const QuantThreadNetStat &thread_net_stat,
+                                 bool build_histogram,
+                                 QuantNetInfo *info) const {
+  const int conv_bottom_blob_count = (int)info->conv_bottom_blobs.size();
+  for (int i = 0; i < conv_bottom_blob_count; i++) {
+    QuantBlobStat &stat = info->quant_blob_stats[i];
+    if (build_histogram) {
+      for (int k = 0; k < num_histogram_bins; k++) {
+        stat.histogram[k] += thread_net_stat.histograms[i][k];
+      }
+    } else {
+      stat.absmax = std::max(stat.absmax, thread_net_stat.absmax[i]);
+      stat.total = std::max(stat.total, thread_net_stat.total[i]);
+    }
+  }
+}
 
-  // initialize conv weight scales
-  quantize_encoder_weight();
-  quantize_joiner_weight();
+void QuantNet::update_stat(const QuantNetInfo &info, ncnn::Extractor *ex,
+                           bool build_histogram,
+                           QuantThreadNetStat *thread_net_stat) const {
+  const int conv_bottom_blob_count = (int)info.conv_bottom_blobs.size();
+
+  for (int j = 0; j < conv_bottom_blob_count; j++) {
+    ncnn::Mat out;
+    ex->extract(info.conv_bottom_blobs[j], out);
+
+    if (build_histogram) {
+      update_histogram(out, info.quant_blob_stats[j].absmax,
+                       num_histogram_bins,
+                       thread_net_stat->histograms[j].data());
+    } else {
+      float &absmax = thread_net_stat->absmax[j];
+      absmax = std::max(absmax, compute_absmax(out));
+
+      int &total = thread_net_stat->total[j];
+      total = std::max(total, out.c * out.w * out.h);
+    }
+  }  // for (int j = 0; j < conv_bottom_blob_count; j++)
+}
 
+int QuantNet::forward_file(const std::string &filename, bool build_histogram,
+                           QuantThreadStat *thread_stat) const {
   float expected_sampling_rate = 16000;
 
+  bool is_ok = false;
+  std::vector<float> samples =
+      sherpa_ncnn::ReadWave(filename, expected_sampling_rate, &is_ok);
+  if (!is_ok) {
+    fprintf(stderr, "Failed to read %s\n", filename.c_str());
+    return -1;
+  }
+  fprintf(stderr, "Processing %s\n", filename.c_str());
+
   knf::FbankOptions fbank_opts;
   fbank_opts.frame_opts.dither = 0;
   fbank_opts.frame_opts.snip_edges = false;
   fbank_opts.frame_opts.samp_freq = expected_sampling_rate;
   fbank_opts.mel_opts.num_bins = 80;
 
+  sherpa_ncnn::FeatureExtractor feature_extractor(fbank_opts);
+  feature_extractor.AcceptWaveform(expected_sampling_rate, samples.data(),
+                                   samples.size());
+  feature_extractor.InputFinished();
+
   int32_t segment = model->Segment();
   int32_t offset = model->Offset();
+  int32_t context_size = model->ContextSize();
+  int32_t blank_id = model->BlankId();
 
-  // count the absmax
-  for (const auto &filename : wave_filenames) {
-    bool is_ok = false;
-    std::vector<float> samples =
-        sherpa_ncnn::ReadWave(filename, expected_sampling_rate, &is_ok);
-    if (!is_ok) {
-      fprintf(stderr, "Failed to read %s\n", filename.c_str());
-      continue;
-    }
-    fprintf(stderr, "Processing %s\n", filename.c_str());
-
-    sherpa_ncnn::FeatureExtractor feature_extractor(fbank_opts);
-    feature_extractor.AcceptWaveform(expected_sampling_rate, samples.data(),
-                                     samples.size());
-    feature_extractor.InputFinished();
+  std::vector<int32_t> hyp(context_size, blank_id);
 
-    int32_t context_size = model->ContextSize();
-    int32_t blank_id = model->BlankId();
+  ncnn::Mat decoder_input(context_size);
 
-    std::vector<int32_t> hyp(context_size, blank_id);
+  // Run the decoder on the last context_size tokens of hyp
+  auto run_decoder = [&]() -> ncnn::Mat {
+    std::copy(hyp.end() - context_size, hyp.end(),
+              static_cast<int32_t *>(decoder_input));
 
-    ncnn::Mat decoder_input(context_size);
-    for (int32_t i = 0; i != context_size; ++i) {
-      static_cast<int32_t *>(decoder_input)[i] = blank_id;
+    if (!decoder.enabled) {
+      return model->RunDecoder(decoder_input);
     }
 
-    ncnn::Mat decoder_out = model->RunDecoder(decoder_input);
+    ncnn::Extractor decoder_ex = model->GetDecoder().create_extractor();
+    decoder_ex.set_light_mode(false);
+    decoder_ex.set_blob_allocator(&thread_stat->blob_allocator);
+    decoder_ex.set_workspace_allocator(&thread_stat->workspace_allocator);
 
-    std::vector<ncnn::Mat> states;
-    ncnn::Mat encoder_out;
+    ncnn::Mat decoder_out = model->RunDecoder(decoder_input, &decoder_ex);
 
-    int32_t num_processed = 0;
-    while (feature_extractor.NumFramesReady() - num_processed >= segment) {
-      ncnn::Extractor encoder_ex = model->GetEncoder().create_extractor();
-      encoder_ex.set_light_mode(false);
-      encoder_ex.set_blob_allocator(&blob_allocators[0]);
-      encoder_ex.set_workspace_allocator(&workspace_allocators[0]);
+    update_stat(decoder, &decoder_ex, build_histogram, &thread_stat->decoder);
 
-      ncnn::Extractor joiner_ex = model->GetJoiner().create_extractor();
-      joiner_ex.set_light_mode(false);
-      joiner_ex.set_blob_allocator(&blob_allocators[0]);
-      joiner_ex.set_workspace_allocator(&workspace_allocators[0]);
-
-      ncnn::Mat features = feature_extractor.GetFrames(num_processed, segment);
-      num_processed += offset;
-      std::tie(encoder_out, states) =
-          model->RunEncoder(features, states, &encoder_ex);
-
-      for (int j = 0; j < encoder_conv_bottom_blob_count; j++) {
-        ncnn::Mat out;
-        encoder_ex.extract(encoder_conv_bottom_blobs[j], out);
-
-        {
-          // count absmax
-          float absmax = 0.f;
-
-          const int outc = out.c;
-          const int outsize = out.w * out.h;
-          for (int p = 0; p < outc; p++) {
-            const float *ptr = out.channel(p);
-            for (int k = 0; k < outsize; k++) {
-              absmax = std::max(absmax, (float)fabs(ptr[k]));
-            }
-          }
-
-          QuantBlobStat &stat = encoder_quant_blob_stats[j];
-          stat.absmax = std::max(stat.absmax, absmax);
-        }
-      }  // for (int j = 0; j < encoder_conv_bottom_blob_count; j++)
-
-      // now for joiner
-      for (int32_t t = 0; t != encoder_out.h; ++t) {
-        ncnn::Mat encoder_out_t(encoder_out.w, encoder_out.row(t));
-        ncnn::Mat joiner_out =
-            model->RunJoiner(encoder_out_t, decoder_out, &joiner_ex);
-
-        for (int j = 0; j < joiner_conv_bottom_blob_count; j++) {
-          ncnn::Mat out;
-          joiner_ex.extract(joiner_conv_bottom_blobs[j], out);
-
-          {
-            // count absmax
-            float absmax = 0.f;
-
-            const int outc = out.c;
-            const int outsize = out.w * out.h;
-            for (int p = 0; p < outc; p++) {
-              const float *ptr = out.channel(p);
-              for (int k = 0; k < outsize; k++) {
-                absmax = std::max(absmax, (float)fabs(ptr[k]));
-              }
-            }
-
-            QuantBlobStat &stat = joiner_quant_blob_stats[j];
-            stat.absmax = std::max(stat.absmax, absmax);
-          }
-        }  // for (int j = 0; j < joiner_conv_bottom_blob_count; j++)
-
-        auto y = static_cast<int32_t>(std::distance(
-            static_cast<const float *>(joiner_out),
-            std::max_element(
-                static_cast<const float *>(joiner_out),
-                static_cast<const float *>(joiner_out) + joiner_out.w)));
-
-        if (y != blank_id) {
-          static_cast<int32_t *>(decoder_input)[0] = hyp.back();
-          static_cast<int32_t *>(decoder_input)[1] = y;
-          hyp.push_back(y);
-
-          decoder_out = model->RunDecoder(decoder_input);
-        }
-      }  // for (int32_t t = 0; t != encoder_out.h; ++t)
+    return decoder_out;
+  };
 
-    }  // while (feature_extractor.NumFramesReady() - num_processed >=
-       // segment)
-  }    // for (const auto &filename : wave_filenames)
+  ncnn::Mat decoder_out = run_decoder();
 
-  // initialize histogram
-  for (int i = 0; i < encoder_conv_bottom_blob_count; i++) {
-    QuantBlobStat &stat = encoder_quant_blob_stats[i];
+  std::vector<ncnn::Mat> states;
+  ncnn::Mat encoder_out;
 
-    stat.histogram.resize(num_histogram_bins, 0);
-    stat.histogram_normed.resize(num_histogram_bins, 0);
-  }
-
-  for (int i = 0; i < joiner_conv_bottom_blob_count; i++) {
-    QuantBlobStat &stat = joiner_quant_blob_stats[i];
-
-    stat.histogram.resize(num_histogram_bins, 0);
-    stat.histogram_normed.resize(num_histogram_bins, 0);
-  }
+  int32_t num_processed = 0;
+  while (feature_extractor.NumFramesReady() - num_processed >= segment) {
+    ncnn::Extractor encoder_ex = model->GetEncoder().create_extractor();
+    encoder_ex.set_light_mode(false);
+    encoder_ex.set_blob_allocator(&thread_stat->blob_allocator);
+    encoder_ex.set_workspace_allocator(&thread_stat->workspace_allocator);
 
-  // build histogram
-  for (const auto &filename : wave_filenames) {
-    bool is_ok = false;
-    std::vector<float> samples =
-        sherpa_ncnn::ReadWave(filename, expected_sampling_rate, &is_ok);
-    if (!is_ok) {
-      fprintf(stderr, "Failed to read %s\n", filename.c_str());
-      continue;
-    }
-    fprintf(stderr, "Processing %s\n", filename.c_str());
-
-    sherpa_ncnn::FeatureExtractor feature_extractor(fbank_opts);
-    feature_extractor.AcceptWaveform(expected_sampling_rate, samples.data(),
-                                     samples.size());
-    feature_extractor.InputFinished();
+    ncnn::Mat features = feature_extractor.GetFrames(num_processed, segment);
+    num_processed += offset;
+    std::tie(encoder_out, states) =
+        model->RunEncoder(features, states, &encoder_ex);
 
-    int32_t context_size = model->ContextSize();
-    int32_t blank_id = model->BlankId();
-
-    std::vector<int32_t> hyp(context_size, blank_id);
-
-    ncnn::Mat decoder_input(context_size);
-    for (int32_t i = 0; i != context_size; ++i) {
-      static_cast<int32_t *>(decoder_input)[i] = blank_id;
-    }
-
-    ncnn::Mat decoder_out = model->RunDecoder(decoder_input);
-
-    std::vector<ncnn::Mat> states;
-    ncnn::Mat encoder_out;
-
-    int32_t num_processed = 0;
-    while (feature_extractor.NumFramesReady() - num_processed >= segment) {
-      ncnn::Extractor encoder_ex = model->GetEncoder().create_extractor();
-      encoder_ex.set_light_mode(false);
-      encoder_ex.set_blob_allocator(&blob_allocators[0]);
-      encoder_ex.set_workspace_allocator(&workspace_allocators[0]);
+    update_stat(encoder, &encoder_ex, build_histogram, &thread_stat->encoder);
 
+    // now for joiner
+    for (int32_t t = 0; t != encoder_out.h; ++t) {
       ncnn::Extractor joiner_ex = model->GetJoiner().create_extractor();
       joiner_ex.set_light_mode(false);
-      joiner_ex.set_blob_allocator(&blob_allocators[0]);
-      joiner_ex.set_workspace_allocator(&workspace_allocators[0]);
-
-      ncnn::Mat features = feature_extractor.GetFrames(num_processed, segment);
-      num_processed += offset;
-      std::tie(encoder_out, states) =
-          model->RunEncoder(features, states, &encoder_ex);
-
-      for (int j = 0; j < encoder_conv_bottom_blob_count; j++) {
-        ncnn::Mat out;
-        encoder_ex.extract(encoder_conv_bottom_blobs[j], out);
-
-        // count histogram bin
-        {
-          const float absmax = encoder_quant_blob_stats[j].absmax;
+      joiner_ex.set_blob_allocator(&thread_stat->blob_allocator);
+      joiner_ex.set_workspace_allocator(&thread_stat->workspace_allocator);
 
-          std::vector<uint64_t> histogram(num_histogram_bins, 0);
+      ncnn::Mat encoder_out_t(encoder_out.w, encoder_out.row(t));
+      ncnn::Mat joiner_out =
+          model->RunJoiner(encoder_out_t, decoder_out, &joiner_ex);
 
-          const int outc = out.c;
-          const int outsize = out.w * out.h;
-          for (int p = 0; p < outc; p++) {
-            const float *ptr = out.channel(p);
-            for (int k = 0; k < outsize; k++) {
-              if (ptr[k] == 0.f) continue;
+      update_stat(joiner, &joiner_ex, build_histogram, &thread_stat->joiner);
 
-              const int index =
-                  std::min((int)(fabs(ptr[k]) / absmax * num_histogram_bins),
-                           (num_histogram_bins - 1));
+      auto y = static_cast<int32_t>(std::distance(
+          static_cast<const float *>(joiner_out),
+          std::max_element(
+              static_cast<const float *>(joiner_out),
+              static_cast<const float *>(joiner_out) + joiner_out.w)));
 
-              histogram[index] += 1;
-            }
-          }
-
-          QuantBlobStat &stat = encoder_quant_blob_stats[j];
-
-          for (int k = 0; k < num_histogram_bins; k++) {
-            stat.histogram[k] += histogram[k];
-          }
-        }
-      }  // for (int j = 0; j < encoder_conv_bottom_blob_count; j++)
-
-      // now for joiner
-      for (int32_t t = 0; t != encoder_out.h; ++t) {
-        ncnn::Mat encoder_out_t(encoder_out.w, encoder_out.row(t));
-        ncnn::Mat joiner_out =
-            model->RunJoiner(encoder_out_t, decoder_out, &joiner_ex);
-
-        for (int j = 0; j < joiner_conv_bottom_blob_count; j++) {
-          ncnn::Mat out;
-          joiner_ex.extract(joiner_conv_bottom_blobs[j], out);
-
-          // count histogram bin
-          {
-            const float absmax = joiner_quant_blob_stats[j].absmax;
-
-            std::vector<uint64_t> histogram(num_histogram_bins, 0);
-
-            const int outc = out.c;
-            const int outsize = out.w * out.h;
-            for (int p = 0; p < outc; p++) {
-              const float *ptr = out.channel(p);
-              for (int k = 0; k < outsize; k++) {
-                if (ptr[k] == 0.f) continue;
-
-                const int index =
-                    std::min((int)(fabs(ptr[k]) / absmax * num_histogram_bins),
-                             (num_histogram_bins - 1));
-
-                histogram[index] += 1;
-              }
-            }
-
-            QuantBlobStat &stat = joiner_quant_blob_stats[j];
-
-            for (int k = 0; k < num_histogram_bins; k++) {
-              stat.histogram[k] += histogram[k];
-            }
-          }
-        }  // for (int j = 0; j < joiner_conv_bottom_blob_count; j++)
-
-        auto y = static_cast<int32_t>(std::distance(
-            static_cast<const float *>(joiner_out),
-            std::max_element(
-                static_cast<const float *>(joiner_out),
-                static_cast<const float *>(joiner_out) + joiner_out.w)));
-
-        if (y != blank_id) {
-          static_cast<int32_t *>(decoder_input)[0] = hyp.back();
-          static_cast<int32_t *>(decoder_input)[1] = y;
-          hyp.push_back(y);
-
-          decoder_out = model->RunDecoder(decoder_input);
-        }
-      }  // for (int32_t t = 0; t != encoder_out.h; ++t)
-
-    }  // while (feature_extractor.NumFramesReady() - num_processed >=
+      if (y != blank_id) {
+        hyp.push_back(y);
+        decoder_out = run_decoder();
+      }
+    }  // for (int32_t t = 0; t != encoder_out.h; ++t)
+  }    // while (feature_extractor.NumFramesReady() - num_processed >=
        // segment)
-  }    // for (const auto &filename : wave_filenames)
-
-  // using kld to find the best threshold value
-  for (int i = 0; i < encoder_conv_bottom_blob_count; i++) {
-    QuantBlobStat &stat = encoder_quant_blob_stats[i];
 
-    float scale = compute_kl_threshold(stat, num_histogram_bins);
-
-    encoder_bottom_blob_scales[i].create(1);
-    encoder_bottom_blob_scales[i][0] = scale;
-  }  // for (int i = 0; i < encoder_conv_bottom_blob_count; i++)
+  return 0;
+}
 
-  for (int i = 0; i < joiner_conv_bottom_blob_count; i++) {
-    QuantBlobStat &stat = joiner_quant_blob_stats[i];
+void QuantNet::compute_scales(QuantNetInfo *info) {
+  const int conv_bottom_blob_count = (int)info->conv_bottom_blobs.size();
+
+  for (int i = 0; i < conv_bottom_blob_count; i++) {
+    QuantBlobStat &stat = info->quant_blob_stats[i];
+
+    float scale;
+    if (method == "aciq") {
+      scale = compute_aciq_threshold(stat);
+    } else if (method == "percentile") {
+      scale =
+          compute_percentile_threshold(stat, percentile, num_histogram_bins);
+    } else {
+      // using kld to find the best threshold value
+      scale = compute_kl_threshold(stat, num_histogram_bins);
+    }
 
-    float scale = compute_kl_threshold(stat, num_histogram_bins);
+    info->bottom_blob_scales[i].create(1);
+    info->bottom_blob_scales[i][0] = scale;
+  }  // for (int i = 0; i < conv_bottom_blob_count; i++)
+}
 
-    joiner_bottom_blob_scales[i].create(1);
-    joiner_bottom_blob_scales[i][0] = scale;
-  }  // for (int i = 0; i < joiner_conv_bottom_blob_count; i++)
+int QuantNet::quantize(const std::vector<std::string> &wave_filenames) {
+  fprintf(stderr, "num files: %d\n", (int)wave_filenames.size());
+  fprintf(stderr, "num threads: %d\n", quantize_num_threads);
+  fprintf(stderr, "method: %s\n", method.c_str());
 
-  return 0;
-}
+  std::vector<QuantNetInfo *> infos = {&encoder, &joiner};
+  if (decoder.enabled) {
+    infos.push_back(&decoder);
+  }
 
-void QuantNet::print_quant_info() const {
-  fprintf(stderr, "----------encoder----------\n");
-  for (int i = 0; i < (int)encoder_conv_bottom_blobs.size(); i++) {
-    const QuantBlobStat &stat = encoder_quant_blob_stats[i];
+  // initialize conv weight scales
+  for (auto info : infos) {
+    quantize_weight(info);
+  }
 
-    float scale = 127 / stat.threshold;
+  std::vector<QuantThreadStat> thread_stats(quantize_num_threads);
 
-    fprintf(stderr, "%-40s : max = %-15f  threshold = %-15f  scale = %-15f\n",
-            encoder_layers[encoder_conv_layers[i]]->name.c_str(), stat.absmax,
-            stat.threshold, scale);
+  // ACIQ needs only the absmax. KL and percentile need also the histogram.
+  std::vector<bool> passes = {false};
+  if (method != "aciq") {
+    passes.push_back(true);
   }
 
-  fprintf(stderr, "----------joiner----------\n");
-  // for joiner
-  for (int i = 0; i < (int)joiner_conv_bottom_blobs.size(); i++) {
-    const QuantBlobStat &stat = joiner_quant_blob_stats[i];
+  for (bool build_histogram : passes) {
+    if (build_histogram) {
+      // initialize histogram
+      for (auto info : infos) {
+        for (auto &stat : info->quant_blob_stats) {
+          stat.histogram.resize(num_histogram_bins, 0);
+          stat.histogram_normed.resize(num_histogram_bins, 0);
+        }
+      }
+    }
 
-    float scale = 127 / stat.threshold;
+    for (auto &s : thread_stats) {
+      init_thread_stat(encoder, build_histogram, &s.encoder);
+      init_thread_stat(decoder, build_histogram, &s.decoder);
+      init_thread_stat(joiner, build_histogram, &s.joiner);
+    }
+
+    parallel_for_files(wave_filenames, quantize_num_threads,
+                       [&](int thread_index, const std::string &filename) {
+                         forward_file(filename, build_histogram,
+                                      &thread_stats[thread_index]);
+                       });
 
-    fprintf(stderr, "%-40s : max = %-15f  threshold = %-15f  scale = %-15f\n",
-            joiner_layers[joiner_conv_layers[i]]->name.c_str(), stat.absmax,
-            stat.threshold, scale);
+    for (const auto &s : thread_stats) {
+      merge_thread_stat(s.encoder, build_histogram, &encoder);
+      merge_thread_stat(s.decoder, build_histogram, &decoder);
+      merge_thread_stat(s.joiner, build_histogram, &joiner);
+    }
   }
-}
 
-int QuantNet::save_table_encoder(const char *tablepath) {
-  FILE *fp = fopen(tablepath, "wb");
-  if (!fp) {
-    fprintf(stderr, "fopen %s failed\n", tablepath);
-    return -1;
+  for (auto info : infos) {
+    compute_scales(info);
   }
 
-  const int encoder_conv_layer_count = (int)encoder_conv_layers.size();
-  const int encoder_conv_bottom_blob_count =
-      (int)encoder_conv_bottom_blobs.size();
+  return 0;
+}
 
-  for (int i = 0; i < encoder_conv_layer_count; i++) {
-    const ncnn::Mat &weight_scale = encoder_weight_scales[i];
+void QuantNet::print_quant_info() const {
+  for (const QuantNetInfo *info : {&encoder, &decoder, &joiner}) {
+    if (!info->enabled) continue;
 
-    fprintf(fp, "%s_param_0 ",
-            encoder_layers[encoder_conv_layers[i]]->name.c_str());
-    for (int j = 0; j < weight_scale.w; j++) {
-      fprintf(fp, "%f ", weight_scale[j]);
-    }
-    fprintf(fp, "\n");
-  }
+    fprintf(stderr, "----------%s----------\n", info->name.c_str());
+    for (int i = 0; i < (int)info->conv_bottom_blobs.size(); i++) {
+      const QuantBlobStat &stat = info->quant_blob_stats[i];
 
-  for (int i = 0; i < encoder_conv_bottom_blob_count; i++) {
-    const ncnn::Mat &bottom_blob_scale = encoder_bottom_blob_scales[i];
+      float scale = 127 / stat.threshold;
 
-    fprintf(fp, "%s ", encoder_layers[encoder_conv_layers[i]]->name.c_str());
-    for (int j = 0; j < bottom_blob_scale.w; j++) {
-      fprintf(fp, "%f ", bottom_blob_scale[j]);
+      fprintf(stderr,
+              "%-40s : max = %-15f  threshold = %-15f  scale = %-15f\n",
+              info->layers[info->conv_layers[i]]->name.c_str(), stat.absmax,
+              stat.threshold, scale);
     }
-    fprintf(fp, "\n");
   }
-
-  fclose(fp);
-
-  return 0;
 }
 
-int QuantNet::save_table_joiner(const char *tablepath) {
+int QuantNet::save_table(const QuantNetInfo &info,
+                         const char *tablepath) const {
   FILE *fp = fopen(tablepath, "wb");
   if (!fp) {
     fprintf(stderr, "fopen %s failed\n", tablepath);
     return -1;
   }
 
-  const int joiner_conv_layer_count = (int)joiner_conv_layers.size();
-  const int joiner_conv_bottom_blob_count =
-      (int)joiner_conv_bottom_blobs.size();
-
-  for (int i = 0; i < joiner_conv_layer_count; i++) {
-    const ncnn::Mat &weight_scale = joiner_weight_scales[i];
+  const int conv_layer_count = (int)info.conv_layers.size();
+  const int conv_bottom_blob_count = (int)info.conv_bottom_blobs.size();
 
-    fprintf(fp, "%s_param_0 ",
-            joiner_layers[joiner_conv_layers[i]]->name.c_str());
+  for (int i = 0; i < conv_layer_count; i++) {
+    const ncnn::Mat &weight_scale = info.weight_scales[i];
 
+    fprintf(fp, "%s_param_0 ", info.layers[info.conv_layers[i]]->name.c_str());
     for (int j = 0; j < weight_scale.w; j++) {
       fprintf(fp, "%f ", weight_scale[j]);
     }
     fprintf(fp, "\n");
   }
 
-  for (int i = 0; i < joiner_conv_bottom_blob_count; i++) {
-    const ncnn::Mat &bottom_blob_scale = joiner_bottom_blob_scales[i];
+  for (int i = 0; i < conv_bottom_blob_count; i++) {
+    const ncnn::Mat &bottom_blob_scale = info.bottom_blob_scales[i];
 
-    fprintf(fp, "%s ", joiner_layers[joiner_conv_layers[i]]->name.c_str());
+    fprintf(fp, "%s ", info.layers[info.conv_layers[i]]->name.c_str());
     for (int j = 0; j < bottom_blob_scale.w; j++) {
       fprintf(fp, "%f ", bottom_blob_scale[j]);
     }
@@ -953,9 +912,8 @@ int QuantNet::save_table_joiner(const char *tablepath) {
 
   fclose(fp);
 
-  fprintf(stderr,
-          "ncnn int8 calibration table create success, best wish for your int8 "
-          "inference has a low accuracy loss...\\(^0^)/...233...\n");
+  fprintf(stderr, "Saved %s scale table to %s\n", info.name.c_str(),
+          tablepath);
 
   return 0;
 }
@@ -970,37 +928,114 @@ static std::vector<std::string> ReadWaveFilenames(const char *f) {
   return ans;
 }
 
+static std::set<std::string> SplitLayerNames(const std::string &s) {
+  std::set<std::string> ans;
+  std::istringstream is(s);
+  std::string name;
+  while (std::getline(is, name, ',')) {
+    if (!name.empty()) {
+      ans.insert(name);
+    }
+  }
+  return ans;
+}
+
 static void ShowUsage() {
   fprintf(
       stderr,
       "Usage:\ngenerate-int8-scale-table encoder.param "
       "encoder.bin decoder.param decoder.bin joiner.param joiner.bin "
-      "encoder-scale-table.txt joiner-scale-table.txt wave_filenames.txt\n\n"
+      "encoder-scale-table.txt joiner-scale-table.txt wave_filenames.txt "
+      "[options]\n\n"
       "Each line in wave_filenames.txt is a path to some 16k Hz mono wave "
-      "file.\n");
+      "file.\n\n"
+      "Options:\n"
+      "  --num-threads=N       Number of threads to process the wave files\n"
+      "                        in parallel. Defaults to the number of CPU\n"
+      "                        cores.\n"
+      "  --method=M            Method to compute the activation thresholds.\n"
+      "                        Valid values: kl, aciq, percentile.\n"
+      "                        Defaults to kl.\n"
+      "  --percentile=P        Used only when method is percentile.\n"
+      "                        Defaults to 99.99.\n"
+      "  --skip-layers=a,b,c   Comma separated names of layers to keep in\n"
+      "                        fp32. They are not written to the tables.\n"
+      "  --decoder-scale-table=decoder-scale-table.txt\n"
+      "                        If given, also calibrate the decoder and\n"
+      "                        save its scale table to this file.\n");
 }
 
 int main(int argc, char **argv) {
-  if (argc != 10) {
-    fprintf(stderr, "Please provide 10 arg. Currently given: %d\n", argc);
+  std::vector<const char *> args;
+  int32_t quantize_num_threads =
+      std::max(1, static_cast<int32_t>(std::thread::hardware_concurrency()));
+  std::string method = "kl";
+  float percentile = 99.99f;
+  std::set<std::string> skip_layers;
+  std::string decoder_scale_table;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    std::string value;
+    auto pos = arg.find('=');
+    if (pos != std::string::npos) {
+      value = arg.substr(pos + 1);
+    }
+
+    if (arg.compare(0, 14, "--num-threads=") == 0) {
+      quantize_num_threads = std::max(1, atoi(value.c_str()));
+    } else if (arg.compare(0, 9, "--method=") == 0) {
+      method = value;
+    } else if (arg.compare(0, 13, "--percentile=") == 0) {
+      percentile = atof(value.c_str());
+    } else if (arg.compare(0, 14, "--skip-layers=") == 0) {
+      skip_layers = SplitLayerNames(value);
+    } else if (arg.compare(0, 22, "--decoder-scale-table=") == 0) {
+      decoder_scale_table = value;
+    } else if (arg.compare(0, 2, "--") == 0) {
+      fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+      ShowUsage();
+      return 1;
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+
+  if (args.size() != 9) {
+    fprintf(stderr, "Please provide 9 positional args. Currently given: %d\n",
+            static_cast<int32_t>(args.size()));
 
     ShowUsage();
     return 1;
   }
 
-  int32_t num_threads = 10;
+  if (method != "kl" && method != "aciq" && method != "percentile") {
+    fprintf(stderr, "Unsupported method: %s\n", method.c_str());
+    ShowUsage();
+    return 1;
+  }
+
+  if (percentile <= 0 || percentile > 100) {
+    fprintf(stderr, "percentile should be in (0, 100]. Given: %f\n",
+            percentile);
+    return 1;
+  }
+
+  // Wave files are processed in parallel, so each of them uses only
+  // a single thread unless we are running single-threaded.
+  int32_t num_threads = quantize_num_threads > 1 ? 1 : 10;
   sherpa_ncnn::ModelConfig config;
 
-  config.encoder_param = argv[1];
-  config.encoder_bin = argv[2];
-  config.decoder_param = argv[3];
-  config.decoder_bin = argv[4];
-  config.joiner_param = argv[5];
-  config.joiner_bin = argv[6];
+  config.encoder_param = args[0];
+  config.encoder_bin = args[1];
+  config.decoder_param = args[2];
+  config.decoder_bin = args[3];
+  config.joiner_param = args[4];
+  config.joiner_bin = args[5];
 
-  const char *encoder_scale_table = argv[7];
-  const char *joiner_scale_table = argv[8];
-  std::vector<std::string> wave_filenames = ReadWaveFilenames(argv[9]);
+  const char *encoder_scale_table = args[6];
+  const char *joiner_scale_table = args[7];
+  std::vector<std::string> wave_filenames = ReadWaveFilenames(args[8]);
 
   ncnn::Option opt;
   opt.num_threads = num_threads;
@@ -1014,18 +1049,33 @@ int main(int argc, char **argv) {
   config.joiner_opt = opt;
 
   auto model = sherpa_ncnn::Model::Create(config);
+  if (!model) {
+    fprintf(stderr, "Failed to create the model\n");
+    return -1;
+  }
 
   QuantNet net(model.get());
+  net.quantize_num_threads = quantize_num_threads;
+  net.method = method;
+  net.percentile = percentile;
+  net.skip_layers = std::move(skip_layers);
+  net.decoder.enabled = !decoder_scale_table.empty();
 
   net.init();
 
-  // TODO(fangjun): We support only KL right now.
-  net.quantize_KL(wave_filenames);
+  net.quantize(wave_filenames);
 
   net.print_quant_info();
 
-  net.save_table_encoder(encoder_scale_table);
-  net.save_table_joiner(joiner_scale_table);
+  net.save_table(net.encoder, encoder_scale_table);
+  net.save_table(net.joiner, joiner_scale_table);
+  if (net.decoder.enabled) {
+    net.save_table(net.decoder, decoder_scale_table.c_str());
+  }
+
+  fprintf(stderr,
+          "ncnn int8 calibration table create success, best wish for your int8 "
+          "inference has a low accuracy loss...\\(^0^)/...233...\n");
 
   return 0;
 }
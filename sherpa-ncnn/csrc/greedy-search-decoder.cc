@@ -19,6 +19,11 @@
 
 #include "sherpa-ncnn/csrc/greedy-search-decoder.h"
 
+#include <utility>
+#include <vector>
+
+#include "sherpa-ncnn/csrc/metrics.h"
+
 namespace sherpa_ncnn {
 
 void GreedySearchDecoder::AcceptWaveform(const float sample_rate,
@@ -35,9 +40,18 @@ void GreedySearchDecoder::BuildDecoderInput() {
   }
 }
 
+void GreedySearchDecoder::UpdateDecoderOut() {
+  BuildDecoderInput();
+  decoder_out_ = root_model_->RunDecoder(decoder_input_);
+  decoder_proj_ = root_model_->RunJoinerDecoderProj(decoder_out_);
+}
+
 void GreedySearchDecoder::ResetResult() {
   result_.tokens.clear();
   result_.text.clear();
+  result_.timestamps.clear();
+  result_.num_stable_tokens = 0;
+  result_.stable_text_length = 0;
   result_.num_trailing_blanks = 0;
   for (int32_t i = 0; i != context_size_; ++i) {
     result_.tokens.push_back(blank_id_);
@@ -47,13 +61,23 @@ void GreedySearchDecoder::ResetResult() {
 void GreedySearchDecoder::Decode() {
   while (feature_extractor_.NumFramesReady() - num_processed_ >= segment_) {
     ncnn::Mat features = feature_extractor_.GetFrames(num_processed_, segment_);
-    std::tie(encoder_out_, encoder_state_) =
-        model_->RunEncoder(features, encoder_state_);
+    {
+      ScopedMetricsTimer timer(&Metrics::Get().encoder_latency);
+      std::tie(encoder_out_, encoder_state_) =
+          model_->RunEncoder(features, encoder_state_);
+    }
+
+    int32_t num_decoder_calls = 0;
+
+    // Project all frames of the chunk at once so that only the add, tanh
+    // and output layers of the joiner run per frame below
+    ncnn::Mat encoder_proj = root_model_->RunJoinerEncoderProj(encoder_out_);
 
     /* encoder_out_.w == encoder_out_dim, encoder_out_.h == num_frames. */
     for (int32_t t = 0; t != encoder_out_.h; ++t) {
-      ncnn::Mat encoder_out_t(encoder_out_.w, encoder_out_.row(t));
-      ncnn::Mat joiner_out = model_->RunJoiner(encoder_out_t, decoder_out_);
+      ncnn::Mat encoder_proj_t(encoder_proj.w, encoder_proj.row(t));
+      ncnn::Mat joiner_out =
+          root_model_->RunJoinerOutput(encoder_proj_t, decoder_proj_);
       auto joiner_out_ptr = joiner_out.row(0);
 
       auto new_token = static_cast<int32_t>(std::distance(
@@ -62,9 +86,10 @@ void GreedySearchDecoder::Decode() {
 
       if (new_token != blank_id_) {
         result_.tokens.push_back(new_token);
-        result_.text += (*sym_)[new_token];
-        BuildDecoderInput();
-        decoder_out_ = model_->RunDecoder(decoder_input_);
+        result_.timestamps.push_back(num_output_frames_ + t);
+        sym_->Detokenize(&new_token, 1, &result_.text);
+        UpdateDecoderOut();
+        ++num_decoder_calls;
         result_.num_trailing_blanks = 0;
       } else {
         ++result_.num_trailing_blanks;
@@ -72,18 +97,123 @@ void GreedySearchDecoder::Decode() {
     }
 
     num_processed_ += offset_;
+    num_output_frames_ += encoder_out_.h;
+
+    if (Metrics::Enabled()) {
+      auto &metrics = Metrics::Get();
+      metrics.encoder_calls.Inc();
+      metrics.frames_decoded.Add(encoder_out_.h);
+      metrics.joiner_calls.Add(encoder_out_.h);
+      metrics.decoder_calls.Add(num_decoder_calls);
+    }
+
+    if (config_.emit_segments) {
+      EmitSegmentOnEndpoint();
+    }
   }
 }
 
-RecognitionResult GreedySearchDecoder::GetResult() {
-  auto ans = result_;
-  if (config_.enable_endpoint && IsEndpoint()) {
-    ResetResult();
-    endpoint_start_frame_ = num_processed_;
+void GreedySearchDecoder::EmitSegmentOnEndpoint() {
+  if (!IsEndpoint()) return;
+
+  int32_t start_frame = segment_start_frame_;
+
+  // It resets the result since we are at an endpoint
+  RecognitionResult r = GetResult();
+
+  if (config_.reset_state_on_endpoint) {
+    encoder_state_.clear();
+    UpdateDecoderOut();
   }
+
+  if (r.timestamps.empty()) return;
+
+  RecognitionSegment segment;
+  segment.id = num_segments_++;
+  segment.start_frame = start_frame;
+  segment.end_frame = num_output_frames_;
+  segment.text = std::move(r.text);
+  segment.tokens.assign(r.tokens.begin() + context_size_, r.tokens.end());
+  segment.timestamps = std::move(r.timestamps);
+
+  segments_.push_back(std::move(segment));
+}
+
+bool GreedySearchDecoder::PopSegment(RecognitionSegment *segment) {
+  if (segments_.empty()) return false;
+
+  *segment = std::move(segments_.front());
+  segments_.pop_front();
+  return true;
+}
+
+bool GreedySearchDecoder::SetLatencyMode(int32_t mode) {
+  if (!root_model_->GetLatencyMode(mode)) return false;
+
+  pending_latency_mode_ = mode;
+
+  // Nothing has been decoded yet, so we can switch now
+  if (num_processed_ == 0) ApplyLatencyMode();
+
+  return true;
+}
+
+void GreedySearchDecoder::ApplyLatencyMode() {
+  if (pending_latency_mode_ == latency_mode_) return;
+
+  latency_mode_ = pending_latency_mode_;
+  model_ = root_model_->GetLatencyMode(latency_mode_);
+  segment_ = model_->Segment();
+  offset_ = model_->Offset();
+
+  // Encoders with different chunk sizes have incompatible states
+  encoder_state_.clear();
+  UpdateDecoderOut();
+}
+
+void GreedySearchDecoder::GetResult(RecognitionResult *result) {
+  // Greedy search never changes tokens that have been decoded
+  result_.num_stable_tokens = static_cast<int32_t>(result_.timestamps.size());
+  result_.stable_text_length = static_cast<int32_t>(result_.text.size());
+
+  *result = result_;
+  if (IsEndpoint()) ResetOnEndpoint();
+}
+
+void GreedySearchDecoder::ResetOnEndpoint() {
+  if (Metrics::Enabled()) Metrics::Get().endpoints.Inc();
+  ResetResult();
+  ApplyLatencyMode();
+  endpoint_start_frame_ = num_processed_;
+  segment_start_frame_ = num_output_frames_;
+}
+
+RecognitionResult GreedySearchDecoder::DrainResult() {
+  bool is_endpoint = IsEndpoint();
+
+  // It resets result_ on endpoints
+  RecognitionResult ans = GetResult();
+  if (is_endpoint) return ans;
+
+  // Everything is stable in greedy search. Keep only the last
+  // context_size_ tokens, which are needed to build the decoder input.
+  int32_t n = static_cast<int32_t>(result_.timestamps.size());
+  result_.tokens.erase(result_.tokens.begin(), result_.tokens.begin() + n);
+  result_.timestamps.clear();
+  result_.text.clear();
+  result_.num_stable_tokens = 0;
+  result_.stable_text_length = 0;
+
   return ans;
 }
 
+Hypotheses GreedySearchDecoder::GetBeam() const {
+  Hypothesis hyp(result_.tokens, 0);
+  hyp.timestamps = result_.timestamps;
+  hyp.num_trailing_blanks = result_.num_trailing_blanks;
+  return Hypotheses(std::vector<Hypothesis>{std::move(hyp)});
+}
+
 void GreedySearchDecoder::InputFinished() {
   feature_extractor_.InputFinished();
 }
@@ -94,13 +224,31 @@ bool GreedySearchDecoder::IsEndpoint() {
                                result_.num_trailing_blanks * 4, 10 / 1000.0);
 }
 
+StreamMemoryStats GreedySearchDecoder::GetMemoryStats() const {
+  StreamMemoryStats ans;
+  ans.feature_bytes = feature_extractor_.NumBytes();
+  ans.encoder_state_bytes =
+      NumBytes(encoder_state_) +
+      NumBytes({encoder_out_, decoder_out_, decoder_proj_});
+  ans.hyp_bytes = result_.tokens.capacity() * sizeof(int32_t) +
+                  result_.text.capacity();
+  return ans;
+}
+
 void GreedySearchDecoder::Reset() {
+  // Callers may reset the stream on an endpoint without getting the result
+  if (IsEndpoint()) ResetOnEndpoint();
+
   ResetResult();
-  BuildDecoderInput();
-  decoder_out_ = model_->RunDecoder(decoder_input_);
+  UpdateDecoderOut();
   feature_extractor_.Reset();
   num_processed_ = 0;
+  num_output_frames_ = 0;
   endpoint_start_frame_ = 0;
+  segment_start_frame_ = 0;
+  num_segments_ = 0;
+  segments_.clear();
+  ApplyLatencyMode();
 }
 
 }  // namespace sherpa_ncnn
@@ -20,6 +20,7 @@
 #ifndef SHERPA_NCNN_CSRC_GREEDY_SEARCH_DECODER_H_
 #define SHERPA_NCNN_CSRC_GREEDY_SEARCH_DECODER_H_
 
+#include <deque>
 #include <memory>
 #include <vector>
 
@@ -35,20 +36,25 @@ class GreedySearchDecoder : public Decoder {
                       const sherpa_ncnn::SymbolTable *sym,
                       const Endpoint *endpoint)
       : config_(config),
-        model_(model),
+        root_model_(model),
+        model_(model->GetLatencyMode(config.latency_mode)),
         feature_extractor_(fbank_opts),
         sym_(sym),
-        blank_id_(model_->BlankId()),
-        context_size_(model_->ContextSize()),
-        segment_(model->Segment()),
+        blank_id_(root_model_->BlankId()),
+        context_size_(root_model_->ContextSize()),
+        segment_(model_->Segment()),
         offset_(model_->Offset()),
         decoder_input_(context_size_),
         num_processed_(0),
+        num_output_frames_(0),
         endpoint_start_frame_(0),
+        segment_start_frame_(0),
+        num_segments_(0),
+        latency_mode_(config.latency_mode),
+        pending_latency_mode_(config.latency_mode),
         endpoint_(endpoint) {
     ResetResult();
-    BuildDecoderInput();
-    decoder_out_ = model_->RunDecoder(decoder_input_);
+    UpdateDecoderOut();
   }
 
   void AcceptWaveform(float sample_rate, const float *input_buffer,
@@ -56,7 +62,14 @@ class GreedySearchDecoder : public Decoder {
 
   void Decode() override;
 
-  RecognitionResult GetResult() override;
+  using Decoder::GetResult;
+  void GetResult(RecognitionResult *result) override;
+
+  Hypotheses GetBeam() const override;
+
+  RecognitionResult DrainResult() override;
+
+  bool PopSegment(RecognitionSegment *segment) override;
 
   void ResetResult() override;
 
@@ -66,23 +79,64 @@ class GreedySearchDecoder : public Decoder {
 
   void InputFinished() override;
 
+  StreamMemoryStats GetMemoryStats() const override;
+
+  int32_t NumPendingFrames() const override {
+    return feature_extractor_.NumFramesReady() - num_processed_;
+  }
+
+  int32_t Segment() const override { return segment_; }
+
+  bool SetLatencyMode(int32_t mode) override;
+
+  int32_t LatencyMode() const override { return latency_mode_; }
+
  private:
+  // Emit a segment if an endpoint is detected. Used only if
+  // config_.emit_segments is true.
+  void EmitSegmentOnEndpoint();
+
+  // Switch to pending_latency_mode_ if it differs from latency_mode_.
+  // It resets the encoder state, so it is called only at the start of the
+  // stream or at an endpoint.
+  void ApplyLatencyMode();
+
+  // Start a new segment at an endpoint. Every endpoint ends up here, so it
+  // is also where endpoints are counted.
+  void ResetOnEndpoint();
+
   void BuildDecoderInput();
 
+  // Run the decoder and the decoder projection of the joiner on the last
+  // context_size_ tokens of the result
+  void UpdateDecoderOut();
+
   const DecoderConfig config_;
-  Model *model_;
+  Model *root_model_;  // runs the decoder and joiner of all latency modes
+  Model *model_;       // runs the encoder of the current latency mode
   sherpa_ncnn::FeatureExtractor feature_extractor_;
   const sherpa_ncnn::SymbolTable *sym_;
   const int32_t blank_id_;
   const int32_t context_size_;
-  const int32_t segment_;
-  const int32_t offset_;
+  int32_t segment_;
+  int32_t offset_;
   ncnn::Mat encoder_out_;
   std::vector<ncnn::Mat> encoder_state_;
   ncnn::Mat decoder_input_;
   ncnn::Mat decoder_out_;
+  ncnn::Mat decoder_proj_;  // projection of decoder_out_ by the joiner
   int32_t num_processed_;
+  int32_t num_output_frames_;  // number of encoder output frames so far
   int32_t endpoint_start_frame_;
+
+  // In encoder output frames
+  int32_t segment_start_frame_;
+  int32_t num_segments_;
+  std::deque<RecognitionSegment> segments_;
+
+  int32_t latency_mode_;
+  int32_t pending_latency_mode_;  // to switch to at the next endpoint
+
   const Endpoint *endpoint_;
   RecognitionResult result_;
 };
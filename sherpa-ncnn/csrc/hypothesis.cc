@@ -35,7 +35,7 @@ void Hypotheses::Add(Hypothesis hyp) {
   }
 }
 
-Hypothesis Hypotheses::GetMostProbable(bool length_norm) const {
+const Hypothesis &Hypotheses::GetMostProbable(bool length_norm) const {
   if (length_norm == false) {
     return std::max_element(hyps_dict_.begin(), hyps_dict_.end(),
                             [](const auto &left, auto &right) -> bool {
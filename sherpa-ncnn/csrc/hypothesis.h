@@ -85,7 +85,8 @@ class Hypotheses {
   // Get the hyp that has the largest log_prob.
   // If length_norm is true, hyp's log_prob is divided by
   // len(hyp.ys) before comparison.
-  Hypothesis GetMostProbable(bool length_norm) const;
+  // The returned reference is valid until this object is changed.
+  const Hypothesis &GetMostProbable(bool length_norm) const;
 
   // Get the k hyps that have the largest log_prob.
   // If length_norm is true, hyp's log_prob is divided by
@@ -0,0 +1,250 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sherpa-ncnn/csrc/layer-profiler.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace sherpa_ncnn {
+
+using Clock = std::chrono::steady_clock;
+
+static int64_t NumBytes(const ncnn::Mat &m) {
+  return static_cast<int64_t>(m.total() * m.elemsize);
+}
+
+static int64_t NumBytes(const std::vector<ncnn::Mat> &v) {
+  int64_t ans = 0;
+  for (const auto &m : v) {
+    ans += NumBytes(m);
+  }
+  return ans;
+}
+
+// It forwards all calls to the wrapped layer and records the elapsed time
+// and the size of the outputs into a LayerStat.
+class ProfiledLayer : public ncnn::Layer {
+ public:
+  ProfiledLayer(ncnn::Layer *layer, LayerStat *stat)
+      : layer_(layer), stat_(stat) {
+    // The network uses the following fields to decide how to call a layer
+    // and how to convert its inputs, so they must match the wrapped layer.
+    one_blob_only = layer->one_blob_only;
+    support_inplace = layer->support_inplace;
+    support_packing = layer->support_packing;
+    support_bf16_storage = layer->support_bf16_storage;
+    support_fp16_storage = layer->support_fp16_storage;
+    support_int8_storage = layer->support_int8_storage;
+    support_vulkan = false;
+    featmask = layer->featmask;
+
+    typeindex = layer->typeindex;
+    type = layer->type;
+    name = layer->name;
+    bottoms = layer->bottoms;
+    tops = layer->tops;
+    bottom_shapes = layer->bottom_shapes;
+    top_shapes = layer->top_shapes;
+  }
+
+  ~ProfiledLayer() override { delete layer_; }
+
+  int destroy_pipeline(const ncnn::Option &opt) override {
+    return layer_->destroy_pipeline(opt);
+  }
+
+  int forward(const std::vector<ncnn::Mat> &bottom_blobs,
+              std::vector<ncnn::Mat> &top_blobs,
+              const ncnn::Option &opt) const override {
+    auto start = Clock::now();
+    int ret = layer_->forward(bottom_blobs, top_blobs, opt);
+    Record(start, NumBytes(top_blobs));
+    return ret;
+  }
+
+  int forward(const ncnn::Mat &bottom_blob, ncnn::Mat &top_blob,
+              const ncnn::Option &opt) const override {
+    auto start = Clock::now();
+    int ret = layer_->forward(bottom_blob, top_blob, opt);
+    Record(start, NumBytes(top_blob));
+    return ret;
+  }
+
+  int forward_inplace(std::vector<ncnn::Mat> &bottom_top_blobs,
+                      const ncnn::Option &opt) const override {
+    auto start = Clock::now();
+    int ret = layer_->forward_inplace(bottom_top_blobs, opt);
+    Record(start, NumBytes(bottom_top_blobs));
+    return ret;
+  }
+
+  int forward_inplace(ncnn::Mat &bottom_top_blob,
+                      const ncnn::Option &opt) const override {
+    auto start = Clock::now();
+    int ret = layer_->forward_inplace(bottom_top_blob, opt);
+    Record(start, NumBytes(bottom_top_blob));
+    return ret;
+  }
+
+ private:
+  void Record(Clock::time_point start, int64_t bytes) const {
+    int64_t ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start)
+            .count();
+
+    stat_->num_calls.fetch_add(1, std::memory_order_relaxed);
+    stat_->elapsed_ns.fetch_add(ns, std::memory_order_relaxed);
+    stat_->output_bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+    int64_t max_bytes = stat_->max_output_bytes.load(std::memory_order_relaxed);
+    while (bytes > max_bytes &&
+           !stat_->max_output_bytes.compare_exchange_weak(
+               max_bytes, bytes, std::memory_order_relaxed)) {
+    }
+  }
+
+ private:
+  ncnn::Layer *layer_;
+  LayerStat *stat_;
+};
+
+LayerProfiler::LayerProfiler(ncnn::Net *net) {
+  if (net->opt.use_vulkan_compute) {
+    NCNN_LOGE("Layer profiling supports only CPU. Skip it");
+    return;
+  }
+
+  auto &layers = net->mutable_layers();
+  stats_.reserve(layers.size());
+
+  for (auto &layer : layers) {
+    auto stat = std::make_unique<LayerStat>();
+    stat->name = layer->name;
+    stat->type = layer->type;
+
+    layer = new ProfiledLayer(layer, stat.get());
+    stats_.push_back(std::move(stat));
+  }
+}
+
+void LayerProfiler::Reset() {
+  for (auto &s : stats_) {
+    s->num_calls = 0;
+    s->elapsed_ns = 0;
+    s->output_bytes = 0;
+    s->max_output_bytes = 0;
+  }
+}
+
+namespace {
+
+struct Row {
+  std::string name;
+  int32_t num_layers = 0;
+  int64_t num_calls = 0;
+  int64_t elapsed_ns = 0;
+  int64_t output_bytes = 0;
+  int64_t max_output_bytes = 0;
+};
+
+}  // namespace
+
+static void PrintRows(std::vector<Row> rows, int64_t total_ns,
+                      bool print_num_layers, std::ostringstream &os) {
+  std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+    return a.elapsed_ns > b.elapsed_ns;
+  });
+
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%-32s %8s %10s %12s %10s %8s %12s %12s\n",
+           "name", "layers", "calls", "time(ms)", "avg(us)", "percent",
+           "avg_out(KB)", "max_out(KB)");
+  os << buf;
+
+  for (const auto &r : rows) {
+    if (r.num_calls == 0) continue;
+
+    std::string num_layers =
+        print_num_layers ? std::to_string(r.num_layers) : "-";
+
+    snprintf(buf, sizeof(buf),
+             "%-32s %8s %10lld %12.3f %10.2f %7.2f%% %12.2f %12.2f\n",
+             r.name.c_str(), num_layers.c_str(),
+             static_cast<long long>(r.num_calls),  // NOLINT
+             r.elapsed_ns / 1e6, r.elapsed_ns / 1e3 / r.num_calls,
+             total_ns > 0 ? 100.0 * r.elapsed_ns / total_ns : 0.0,
+             r.output_bytes / 1024.0 / r.num_calls,
+             r.max_output_bytes / 1024.0);
+    os << buf;
+  }
+}
+
+std::string LayerProfiler::Report() const {
+  std::map<std::string, Row> types;
+  std::vector<Row> layers;
+  layers.reserve(stats_.size());
+
+  int64_t total_ns = 0;
+  for (const auto &s : stats_) {
+    Row r;
+    r.name = s->name + " (" + s->type + ")";
+    r.num_layers = 1;
+    r.num_calls = s->num_calls;
+    r.elapsed_ns = s->elapsed_ns;
+    r.output_bytes = s->output_bytes;
+    r.max_output_bytes = s->max_output_bytes;
+
+    auto &t = types[s->type];
+    t.name = s->type;
+    t.num_layers += 1;
+    t.num_calls += r.num_calls;
+    t.elapsed_ns += r.elapsed_ns;
+    t.output_bytes += r.output_bytes;
+    t.max_output_bytes = std::max(t.max_output_bytes, r.max_output_bytes);
+
+    total_ns += r.elapsed_ns;
+    layers.push_back(std::move(r));
+  }
+
+  std::vector<Row> type_rows;
+  type_rows.reserve(types.size());
+  for (auto &p : types) {
+    type_rows.push_back(std::move(p.second));
+  }
+
+  std::ostringstream os;
+  os << "Total time in layers: " << total_ns / 1e6 << " ms\n\n";
+
+  os << "Per layer type:\n";
+  PrintRows(std::move(type_rows), total_ns, true, os);
+
+  os << "\nPer layer:\n";
+  PrintRows(std::move(layers), total_ns, false, os);
+
+  return os.str();
+}
+
+}  // namespace sherpa_ncnn
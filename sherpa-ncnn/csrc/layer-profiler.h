@@ -0,0 +1,85 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHERPA_NCNN_CSRC_LAYER_PROFILER_H_
+#define SHERPA_NCNN_CSRC_LAYER_PROFILER_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "net.h"  // NOLINT
+
+namespace sherpa_ncnn {
+
+// Statistics of a single layer, accumulated over all forward calls.
+struct LayerStat {
+  std::string name;
+  std::string type;
+
+  std::atomic<int64_t> num_calls{0};
+  std::atomic<int64_t> elapsed_ns{0};
+
+  // Sum and maximum of the bytes of the output blobs of a call
+  std::atomic<int64_t> output_bytes{0};
+  std::atomic<int64_t> max_output_bytes{0};
+};
+
+/** Measure the time and output memory of each layer of a network.
+ *
+ * It replaces every layer of the given network with a wrapper layer that
+ * forwards to the original one and records the time spent in it. The
+ * network has to be loaded before it is passed to the constructor.
+ *
+ * Usage:
+ *
+ *   LayerProfiler profiler(&net);
+ *   // run the net as usual
+ *   std::cerr << profiler.Report() << "\n";
+ *
+ * The profiler must outlive the network. The wrapper layers are deleted
+ * together with the network and they delete the original layers.
+ *
+ * It supports only CPU inference. If the network uses Vulkan, nothing is
+ * wrapped and the report is empty.
+ *
+ * It is safe to run the network from multiple threads while profiling.
+ */
+class LayerProfiler {
+ public:
+  explicit LayerProfiler(ncnn::Net *net);
+
+  // Return a report containing the statistics of each layer type,
+  // followed by that of each layer, sorted by time in descending order.
+  std::string Report() const;
+
+  // Clear the accumulated statistics
+  void Reset();
+
+  const std::vector<std::unique_ptr<LayerStat>> &Stats() const {
+    return stats_;
+  }
+
+ private:
+  std::vector<std::unique_ptr<LayerStat>> stats_;
+};
+
+}  // namespace sherpa_ncnn
+
+#endif  // SHERPA_NCNN_CSRC_LAYER_PROFILER_H_
@@ -25,11 +25,15 @@
 
 namespace sherpa_ncnn {
 
-LstmModel::LstmModel(const ModelConfig &config) {
+LstmModel::LstmModel(const ModelConfig &config, bool encoder_only) {
   encoder_.opt = config.encoder_opt;
   decoder_.opt = config.decoder_opt;
   joiner_.opt = config.joiner_opt;
 
+  ApplyPrecision(config.encoder_precision, &encoder_.opt);
+  ApplyPrecision(config.decoder_precision, &decoder_.opt);
+  ApplyPrecision(config.joiner_precision, &joiner_.opt);
+
   bool has_gpu = false;
 #if NCNN_VULKAN
   has_gpu = ncnn::get_gpu_count() > 0;
@@ -47,20 +51,28 @@ LstmModel::LstmModel(const ModelConfig &config) {
   }
 
   InitEncoder(config.encoder_param, config.encoder_bin);
+  InitEncoderInputOutputIndexes();
+
+  if (encoder_only) return;
+
   InitDecoder(config.decoder_param, config.decoder_bin);
   InitJoiner(config.joiner_param, config.joiner_bin);
 
-  InitEncoderInputOutputIndexes();
   InitDecoderInputOutputIndexes();
   InitJoinerInputOutputIndexes();
 }
 
 #if __ANDROID_API__ >= 9
-LstmModel::LstmModel(AAssetManager *mgr, const ModelConfig &config) {
+LstmModel::LstmModel(AAssetManager *mgr, const ModelConfig &config,
+                     bool encoder_only) {
   encoder_.opt = config.encoder_opt;
   decoder_.opt = config.decoder_opt;
   joiner_.opt = config.joiner_opt;
 
+  ApplyPrecision(config.encoder_precision, &encoder_.opt);
+  ApplyPrecision(config.decoder_precision, &decoder_.opt);
+  ApplyPrecision(config.joiner_precision, &joiner_.opt);
+
   bool has_gpu = false;
 #if NCNN_VULKAN
   has_gpu = ncnn::get_gpu_count() > 0;
@@ -78,10 +90,13 @@ LstmModel::LstmModel(AAssetManager *mgr, const ModelConfig &config) {
   }
 
   InitEncoder(mgr, config.encoder_param, config.encoder_bin);
+  InitEncoderInputOutputIndexes();
+
+  if (encoder_only) return;
+
   InitDecoder(mgr, config.decoder_param, config.decoder_bin);
   InitJoiner(mgr, config.joiner_param, config.joiner_bin);
 
-  InitEncoderInputOutputIndexes();
   InitDecoderInputOutputIndexes();
   InitJoinerInputOutputIndexes();
 }
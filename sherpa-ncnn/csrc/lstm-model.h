@@ -30,9 +30,12 @@ namespace sherpa_ncnn {
 
 class LstmModel : public Model {
  public:
-  explicit LstmModel(const ModelConfig &config);
+  // If encoder_only is true, only the encoder is loaded. It is used for
+  // latency modes. See Model::GetLatencyMode().
+  explicit LstmModel(const ModelConfig &config, bool encoder_only = false);
 #if __ANDROID_API__ >= 9
-  LstmModel(AAssetManager *mgr, const ModelConfig &config);
+  LstmModel(AAssetManager *mgr, const ModelConfig &config,
+            bool encoder_only = false);
 #endif
 
   ncnn::Net &GetEncoder() override { return encoder_; }
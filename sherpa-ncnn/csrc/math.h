@@ -101,6 +101,17 @@ void LogSoftmax(T *input, int32_t input_len) {
   }
 }
 
+// Return the entropy (in nats) of a distribution given by its
+// log-probabilities, e.g., the output of LogSoftmax().
+template <class T>
+T Entropy(const T *log_probs, int32_t n) {
+  T ans = 0;
+  for (int32_t i = 0; i != n; ++i) {
+    ans -= exp(log_probs[i]) * log_probs[i];
+  }
+  return ans;
+}
+
 template <class T>
 std::vector<int32_t> TopkIndex(const T *vec, int32_t size, int32_t topk) {
   std::vector<int32_t> vec_index(size);
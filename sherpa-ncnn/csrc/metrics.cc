@@ -0,0 +1,359 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sherpa-ncnn/csrc/metrics.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include "platform.h"  // NOLINT
+
+namespace sherpa_ncnn {
+
+std::atomic<bool> Metrics::enabled_{false};
+
+// Each thread uses a fixed shard chosen in a round-robin fashion
+static int32_t ShardIndex() {
+  static std::atomic<int32_t> next{0};
+  static thread_local int32_t index =
+      next.fetch_add(1, std::memory_order_relaxed) % kMetricsNumShards;
+  return index;
+}
+
+void Counter::Add(int64_t n) {
+  shards_[ShardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+int64_t Counter::Value() const {
+  int64_t ans = 0;
+  for (const auto &s : shards_) {
+    ans += s.value.load(std::memory_order_relaxed);
+  }
+  return ans;
+}
+
+void Gauge::Add(int64_t n) {
+  shards_[ShardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+int64_t Gauge::Value() const {
+  int64_t ans = 0;
+  for (const auto &s : shards_) {
+    ans += s.value.load(std::memory_order_relaxed);
+  }
+  return ans;
+}
+
+static std::string FormatDouble(double d) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.6g", d);
+  return buf;
+}
+
+Histogram::Histogram(const std::vector<double> &bounds) : bounds_(bounds) {
+  if (bounds_.size() > kMaxBuckets) {
+    bounds_.resize(kMaxBuckets);
+  }
+}
+
+void Histogram::Observe(double seconds) {
+  int32_t i = static_cast<int32_t>(
+      std::lower_bound(bounds_.begin(), bounds_.end(), seconds) -
+      bounds_.begin());
+
+  auto &s = shards_[ShardIndex()];
+  s.counts[i].fetch_add(1, std::memory_order_relaxed);
+  s.sum_us.fetch_add(static_cast<int64_t>(seconds * 1e6),
+                     std::memory_order_relaxed);
+}
+
+void Histogram::Expose(const std::string &name, const std::string &help,
+                       std::string *os) const {
+  int32_t num_buckets = static_cast<int32_t>(bounds_.size()) + 1;
+  std::vector<int64_t> counts(num_buckets);
+  int64_t sum_us = 0;
+
+  for (const auto &s : shards_) {
+    for (int32_t i = 0; i != num_buckets; ++i) {
+      counts[i] += s.counts[i].load(std::memory_order_relaxed);
+    }
+    sum_us += s.sum_us.load(std::memory_order_relaxed);
+  }
+
+  *os += "# HELP " + name + " " + help + "\n";
+  *os += "# TYPE " + name + " histogram\n";
+
+  int64_t cumulative = 0;
+  for (int32_t i = 0; i != num_buckets; ++i) {
+    cumulative += counts[i];
+    std::string le =
+        i < num_buckets - 1 ? FormatDouble(bounds_[i]) : std::string("+Inf");
+    *os += name + "_bucket{le=\"" + le + "\"} " + std::to_string(cumulative) +
+           "\n";
+  }
+
+  *os += name + "_sum " + FormatDouble(sum_us / 1e6) + "\n";
+  *os += name + "_count " + std::to_string(cumulative) + "\n";
+}
+
+Metrics::Metrics()
+    : encoder_latency({0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25,
+                       0.5, 1.0}) {}
+
+Metrics &Metrics::Get() {
+  static Metrics metrics;
+  return metrics;
+}
+
+static void ExposeValue(const std::string &name, const std::string &type,
+                        const std::string &help, const std::string &value,
+                        std::string *os) {
+  *os += "# HELP " + name + " " + help + "\n";
+  *os += "# TYPE " + name + " " + type + "\n";
+  *os += name + " " + value + "\n";
+}
+
+std::string Metrics::ToPrometheusText() const {
+  std::string os;
+
+  ExposeValue("sherpa_ncnn_streams_active", "gauge",
+              "Number of streams that are currently alive",
+              std::to_string(streams_active.Value()), &os);
+
+  ExposeValue("sherpa_ncnn_queue_depth", "gauge",
+              "Feature frames waiting to be processed by the encoder",
+              std::to_string(queue_depth.Value()), &os);
+
+  ExposeValue("sherpa_ncnn_frames_decoded_total", "counter",
+              "Number of encoder output frames decoded",
+              std::to_string(frames_decoded.Value()), &os);
+
+  ExposeValue("sherpa_ncnn_encoder_calls_total", "counter",
+              "Number of encoder network invocations",
+              std::to_string(encoder_calls.Value()), &os);
+
+  ExposeValue("sherpa_ncnn_decoder_calls_total", "counter",
+              "Number of decoder network invocations",
+              std::to_string(decoder_calls.Value()), &os);
+
+  ExposeValue("sherpa_ncnn_joiner_calls_total", "counter",
+              "Number of joiner network invocations",
+              std::to_string(joiner_calls.Value()), &os);
+
+  ExposeValue("sherpa_ncnn_joiner_shortlist_rows_total", "counter",
+              "Number of joiner output rows computed with a shortlist",
+              std::to_string(joiner_shortlist_rows.Value()), &os);
+
+  ExposeValue("sherpa_ncnn_joiner_shortlist_fallbacks_total", "counter",
+              "Number of shortlisted joiner output rows recomputed in full",
+              std::to_string(joiner_shortlist_fallbacks.Value()), &os);
+
+  ExposeValue("sherpa_ncnn_endpoints_total", "counter",
+              "Number of detected endpoints",
+              std::to_string(endpoints.Value()), &os);
+
+  double audio_seconds = audio_us.Value() / 1e6;
+  double decode_seconds = decode_us.Value() / 1e6;
+
+  ExposeValue("sherpa_ncnn_audio_seconds_total", "counter",
+              "Duration of the audio accepted by all streams",
+              FormatDouble(audio_seconds), &os);
+
+  ExposeValue("sherpa_ncnn_decode_seconds_total", "counter",
+              "Time spent in decoding", FormatDouble(decode_seconds), &os);
+
+  ExposeValue("sherpa_ncnn_rtf", "gauge",
+              "Real time factor since the start of the process",
+              FormatDouble(audio_seconds > 0 ? decode_seconds / audio_seconds
+                                             : 0),
+              &os);
+
+  encoder_latency.Expose("sherpa_ncnn_encoder_latency_seconds",
+                         "Time to run the encoder on one chunk", &os);
+
+  return os;
+}
+
+ScopedMetricsTimer::~ScopedMetricsTimer() {
+  if (!enabled_) return;
+
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_)
+                .count();
+
+  if (histogram_) histogram_->Observe(us / 1e6);
+  if (counter_) counter_->Add(us);
+}
+
+#ifdef _WIN32
+bool MetricsServer::Start(int32_t port) {
+  NCNN_LOGE("The metrics server is not supported on Windows");
+  return false;
+}
+
+void MetricsServer::Stop() {}
+
+void MetricsServer::Run() {}
+
+#else
+
+bool MetricsServer::Start(int32_t port) {
+  if (thread_.joinable()) {
+    NCNN_LOGE("The metrics server has already been started");
+    return false;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    NCNN_LOGE("Failed to create a socket: %s", strerror(errno));
+    return false;
+  }
+
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, 16) != 0) {
+    NCNN_LOGE("Failed to listen on port %d: %s", port, strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  listen_fd_ = fd;
+  stop_ = false;
+  Metrics::Enable(true);
+
+  thread_ = std::thread([this]() { Run(); });
+
+  return true;
+}
+
+void MetricsServer::Stop() {
+  if (!thread_.joinable()) return;
+
+  stop_ = true;
+  thread_.join();
+
+  close(listen_fd_);
+  listen_fd_ = -1;
+}
+
+// A client that disconnects while we are sending must not kill the
+// process with SIGPIPE. On Apple, SO_NOSIGPIPE is set on the socket instead.
+#ifdef MSG_NOSIGNAL
+static constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+static constexpr int kSendFlags = 0;
+#endif
+
+static void SendAll(int fd, const std::string &s) {
+  const char *p = s.data();
+  size_t n = s.size();
+  while (n > 0) {
+    ssize_t k = send(fd, p, n, kSendFlags);
+    if (k <= 0) return;
+    p += k;
+    n -= k;
+  }
+}
+
+static void HandleConnection(int fd) {
+  // Don't let a slow client block the server
+  timeval tv;
+  tv.tv_sec = 1;
+  tv.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+  char buf[1024];
+  ssize_t n = recv(fd, buf, sizeof(buf) - 1, 0);
+  if (n <= 0) return;
+  buf[n] = 0;
+
+  // We only look at the request line, e.g., GET /metrics HTTP/1.1
+  std::string request(buf);
+  std::string status = "200 OK";
+  std::string body;
+
+  if (request.compare(0, 4, "GET ") != 0) {
+    status = "405 Method Not Allowed";
+  } else {
+    std::string path = request.substr(4, request.find(' ', 4) - 4);
+    if (path == "/metrics" || path == "/") {
+      body = Metrics::Get().ToPrometheusText();
+    } else {
+      status = "404 Not Found";
+    }
+  }
+
+  std::string response = "HTTP/1.1 " + status +
+                         "\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: " +
+                         std::to_string(body.size()) +
+                         "\r\n"
+                         "Connection: close\r\n\r\n" +
+                         body;
+  SendAll(fd, response);
+}
+
+void MetricsServer::Run() {
+  while (!stop_) {
+    pollfd p;
+    p.fd = listen_fd_;
+    p.events = POLLIN;
+    p.revents = 0;
+
+    // Wake up periodically to check stop_
+    if (poll(&p, 1, 200) <= 0) continue;
+
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) continue;
+
+    HandleConnection(fd);
+    close(fd);
+  }
+}
+
+#endif
+
+}  // namespace sherpa_ncnn
@@ -0,0 +1,204 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHERPA_NCNN_CSRC_METRICS_H_
+#define SHERPA_NCNN_CSRC_METRICS_H_
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace sherpa_ncnn {
+
+// Updates from different threads go to different shards so that they
+// don't contend for the same cache line.
+static constexpr int32_t kMetricsNumShards = 16;
+
+struct alignas(64) MetricsShard {
+  std::atomic<int64_t> value{0};
+};
+
+// A monotonically increasing counter.
+class Counter {
+ public:
+  void Add(int64_t n);
+
+  void Inc() { Add(1); }
+
+  int64_t Value() const;
+
+ private:
+  MetricsShard shards_[kMetricsNumShards];
+};
+
+// A value that can go up and down, e.g., the number of active streams.
+// It is sharded like Counter.
+class Gauge {
+ public:
+  void Add(int64_t n);
+
+  int64_t Value() const;
+
+ private:
+  MetricsShard shards_[kMetricsNumShards];
+};
+
+// A histogram with fixed bucket upper bounds. Values are stored in
+// microseconds, so it is meant for durations.
+class Histogram {
+ public:
+  static constexpr int32_t kMaxBuckets = 15;
+
+  // @param bounds Upper bounds of the buckets in seconds, in ascending order.
+  //               At most kMaxBuckets entries are used.
+  explicit Histogram(const std::vector<double> &bounds);
+
+  void Observe(double seconds);
+
+  // Append the Prometheus text format of this histogram to os
+  void Expose(const std::string &name, const std::string &help,
+              std::string *os) const;
+
+ private:
+  struct alignas(64) Shard {
+    // The last one is for +Inf
+    std::atomic<int64_t> counts[kMaxBuckets + 1];
+    std::atomic<int64_t> sum_us{0};
+
+    Shard() {
+      for (auto &c : counts) c = 0;
+    }
+  };
+
+  std::vector<double> bounds_;
+  Shard shards_[kMetricsNumShards];
+};
+
+/** Metrics of all recognizers in the current process.
+ *
+ * Metrics are disabled by default. When they are disabled, the decoding
+ * code only checks a flag and does not update anything.
+ *
+ * Usage:
+ *
+ *   Metrics::Enable(true);
+ *
+ *   if (Metrics::Enabled()) {
+ *     Metrics::Get().joiner_calls.Inc();
+ *   }
+ *
+ *   std::string text = Metrics::Get().ToPrometheusText();
+ */
+class Metrics {
+ public:
+  static Metrics &Get();
+
+  static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  static void Enable(bool enable) {
+    enabled_.store(enable, std::memory_order_relaxed);
+  }
+
+  // Return the metrics in the Prometheus text exposition format
+  std::string ToPrometheusText() const;
+
+  // Streams created while metrics are disabled are counted from their
+  // next call to AcceptWaveform(), Decode(), etc. after metrics are enabled.
+  Gauge streams_active;
+
+  // Feature frames accepted but not yet processed by the encoder,
+  // summed over all streams
+  Gauge queue_depth;
+
+  Counter frames_decoded;  // encoder output frames
+  Counter encoder_calls;
+  Counter decoder_calls;
+  Counter joiner_calls;
+
+  // Rows computed by the joiner with a shortlist and those of them that
+  // fall back to the full vocabulary. See ModelConfig::joiner_shortlist_size
+  Counter joiner_shortlist_rows;
+  Counter joiner_shortlist_fallbacks;
+  Counter endpoints;
+
+  // In microseconds. Their ratio is the real time factor.
+  Counter audio_us;
+  Counter decode_us;
+
+  Histogram encoder_latency;
+
+ private:
+  Metrics();
+
+  static std::atomic<bool> enabled_;
+};
+
+// Measure the time between its construction and destruction and add it
+// to a histogram and/or a counter if metrics are enabled.
+class ScopedMetricsTimer {
+ public:
+  explicit ScopedMetricsTimer(Histogram *histogram, Counter *counter = nullptr)
+      : enabled_(Metrics::Enabled()),
+        histogram_(histogram),
+        counter_(counter) {
+    if (enabled_) start_ = std::chrono::steady_clock::now();
+  }
+
+  ~ScopedMetricsTimer();
+
+ private:
+  bool enabled_;
+  Histogram *histogram_;
+  Counter *counter_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/** A minimal HTTP server that returns Metrics::Get().ToPrometheusText()
+ * for every GET request. It listens only on 127.0.0.1.
+ *
+ * It is not supported on Windows.
+ */
+class MetricsServer {
+ public:
+  MetricsServer() = default;
+  MetricsServer(const MetricsServer &) = delete;
+  MetricsServer &operator=(const MetricsServer &) = delete;
+
+  ~MetricsServer() { Stop(); }
+
+  // Start serving on the given port and enable metrics.
+  // Return false on error.
+  bool Start(int32_t port);
+
+  // Stop serving. Metrics stay enabled.
+  void Stop();
+
+ private:
+  void Run();
+
+  int listen_fd_ = -1;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+}  // namespace sherpa_ncnn
+
+#endif  // SHERPA_NCNN_CSRC_METRICS_H_
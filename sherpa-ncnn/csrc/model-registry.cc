@@ -0,0 +1,141 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sherpa-ncnn/csrc/model-registry.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sherpa_ncnn {
+
+// Return nullptr if the table is empty, e.g., the file does not exist
+static std::shared_ptr<const SymbolTable> CheckSymbolTable(
+    std::shared_ptr<const SymbolTable> sym, const std::string &tokens) {
+  if (sym->NumSymbols() == 0) {
+    NCNN_LOGE("Failed to load %s", tokens.c_str());
+    return nullptr;
+  }
+
+  return sym;
+}
+
+ModelRegistry::ModelRegistry(const knf::FbankOptions &fbank_opts)
+    : fbank_opts_(fbank_opts) {}
+
+int32_t ModelRegistry::Load(const ModelConfig &config) {
+  // Model::Create() returns nullptr instead of exiting on errors, so a bad
+  // file does not bring down a running process.
+  std::shared_ptr<const SymbolTable> sym = CheckSymbolTable(
+      std::make_shared<const SymbolTable>(config.tokens), config.tokens);
+  if (!sym) return -1;
+
+  ModelConfig model_config = config;
+  model_config.feature_dim = fbank_opts_.mel_opts.num_bins;
+
+  // Loading takes a while, so it is done without holding the lock
+  std::shared_ptr<Model> model = Model::Create(model_config);
+  if (!model) return -1;
+
+  return Add(std::move(model), std::move(sym));
+}
+
+#if __ANDROID_API__ >= 9
+int32_t ModelRegistry::Load(AAssetManager *mgr, const ModelConfig &config) {
+  std::shared_ptr<const SymbolTable> sym = CheckSymbolTable(
+      std::make_shared<const SymbolTable>(mgr, config.tokens), config.tokens);
+  if (!sym) return -1;
+
+  ModelConfig model_config = config;
+  model_config.feature_dim = fbank_opts_.mel_opts.num_bins;
+
+  std::shared_ptr<Model> model = Model::Create(mgr, model_config);
+  if (!model) return -1;
+
+  return Add(std::move(model), std::move(sym));
+}
+#endif
+
+int32_t ModelRegistry::Add(std::shared_ptr<Model> model,
+                           std::shared_ptr<const SymbolTable> sym) {
+  // The previous model is moved here and freed after the lock is released
+  // if no stream is using it, so that freeing it does not block other
+  // threads.
+  std::shared_ptr<Model> old_model;
+  std::shared_ptr<const SymbolTable> old_sym;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  old_models_.erase(
+      std::remove_if(old_models_.begin(), old_models_.end(),
+                     [](const std::pair<int32_t, std::weak_ptr<Model>> &p) {
+                       return p.second.expired();
+                     }),
+      old_models_.end());
+
+  if (model_) {
+    old_models_.emplace_back(version_, model_);
+  }
+
+  old_model = std::move(model_);
+  old_sym = std::move(sym_);
+
+  model_ = std::move(model);
+  sym_ = std::move(sym);
+
+  return ++version_;
+}
+
+std::unique_ptr<Recognizer> ModelRegistry::CreateStream(
+    const DecoderConfig &decoder_conf, int32_t *version) const {
+  std::shared_ptr<Model> model;
+  std::shared_ptr<const SymbolTable> sym;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!model_) return nullptr;
+
+    model = model_;
+    sym = sym_;
+    if (version) *version = version_;
+  }
+
+  return std::make_unique<Recognizer>(decoder_conf, std::move(model),
+                                      std::move(sym), fbank_opts_);
+}
+
+int32_t ModelRegistry::Version() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return version_;
+}
+
+std::vector<int32_t> ModelRegistry::LiveVersions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::vector<int32_t> ans;
+  for (const auto &p : old_models_) {
+    if (!p.second.expired()) ans.push_back(p.first);
+  }
+
+  if (model_) ans.push_back(version_);
+
+  return ans;
+}
+
+}  // namespace sherpa_ncnn
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHERPA_NCNN_CSRC_MODEL_REGISTRY_H_
+#define SHERPA_NCNN_CSRC_MODEL_REGISTRY_H_
+
+#include <memory>
+#include <mutex>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "sherpa-ncnn/csrc/model.h"
+#include "sherpa-ncnn/csrc/recognizer.h"
+#include "sherpa-ncnn/csrc/symbol-table.h"
+
+namespace sherpa_ncnn {
+
+/** Replace the model of a running process without interrupting the streams
+ * that are being decoded.
+ *
+ * Each successful Load() creates a new version of the model. Streams
+ * created by CreateStream() use the newest version, while streams created
+ * earlier keep using the version they started with. Each stream holds a
+ * reference to its model, so an old version is freed as soon as it has
+ * been replaced and its last stream is destroyed.
+ *
+ * Usage:
+ *
+ *   ModelRegistry registry(fbank_opts);
+ *   registry.Load(model_config);
+ *
+ *   auto stream = registry.CreateStream(decoder_config);
+ *
+ *   // Later, e.g., when a new model is released. stream is not affected.
+ *   registry.Load(new_model_config);
+ *
+ * All methods are thread-safe. Loading a model does not block
+ * CreateStream() in other threads.
+ */
+class ModelRegistry {
+ public:
+  explicit ModelRegistry(const knf::FbankOptions &fbank_opts);
+
+  ModelRegistry(const ModelRegistry &) = delete;
+  ModelRegistry &operator=(const ModelRegistry &) = delete;
+
+  /** Load a model and make it the newest version.
+   *
+   * @return Return the version of the loaded model, which is 1 for the
+   *         first model, 2 for the second one, etc. Return -1 on error,
+   *         in which case the current version is kept.
+   */
+  int32_t Load(const ModelConfig &config);
+
+#if __ANDROID_API__ >= 9
+  int32_t Load(AAssetManager *mgr, const ModelConfig &config);
+#endif
+
+  /** Create a stream using the newest version of the model.
+   *
+   * @param decoder_conf Config for decoding.
+   * @param version If not nullptr, it is set to the version of the model
+   *                used by the returned stream.
+   *
+   * @return Return nullptr if no model has been loaded.
+   */
+  std::unique_ptr<Recognizer> CreateStream(const DecoderConfig &decoder_conf,
+                                           int32_t *version = nullptr) const;
+
+  // Return the newest version, or 0 if no model has been loaded
+  int32_t Version() const;
+
+  // Return the versions that are still in memory in ascending order, i.e.,
+  // the newest one and older ones still used by some streams
+  std::vector<int32_t> LiveVersions() const;
+
+ private:
+  int32_t Add(std::shared_ptr<Model> model,
+              std::shared_ptr<const SymbolTable> sym);
+
+  knf::FbankOptions fbank_opts_;
+
+  mutable std::mutex mutex_;
+  int32_t version_ = 0;
+  std::shared_ptr<Model> model_;
+  std::shared_ptr<const SymbolTable> sym_;
+
+  // Models of older versions. Streams own them; they are kept here
+  // only to report LiveVersions().
+  std::vector<std::pair<int32_t, std::weak_ptr<Model>>> old_models_;
+};
+
+}  // namespace sherpa_ncnn
+
+#endif  // SHERPA_NCNN_CSRC_MODEL_REGISTRY_H_
@@ -17,7 +17,15 @@
  */
 #include "sherpa-ncnn/csrc/model.h"
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <limits>
 #include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "sherpa-ncnn/csrc/conv-emformer-model.h"
 #include "sherpa-ncnn/csrc/lstm-model.h"
@@ -36,9 +44,29 @@ std::string ModelConfig::ToString() const {
   os << "joiner_param=\"" << joiner_param << "\", ";
   os << "joiner_bin=\"" << joiner_bin << "\", ";
   os << "tokens=\"" << tokens << "\", ";
+  for (int32_t i = 0; i != static_cast<int32_t>(extra_encoder_params.size());
+       ++i) {
+    os << "extra_encoder_param[" << i << "]=\"" << extra_encoder_params[i]
+       << "\", ";
+    if (i < static_cast<int32_t>(extra_encoder_bins.size())) {
+      os << "extra_encoder_bin[" << i << "]=\"" << extra_encoder_bins[i]
+         << "\", ";
+    }
+  }
   os << "encoder num_threads=" << encoder_opt.num_threads << ", ";
   os << "decoder num_threads=" << decoder_opt.num_threads << ", ";
-  os << "joiner num_threads=" << joiner_opt.num_threads << ")";
+  os << "joiner num_threads=" << joiner_opt.num_threads << ", ";
+  os << "encoder_precision=\"" << encoder_precision << "\", ";
+  os << "decoder_precision=\"" << decoder_precision << "\", ";
+  os << "joiner_precision=\"" << joiner_precision << "\", ";
+  os << "precision_check_threshold=" << precision_check_threshold << ", ";
+  os << "feature_dim=" << feature_dim << ", ";
+  os << "enable_encoder_profiling=" << enable_encoder_profiling << ", ";
+  os << "use_native_joiner=" << use_native_joiner << ", ";
+  os << "joiner_shortlist_size=" << joiner_shortlist_size << ", ";
+  os << "joiner_shortlist_rank=" << joiner_shortlist_rank << ", ";
+  os << "joiner_shortlist_fallback_prob=" << joiner_shortlist_fallback_prob
+     << ")";
 
   return os.str();
 }
@@ -104,12 +132,13 @@ void Model::InitNet(ncnn::Net &net, const std::string &param,
                     const std::string &bin) {
   if (net.load_param(param.c_str())) {
     NCNN_LOGE("failed to load %s", param.c_str());
-    exit(-1);
+    load_failed_ = true;
+    return;
   }
 
   if (net.load_model(bin.c_str())) {
     NCNN_LOGE("failed to load %s", bin.c_str());
-    exit(-1);
+    load_failed_ = true;
   }
 }
 
@@ -118,17 +147,436 @@ void Model::InitNet(AAssetManager *mgr, ncnn::Net &net,
                     const std::string &param, const std::string &bin) {
   if (net.load_param(mgr, param.c_str())) {
     NCNN_LOGE("failed to load %s", param.c_str());
-    exit(-1);
+    load_failed_ = true;
+    return;
   }
 
   if (net.load_model(mgr, bin.c_str())) {
     NCNN_LOGE("failed to load %s", bin.c_str());
-    exit(-1);
+    load_failed_ = true;
   }
 }
 #endif
 
-std::unique_ptr<Model> Model::Create(const ModelConfig &config) {
+int64_t ModelMemoryStats::TotalBytes() const {
+  int64_t ans = 0;
+  for (const auto *s : {&encoder, &decoder, &joiner}) {
+    ans += s->weight_bytes + s->peak_blob_bytes + s->peak_workspace_bytes;
+  }
+  return ans;
+}
+
+std::string ModelMemoryStats::ToString() const {
+  std::ostringstream os;
+  const char *names[] = {"encoder", "decoder", "joiner"};
+  const NetMemoryStats *stats[] = {&encoder, &decoder, &joiner};
+
+  os << "ModelMemoryStats(";
+  for (int32_t i = 0; i != 3; ++i) {
+    os << names[i] << "=(";
+    os << "weight_bytes=" << stats[i]->weight_bytes << ", ";
+    os << "blob_bytes=" << stats[i]->blob_bytes << ", ";
+    os << "peak_blob_bytes=" << stats[i]->peak_blob_bytes << ", ";
+    os << "workspace_bytes=" << stats[i]->workspace_bytes << ", ";
+    os << "peak_workspace_bytes=" << stats[i]->peak_workspace_bytes << "), ";
+  }
+  os << "total_bytes=" << TotalBytes() << ")";
+
+  return os.str();
+}
+
+int64_t NumBytes(const std::vector<ncnn::Mat> &mats) {
+  int64_t ans = 0;
+  for (const auto &m : mats) {
+    ans += static_cast<int64_t>(m.total() * m.elemsize);
+  }
+  return ans;
+}
+
+static int64_t FileSize(const std::string &filename) {
+  std::ifstream is(filename, std::ios::binary | std::ios::ate);
+  if (!is) return 0;
+
+  return static_cast<int64_t>(is.tellg());
+}
+
+#if __ANDROID_API__ >= 9
+static int64_t FileSize(AAssetManager *mgr, const std::string &filename) {
+  AAsset *asset =
+      AAssetManager_open(mgr, filename.c_str(), AASSET_MODE_UNKNOWN);
+  if (!asset) return 0;
+
+  int64_t ans = AAsset_getLength64(asset);
+  AAsset_close(asset);
+  return ans;
+}
+#endif
+
+void Model::TrackMemory(ncnn::Net *net, int64_t weight_bytes,
+                        TrackedNet *tracked) {
+  tracked->weight_bytes = weight_bytes;
+
+  // Use the same settings as the local pool allocators of ncnn::Net
+  if (!net->opt.blob_allocator) {
+    tracked->blob_allocator = std::make_unique<TrackingAllocator>(0.f);
+    net->opt.blob_allocator = tracked->blob_allocator.get();
+  }
+
+  if (!net->opt.workspace_allocator) {
+    tracked->workspace_allocator = std::make_unique<TrackingAllocator>(0.5f);
+    net->opt.workspace_allocator = tracked->workspace_allocator.get();
+  }
+}
+
+NetMemoryStats Model::GetNetMemoryStats(const TrackedNet &tracked) {
+  NetMemoryStats ans;
+  ans.weight_bytes = tracked.weight_bytes;
+
+  if (tracked.blob_allocator) {
+    ans.blob_bytes = tracked.blob_allocator->CurrentBytes();
+    ans.peak_blob_bytes = tracked.blob_allocator->PeakBytes();
+  }
+
+  if (tracked.workspace_allocator) {
+    ans.workspace_bytes = tracked.workspace_allocator->CurrentBytes();
+    ans.peak_workspace_bytes = tracked.workspace_allocator->PeakBytes();
+  }
+
+  return ans;
+}
+
+static void AddNetMemoryStats(const NetMemoryStats &s, NetMemoryStats *ans) {
+  ans->weight_bytes += s.weight_bytes;
+  ans->blob_bytes += s.blob_bytes;
+  ans->peak_blob_bytes += s.peak_blob_bytes;
+  ans->workspace_bytes += s.workspace_bytes;
+  ans->peak_workspace_bytes += s.peak_workspace_bytes;
+}
+
+ModelMemoryStats Model::GetMemoryStats() const {
+  ModelMemoryStats ans;
+  ans.encoder = GetNetMemoryStats(tracked_encoder_);
+  ans.decoder = GetNetMemoryStats(tracked_decoder_);
+  ans.joiner = GetNetMemoryStats(tracked_joiner_);
+
+  for (const auto &m : latency_modes_) {
+    AddNetMemoryStats(GetNetMemoryStats(m->tracked_encoder_), &ans.encoder);
+  }
+
+  return ans;
+}
+
+void Model::InitEncoderStats(const ModelConfig &config,
+                             int64_t weight_bytes) {
+  if (config.enable_encoder_profiling) {
+    encoder_profiler_ = std::make_unique<LayerProfiler>(&GetEncoder());
+  }
+
+  TrackMemory(&GetEncoder(), weight_bytes, &tracked_encoder_);
+}
+
+void Model::InitJoinerProjection() {
+  ncnn::Net &joiner = GetJoiner();
+  const auto &blobs = joiner.blobs();
+  const auto &layers = joiner.layers();
+
+  int32_t encoder_out_index = -1;
+  int32_t decoder_out_index = -1;
+  int32_t joiner_out_index = -1;
+  for (int32_t i = 0; i != static_cast<int32_t>(blobs.size()); ++i) {
+    if (blobs[i].name == "in0") encoder_out_index = i;
+    if (blobs[i].name == "in1") decoder_out_index = i;
+    if (blobs[i].name == "out0") joiner_out_index = i;
+  }
+
+  if (encoder_out_index < 0 || decoder_out_index < 0 || joiner_out_index < 0) {
+    return;
+  }
+
+  // Return the output of the InnerProduct layer consuming the given blob
+  // or -1 if the blob is consumed by something else
+  auto proj = [&blobs, &layers](int32_t index) -> int32_t {
+    int32_t consumer = blobs[index].consumer;
+    if (consumer < 0) return -1;
+
+    const ncnn::Layer *layer = layers[consumer];
+    if (layer->type != "InnerProduct" || layer->tops.size() != 1) return -1;
+
+    return layer->tops[0];
+  };
+
+  int32_t encoder_proj_index = proj(encoder_out_index);
+  int32_t decoder_proj_index = proj(decoder_out_index);
+  if (encoder_proj_index < 0 || decoder_proj_index < 0) return;
+
+  // Both projections are consumed by the add layer
+  int32_t consumer = blobs[encoder_proj_index].consumer;
+  if (consumer < 0 || consumer != blobs[decoder_proj_index].consumer) return;
+
+  joiner_encoder_out_index_ = encoder_out_index;
+  joiner_decoder_out_index_ = decoder_out_index;
+  joiner_encoder_proj_index_ = encoder_proj_index;
+  joiner_decoder_proj_index_ = decoder_proj_index;
+  joiner_out_index_ = joiner_out_index;
+}
+
+ncnn::Mat Model::RunJoinerEncoderProj(ncnn::Mat &encoder_out) {
+  if (!HasJoinerProjection()) return encoder_out;
+
+  ncnn::Extractor joiner_ex = GetJoiner().create_extractor();
+  joiner_ex.input(joiner_encoder_out_index_, encoder_out);
+
+  ncnn::Mat encoder_proj;
+  joiner_ex.extract(joiner_encoder_proj_index_, encoder_proj);
+  return encoder_proj;
+}
+
+ncnn::Mat Model::RunJoinerDecoderProj(ncnn::Mat &decoder_out) {
+  if (!HasJoinerProjection()) return decoder_out;
+
+  ncnn::Extractor joiner_ex = GetJoiner().create_extractor();
+  joiner_ex.input(joiner_decoder_out_index_, decoder_out);
+
+  ncnn::Mat decoder_proj;
+  joiner_ex.extract(joiner_decoder_proj_index_, decoder_proj);
+  return decoder_proj;
+}
+
+ncnn::Mat Model::RunJoinerOutput(ncnn::Mat &encoder_proj,
+                                 ncnn::Mat &decoder_proj) {
+  if (native_joiner_) return native_joiner_->Run(encoder_proj, decoder_proj);
+
+  if (!HasJoinerProjection()) return RunJoiner(encoder_proj, decoder_proj);
+
+  // Layers before the two projections are skipped since their outputs
+  // are given
+  ncnn::Extractor joiner_ex = GetJoiner().create_extractor();
+  joiner_ex.input(joiner_encoder_proj_index_, encoder_proj);
+  joiner_ex.input(joiner_decoder_proj_index_, decoder_proj);
+
+  ncnn::Mat joiner_out;
+  joiner_ex.extract(joiner_out_index_, joiner_out);
+  return joiner_out;
+}
+
+void Model::InitNativeJoiner(const ncnn::Net &joiner,
+                             const ModelConfig &config) {
+  if (HasJoinerProjection()) {
+    native_joiner_ =
+        NativeJoiner::Create(joiner, joiner_encoder_proj_index_,
+                             joiner_out_index_, config.joiner_precision);
+  }
+
+  if (!native_joiner_) {
+    NCNN_LOGE(
+        "The joiner does not consist of two projections followed by "
+        "add -> tanh -> InnerProduct. Don't use the native joiner");
+    return;
+  }
+
+  if (config.joiner_shortlist_size > 0) {
+    native_joiner_->InitShortlist(
+        config.joiner_shortlist_size, config.joiner_shortlist_rank,
+        config.joiner_shortlist_fallback_prob, BlankId());
+  }
+
+  tracked_joiner_.weight_bytes += native_joiner_->NumBytes();
+}
+
+// Option to load the joiner for NativeJoiner. Weights are kept on CPU in
+// their original layout so that they can be read from the layers.
+static ncnn::Option NativeJoinerOption(const ModelConfig &config) {
+  ncnn::Option opt = config.joiner_opt;
+  opt.lightmode = false;
+  opt.use_vulkan_compute = false;
+  opt.use_packing_layout = false;
+  opt.use_fp16_packed = false;
+  opt.use_fp16_storage = false;
+  opt.use_fp16_arithmetic = false;
+  opt.use_bf16_storage = false;
+  return opt;
+}
+
+void Model::ApplyPrecision(const std::string &precision, ncnn::Option *opt) {
+  if (precision.empty()) return;
+
+  if (precision == "fp32") {
+    opt->use_fp16_packed = false;
+    opt->use_fp16_storage = false;
+    opt->use_fp16_arithmetic = false;
+    opt->use_bf16_storage = false;
+  } else if (precision == "int8") {
+    opt->use_int8_inference = true;
+    opt->use_int8_storage = true;
+    opt->use_int8_packed = true;
+    opt->use_fp16_packed = false;
+    opt->use_fp16_storage = false;
+    opt->use_fp16_arithmetic = false;
+    opt->use_bf16_storage = false;
+  } else if (precision == "fp16-storage") {
+    opt->use_fp16_packed = true;
+    opt->use_fp16_storage = true;
+    opt->use_fp16_arithmetic = false;
+    opt->use_bf16_storage = false;
+  } else if (precision == "fp16-arithmetic") {
+    opt->use_fp16_packed = true;
+    opt->use_fp16_storage = true;
+    opt->use_fp16_arithmetic = true;
+    opt->use_bf16_storage = false;
+  } else if (precision == "bf16-storage") {
+    opt->use_fp16_packed = false;
+    opt->use_fp16_storage = false;
+    opt->use_fp16_arithmetic = false;
+    opt->use_bf16_storage = true;
+  } else {
+    NCNN_LOGE(
+        "Unsupported precision: %s. Valid values are: fp32, fp16-storage, "
+        "fp16-arithmetic, bf16-storage, int8",
+        precision.c_str());
+    load_failed_ = true;
+  }
+}
+
+static bool NeedsPrecisionCheck(const std::string &precision) {
+  return precision == "fp16-storage" || precision == "fp16-arithmetic" ||
+         precision == "bf16-storage";
+}
+
+// Return max|a - b| / max|b|
+static float MaxRelativeError(const ncnn::Mat &a, const ncnn::Mat &b) {
+  if (a.w != b.w || a.h != b.h || a.c != b.c) {
+    return std::numeric_limits<float>::infinity();
+  }
+
+  float max_diff = 0;
+  float max_abs = 0;
+  int32_t n = a.w * a.h;
+  for (int32_t c = 0; c != a.c; ++c) {
+    const float *pa = a.channel(c);
+    const float *pb = b.channel(c);
+    for (int32_t i = 0; i != n; ++i) {
+      max_diff = std::max(max_diff, std::abs(pa[i] - pb[i]));
+      max_abs = std::max(max_abs, std::abs(pb[i]));
+    }
+  }
+
+  return max_diff / std::max(max_abs, 1e-6f);
+}
+
+// Run the encoder, decoder, and joiner of model and ref on the same input
+// and return the maximum relative error of each of them with respect to ref.
+static std::vector<float> ComputePrecisionErrors(Model *model, Model *ref,
+                                                 int32_t feature_dim) {
+  // A chunk of fbank-like features. They are generated deterministically
+  // so the check gives the same result every time.
+  ncnn::Mat features(feature_dim, ref->Segment());
+  float *p = features;
+  uint32_t seed = 20230101;
+  for (int32_t i = 0; i != features.w * features.h; ++i) {
+    seed = seed * 1664525u + 1013904223u;
+    p[i] = -12.0f + 12.0f * (seed >> 8) / static_cast<float>(1 << 24);
+  }
+
+  ncnn::Mat encoder_out = model->RunEncoder(features, {}).first;
+  ncnn::Mat ref_encoder_out = ref->RunEncoder(features, {}).first;
+
+  int32_t context_size = ref->ContextSize();
+  ncnn::Mat decoder_input(context_size);
+  for (int32_t i = 0; i != context_size; ++i) {
+    static_cast<int32_t *>(decoder_input)[i] = ref->BlankId();
+  }
+
+  ncnn::Mat decoder_out = model->RunDecoder(decoder_input);
+  ncnn::Mat ref_decoder_out = ref->RunDecoder(decoder_input);
+
+  // Both joiners use the same input so that only the error of the joiner
+  // itself is measured
+  ncnn::Mat encoder_out_0(ref_encoder_out.w, ref_encoder_out.row(0));
+  ncnn::Mat joiner_out = model->RunJoiner(encoder_out_0, ref_decoder_out);
+  ncnn::Mat ref_joiner_out = ref->RunJoiner(encoder_out_0, ref_decoder_out);
+
+  return {MaxRelativeError(encoder_out, ref_encoder_out),
+          MaxRelativeError(decoder_out, ref_decoder_out),
+          MaxRelativeError(joiner_out, ref_joiner_out)};
+}
+
+// Check networks using fp16 or bf16 against fp32 and reload the model
+// with fp32 for networks whose error is too large.
+//
+// @param model The model created from config.
+// @param config The config used to create model. On return, it contains
+//               the precisions of the returned model.
+// @param create A function to create a model from a config.
+static std::unique_ptr<Model> CheckPrecision(
+    std::unique_ptr<Model> model, ModelConfig *config,
+    const std::function<std::unique_ptr<Model>(const ModelConfig &)>
+        &create) {
+  if (!model || config->precision_check_threshold <= 0) return model;
+
+  std::vector<std::string *> precisions;
+  ModelConfig new_config = *config;
+  for (auto *precision :
+       {&new_config.encoder_precision, &new_config.decoder_precision,
+        &new_config.joiner_precision}) {
+    if (NeedsPrecisionCheck(*precision)) {
+      precisions.push_back(precision);
+    }
+  }
+
+  if (precisions.empty()) return model;
+
+  ModelConfig ref_config = *config;
+  ref_config.encoder_precision = "fp32";
+  ref_config.decoder_precision = "fp32";
+  ref_config.joiner_precision = "fp32";
+
+  auto ref = create(ref_config);
+  if (!ref) return model;
+
+  std::vector<float> errors =
+      ComputePrecisionErrors(model.get(), ref.get(), config->feature_dim);
+  ref.reset();
+
+  const char *names[] = {"encoder", "decoder", "joiner"};
+  std::string *all[] = {&new_config.encoder_precision,
+                        &new_config.decoder_precision,
+                        &new_config.joiner_precision};
+
+  bool changed = false;
+  for (int32_t i = 0; i != 3; ++i) {
+    if (!NeedsPrecisionCheck(*all[i])) continue;
+
+    if (errors[i] > config->precision_check_threshold) {
+      NCNN_LOGE("%s: max relative error of %s is %.4f > %.4f. Use fp32",
+                names[i], all[i]->c_str(), errors[i],
+                config->precision_check_threshold);
+      *all[i] = "fp32";
+      changed = true;
+    } else {
+      NCNN_LOGE("%s: max relative error of %s is %.4f", names[i],
+                all[i]->c_str(), errors[i]);
+    }
+  }
+
+  if (!changed) return model;
+
+  *config = new_config;
+
+  model.reset();
+  return create(new_config);
+}
+
+// Return nullptr if a network of the model failed to load
+static std::unique_ptr<Model> CheckLoaded(std::unique_ptr<Model> model) {
+  if (!model->IsLoaded()) return nullptr;
+
+  return model;
+}
+
+// If encoder_only is true, only the encoder network is loaded.
+// See Model::GetLatencyMode().
+static std::unique_ptr<Model> CreateModel(const ModelConfig &config,
+                                          bool encoder_only = false) {
   // 1. Load the encoder network
   // 2. If the encoder network has LSTM layers, we assume it is a LstmModel
   // 3. Otherwise, we assume it is a ConvEmformer
@@ -145,15 +593,16 @@ std::unique_ptr<Model> Model::Create(const ModelConfig &config) {
   }
 
   if (IsLstmModel(net)) {
-    return std::make_unique<LstmModel>(config);
+    return CheckLoaded(std::make_unique<LstmModel>(config, encoder_only));
   }
 
   if (IsConvEmformerModel(net)) {
-    return std::make_unique<ConvEmformerModel>(config);
+    return CheckLoaded(
+        std::make_unique<ConvEmformerModel>(config, encoder_only));
   }
 
   if (IsZipformerModel(net)) {
-    return std::make_unique<ZipformerModel>(config);
+    return CheckLoaded(std::make_unique<ZipformerModel>(config, encoder_only));
   }
 
   NCNN_LOGE(
@@ -169,9 +618,83 @@ std::unique_ptr<Model> Model::Create(const ModelConfig &config) {
   return nullptr;
 }
 
+// Return the config to load the encoder of the given latency mode, which
+// must be at least 1. See ModelConfig::extra_encoder_params.
+static ModelConfig LatencyModeConfig(const ModelConfig &config,
+                                     int32_t mode) {
+  ModelConfig ans = config;
+  ans.encoder_param = config.extra_encoder_params[mode - 1];
+  ans.encoder_bin = config.extra_encoder_bins[mode - 1];
+  ans.extra_encoder_params.clear();
+  ans.extra_encoder_bins.clear();
+  return ans;
+}
+
+static bool CheckLatencyModes(const ModelConfig &config) {
+  if (config.extra_encoder_params.size() != config.extra_encoder_bins.size()) {
+    NCNN_LOGE("Got %d extra encoder param files but %d bin files",
+              static_cast<int32_t>(config.extra_encoder_params.size()),
+              static_cast<int32_t>(config.extra_encoder_bins.size()));
+    return false;
+  }
+
+  return true;
+}
+
+Model *Model::GetLatencyMode(int32_t mode) {
+  if (mode == 0) return this;
+
+  if (mode < 0 || mode >= NumLatencyModes()) return nullptr;
+
+  return latency_modes_[mode - 1].get();
+}
+
+std::unique_ptr<Model> Model::Create(const ModelConfig &config) {
+  if (!CheckLatencyModes(config)) return nullptr;
+
+  // It contains the precisions after the check, which are reused by the
+  // encoders of other latency modes
+  ModelConfig checked_config = config;
+  auto model = CheckPrecision(
+      CreateModel(config), &checked_config,
+      [](const ModelConfig &c) { return CreateModel(c); });
+
+  if (!model) return nullptr;
+
+  model->InitEncoderStats(config, FileSize(config.encoder_bin));
+  TrackMemory(&model->GetDecoder(), FileSize(config.decoder_bin),
+              &model->tracked_decoder_);
+  TrackMemory(&model->GetJoiner(), FileSize(config.joiner_bin),
+              &model->tracked_joiner_);
+
+  model->InitJoinerProjection();
+
+  if (config.use_native_joiner) {
+    ncnn::Net joiner;
+    joiner.opt = NativeJoinerOption(config);
+    model->InitNet(joiner, config.joiner_param, config.joiner_bin);
+    if (!model->IsLoaded()) return nullptr;
+
+    model->InitNativeJoiner(joiner, config);
+  }
+
+  int32_t num_modes = static_cast<int32_t>(config.extra_encoder_params.size());
+  for (int32_t mode = 1; mode <= num_modes; ++mode) {
+    ModelConfig mode_config = LatencyModeConfig(checked_config, mode);
+    auto m = CreateModel(mode_config, true);
+    if (!m) return nullptr;
+
+    m->InitEncoderStats(mode_config, FileSize(mode_config.encoder_bin));
+    model->latency_modes_.push_back(std::move(m));
+  }
+
+  return model;
+}
+
 #if __ANDROID_API__ >= 9
-std::unique_ptr<Model> Model::Create(AAssetManager *mgr,
-                                     const ModelConfig &config) {
+static std::unique_ptr<Model> CreateModel(AAssetManager *mgr,
+                                          const ModelConfig &config,
+                                          bool encoder_only = false) {
   ncnn::Net net;
   RegisterMetaDataLayer(net);
 
@@ -182,15 +705,17 @@ std::unique_ptr<Model> Model::Create(AAssetManager *mgr,
   }
 
   if (IsLstmModel(net)) {
-    return std::make_unique<LstmModel>(mgr, config);
+    return CheckLoaded(std::make_unique<LstmModel>(mgr, config, encoder_only));
   }
 
   if (IsConvEmformerModel(net)) {
-    return std::make_unique<ConvEmformerModel>(mgr, config);
+    return CheckLoaded(
+        std::make_unique<ConvEmformerModel>(mgr, config, encoder_only));
   }
 
   if (IsZipformerModel(net)) {
-    return std::make_unique<ZipformerModel>(mgr, config);
+    return CheckLoaded(
+        std::make_unique<ZipformerModel>(mgr, config, encoder_only));
   }
 
   NCNN_LOGE(
@@ -205,6 +730,47 @@ std::unique_ptr<Model> Model::Create(AAssetManager *mgr,
 
   return nullptr;
 }
+
+std::unique_ptr<Model> Model::Create(AAssetManager *mgr,
+                                     const ModelConfig &config) {
+  if (!CheckLatencyModes(config)) return nullptr;
+
+  ModelConfig checked_config = config;
+  auto model = CheckPrecision(
+      CreateModel(mgr, config), &checked_config,
+      [mgr](const ModelConfig &c) { return CreateModel(mgr, c); });
+
+  if (!model) return nullptr;
+
+  model->InitEncoderStats(config, FileSize(mgr, config.encoder_bin));
+  TrackMemory(&model->GetDecoder(), FileSize(mgr, config.decoder_bin),
+              &model->tracked_decoder_);
+  TrackMemory(&model->GetJoiner(), FileSize(mgr, config.joiner_bin),
+              &model->tracked_joiner_);
+
+  model->InitJoinerProjection();
+
+  if (config.use_native_joiner) {
+    ncnn::Net joiner;
+    joiner.opt = NativeJoinerOption(config);
+    model->InitNet(mgr, joiner, config.joiner_param, config.joiner_bin);
+    if (!model->IsLoaded()) return nullptr;
+
+    model->InitNativeJoiner(joiner, config);
+  }
+
+  int32_t num_modes = static_cast<int32_t>(config.extra_encoder_params.size());
+  for (int32_t mode = 1; mode <= num_modes; ++mode) {
+    ModelConfig mode_config = LatencyModeConfig(checked_config, mode);
+    auto m = CreateModel(mgr, mode_config, true);
+    if (!m) return nullptr;
+
+    m->InitEncoderStats(mode_config, FileSize(mgr, mode_config.encoder_bin));
+    model->latency_modes_.push_back(std::move(m));
+  }
+
+  return model;
+}
 #endif
 
 }  // namespace sherpa_ncnn
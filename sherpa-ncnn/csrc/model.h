@@ -25,6 +25,9 @@
 #include <vector>
 
 #include "net.h"  // NOLINT
+#include "sherpa-ncnn/csrc/layer-profiler.h"
+#include "sherpa-ncnn/csrc/native-joiner.h"
+#include "sherpa-ncnn/csrc/tracking-allocator.h"
 
 namespace sherpa_ncnn {
 
@@ -38,13 +41,101 @@ struct ModelConfig {
   std::string tokens;         // path to tokens.txt
   bool use_vulkan_compute = true;
 
+  // Paths to encoders of the same model exported with other chunk sizes.
+  // Each of them is a latency mode: mode 0 uses encoder_param/encoder_bin
+  // and mode i uses extra_encoder_params[i - 1]/extra_encoder_bins[i - 1].
+  // A stream chooses a mode with DecoderConfig::latency_mode.
+  std::vector<std::string> extra_encoder_params;
+  std::vector<std::string> extra_encoder_bins;
+
   ncnn::Option encoder_opt;
   ncnn::Option decoder_opt;
   ncnn::Option joiner_opt;
 
+  // Numeric precision of each network. Valid values are:
+  //
+  //  - "" (default): Use encoder_opt/decoder_opt/joiner_opt as given.
+  //    Zipformer and LSTM models still disable fp16 for the encoder.
+  //  - "fp32"
+  //  - "fp16-storage": Store weights and activations in fp16, compute in fp32
+  //  - "fp16-arithmetic": Store and compute in fp16
+  //  - "bf16-storage": Store weights and activations in bf16, compute in fp32
+  //  - "int8": Use int8 for quantized layers and fp32 for the others.
+  //            It requires a model generated by ncnn2int8.
+  //
+  // fp16 and bf16 take effect only if they are supported by the hardware.
+  // LSTM encoders always use fp32 storage.
+  std::string encoder_precision;
+  std::string decoder_precision;
+  std::string joiner_precision;
+
+  // If it is positive, each network using fp16 or bf16 is compared with
+  // its fp32 counterpart on a calibration chunk after loading. If the
+  // maximum relative error of its output exceeds this value, the network
+  // falls back to fp32.
+  float precision_check_threshold = 0.05;
+
+  // Dimension of the input features, i.e., the number of mel bins of the
+  // fbank. The precision check uses it to build its calibration chunk.
+  // Recognizer and ModelRegistry set it from their fbank options.
+  int32_t feature_dim = 80;
+
+  // If true, record the time and output size of each encoder layer.
+  // Use Model::GetEncoderProfiler() to get the report.
+  // It slows down the encoder slightly and supports only CPU.
+  bool enable_encoder_profiling = false;
+
+  // If true, the add, tanh, and output layers of the joiner are computed
+  // by NativeJoiner instead of ncnn. It keeps another copy of the output
+  // weight in fp32, fp16, or int8 according to joiner_precision and runs
+  // on CPU. It takes effect only if the projections of the joiner can be
+  // found. See Model::RunJoinerEncoderProj().
+  bool use_native_joiner = false;
+
+  // Used only if use_native_joiner is true.
+  //
+  // If positive, only the joiner_shortlist_size most likely tokens and
+  // blank, as predicted by a rank joiner_shortlist_rank approximation of
+  // the output weight, are computed exactly for each frame. If the other
+  // tokens get more than joiner_shortlist_fallback_prob of the probability
+  // from the approximation, the full vocabulary is computed for that frame.
+  // It helps models with a large vocabulary, e.g., Chinese models.
+  int32_t joiner_shortlist_size = 0;
+  int32_t joiner_shortlist_rank = 32;
+  float joiner_shortlist_fallback_prob = 0.02;
+
+  std::string ToString() const;
+};
+
+struct NetMemoryStats {
+  // Size of the .bin file. Weights converted to fp16 or bf16 at load time
+  // use less memory than this.
+  int64_t weight_bytes = 0;
+
+  // Bytes of intermediate blobs and workspace currently allocated from the
+  // pool allocators of this network and their high-water marks. They are
+  // shared by all streams using the same model and are 0 if the caller
+  // has provided its own allocators in ModelConfig.
+  int64_t blob_bytes = 0;
+  int64_t peak_blob_bytes = 0;
+  int64_t workspace_bytes = 0;
+  int64_t peak_workspace_bytes = 0;
+};
+
+struct ModelMemoryStats {
+  NetMemoryStats encoder;
+  NetMemoryStats decoder;
+  NetMemoryStats joiner;
+
+  // Sum of weight bytes and peak blob and workspace bytes of all networks
+  int64_t TotalBytes() const;
+
   std::string ToString() const;
 };
 
+// Return the number of bytes of the data in the given mats
+int64_t NumBytes(const std::vector<ncnn::Mat> &mats);
+
 class Model {
  public:
   virtual ~Model() = default;
@@ -117,6 +208,48 @@ class Model {
   virtual ncnn::Mat RunJoiner(ncnn::Mat &encoder_out, ncnn::Mat &decoder_out,
                               ncnn::Extractor *extractor) = 0;
 
+  /** The joiner computes
+   *
+   *    output_linear(tanh(encoder_proj(encoder_out) +
+   *                       decoder_proj(decoder_out)))
+   *
+   * The following three functions run it in parts so that each encoder
+   * frame and each decoder output is projected only once, no matter how
+   * many times it is paired with the other side. The two projections are
+   * located in the joiner network at load time. If they cannot be found,
+   * the projections return their input unchanged and RunJoinerOutput()
+   * runs the whole joiner, so callers don't need to check
+   * HasJoinerProjection().
+   *
+   * @param encoder_out  A mat of shape (num_frames, encoder_dim) or
+   *                     (encoder_dim,)
+   *
+   * @return Return a mat of shape (num_frames, joiner_dim) or (joiner_dim,)
+   */
+  ncnn::Mat RunJoinerEncoderProj(ncnn::Mat &encoder_out);
+
+  /** @param decoder_out  A mat of shape (num_paths, decoder_dim) or
+   *                      (decoder_dim,)
+   *
+   * @return Return a mat of shape (num_paths, joiner_dim) or (joiner_dim,)
+   */
+  ncnn::Mat RunJoinerDecoderProj(ncnn::Mat &decoder_out);
+
+  /** @param encoder_proj  Output of RunJoinerEncoderProj(). It must have
+   *                       the same number of rows as decoder_proj.
+   * @param decoder_proj  Output of RunJoinerDecoderProj().
+   *
+   * @return Return the joiner output which is of shape (vocab_size,) or
+   *         (num_rows, vocab_size)
+   */
+  ncnn::Mat RunJoinerOutput(ncnn::Mat &encoder_proj, ncnn::Mat &decoder_proj);
+
+  // Return true if RunJoinerOutput() uses a NativeJoiner.
+  // See ModelConfig::use_native_joiner.
+  bool HasNativeJoiner() const { return native_joiner_ != nullptr; }
+
+  bool HasJoinerProjection() const { return joiner_encoder_proj_index_ >= 0; }
+
   virtual int32_t ContextSize() const { return 2; }
 
   virtual int32_t BlankId() const { return 0; }
@@ -128,14 +261,93 @@ class Model {
   // running the encoder network
   virtual int32_t Offset() const = 0;
 
+  // Return the number of latency modes. See
+  // ModelConfig::extra_encoder_params.
+  int32_t NumLatencyModes() const {
+    return 1 + static_cast<int32_t>(latency_modes_.size());
+  }
+
+  // Return the model of the given latency mode or nullptr if it is out of
+  // range. Mode 0 is this model. Other modes are models that load only the
+  // extra encoders. Use this model to run the decoder and joiner of all
+  // modes.
+  Model *GetLatencyMode(int32_t mode);
+
+  // Return nullptr if ModelConfig::enable_encoder_profiling is false
+  LayerProfiler *GetEncoderProfiler() const { return encoder_profiler_.get(); }
+
+  // The encoders of all latency modes are included.
+  ModelMemoryStats GetMemoryStats() const;
+
+  // Return false if a network could not be loaded. Create() never returns
+  // such a model.
+  bool IsLoaded() const { return !load_failed_; }
+
  protected:
-  static void InitNet(ncnn::Net &net, const std::string &param,
-                      const std::string &bin);
+  // Load net from the given files. On error, the model is marked as
+  // failed so that Create() returns nullptr instead of exiting. It
+  // matters for processes that load new models while running.
+  void InitNet(ncnn::Net &net, const std::string &param,
+               const std::string &bin);
 
 #if __ANDROID_API__ >= 9
-  static void InitNet(AAssetManager *mgr, ncnn::Net &net,
-                      const std::string &param, const std::string &bin);
+  void InitNet(AAssetManager *mgr, ncnn::Net &net, const std::string &param,
+               const std::string &bin);
 #endif
+
+  // Change opt according to the given precision.
+  // See ModelConfig::encoder_precision for valid values. An invalid value
+  // marks the model as failed.
+  void ApplyPrecision(const std::string &precision, ncnn::Option *opt);
+
+ private:
+  struct TrackedNet {
+    std::unique_ptr<TrackingAllocator> blob_allocator;
+    std::unique_ptr<TrackingAllocator> workspace_allocator;
+    int64_t weight_bytes = 0;
+  };
+
+  // Install tracking allocators for the given net unless it already
+  // uses user provided allocators.
+  static void TrackMemory(ncnn::Net *net, int64_t weight_bytes,
+                          TrackedNet *tracked);
+
+  static NetMemoryStats GetNetMemoryStats(const TrackedNet &tracked);
+
+  // Set up profiling and memory tracking of the encoder
+  void InitEncoderStats(const ModelConfig &config, int64_t weight_bytes);
+
+  // Locate the outputs of encoder_proj and decoder_proj in the joiner.
+  // See RunJoinerEncoderProj().
+  void InitJoinerProjection();
+
+  // Create native_joiner_ from the given joiner network, which must be
+  // loaded from the same files as GetJoiner() with lightmode disabled
+  void InitNativeJoiner(const ncnn::Net &joiner, const ModelConfig &config);
+
+  // The following members are declared in the base class so that they are
+  // destroyed after the networks of subclasses
+  std::unique_ptr<LayerProfiler> encoder_profiler_;
+
+  TrackedNet tracked_encoder_;
+  TrackedNet tracked_decoder_;
+  TrackedNet tracked_joiner_;
+
+  // Blob indexes in the joiner. joiner_encoder_proj_index_ is -1 if the
+  // joiner cannot be run in parts.
+  int32_t joiner_encoder_out_index_ = -1;
+  int32_t joiner_decoder_out_index_ = -1;
+  int32_t joiner_encoder_proj_index_ = -1;
+  int32_t joiner_decoder_proj_index_ = -1;
+  int32_t joiner_out_index_ = -1;
+
+  std::unique_ptr<NativeJoiner> native_joiner_;
+
+  // Models of latency modes 1, 2, ...
+  std::vector<std::unique_ptr<Model>> latency_modes_;
+
+  // See InitNet()
+  bool load_failed_ = false;
 };
 
 }  // namespace sherpa_ncnn
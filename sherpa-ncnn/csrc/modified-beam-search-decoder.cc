@@ -19,16 +19,19 @@
 #include "sherpa-ncnn/csrc/modified-beam-search-decoder.h"
 
 #include <algorithm>
+#include <map>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "sherpa-ncnn/csrc/math.h"
+#include "sherpa-ncnn/csrc/metrics.h"
 
 namespace sherpa_ncnn {
 
-// @param in 1-D tensor of shape (encoder_dim,)
+// @param in 1-D tensor of shape (dim,), e.g., a projected encoder frame
 // @param n Number of times to repeat
-// @return Return a 2-d tensor of shape (n, encoder_dim)
+// @return Return a 2-d tensor of shape (n, dim)
 //
 // TODO(fangjun): Remove this function
 // once
@@ -63,35 +66,24 @@ static void LogSoftmax(ncnn::Mat *in_out) {
   }
 }
 
-// The decoder model contains an embedding layer, which only supports
-// 1-D output.
-// This is a wrapper to support 2-D decoder output.
-//
-// @param model_ The NN model.
-// @param decoder_input A 2-D tensor of shape (num_active_paths, context_size)
-// @return Return a 2-D tensor of shape (num_active_paths, decoder_dim)
-//
-// TODO(fangjun): Change Embed in ncnn to output 2-d tensors
-static ncnn::Mat RunDecoder2D(Model *model_, ncnn::Mat decoder_input) {
-  ncnn::Mat decoder_out;
-  int32_t h = decoder_input.h;
+int32_t ModifiedBeamSearchDecoder::NumActivePaths(
+    const float *log_probs, int32_t vocab_size) const {
+  if (!config_.adaptive_beam) return config_.num_active_paths;
 
-  for (int32_t y = 0; y != h; ++y) {
-    ncnn::Mat decoder_input_t =
-        ncnn::Mat(decoder_input.w, decoder_input.row(y));
+  int32_t max_paths = config_.num_active_paths;
+  int32_t min_paths =
+      std::min(std::max(config_.min_active_paths, 1), max_paths);
 
-    ncnn::Mat tmp = model_->RunDecoder(decoder_input_t);
+  float low = config_.adaptive_beam_low_entropy;
+  float high = config_.adaptive_beam_high_entropy;
 
-    if (y == 0) {
-      decoder_out = ncnn::Mat(tmp.w, h);
-    }
+  float entropy = Entropy(log_probs, vocab_size);
+  if (entropy <= low) return min_paths;
+  if (entropy >= high) return max_paths;
 
-    const float *ptr = tmp;
-    float *out_ptr = decoder_out.row(y);
-    std::copy(ptr, ptr + tmp.w, out_ptr);
-  }
-
-  return decoder_out;
+  float scale = (entropy - low) / (high - low);
+  return min_paths +
+         static_cast<int32_t>(std::ceil(scale * (max_paths - min_paths)));
 }
 
 void ModifiedBeamSearchDecoder::AcceptWaveform(const float sample_rate,
@@ -101,27 +93,62 @@ void ModifiedBeamSearchDecoder::AcceptWaveform(const float sample_rate,
                                     frames_per_buffer);
 }
 
-ncnn::Mat ModifiedBeamSearchDecoder::BuildDecoderInput(
-    const std::vector<Hypothesis> &hyps) const {
+ncnn::Mat ModifiedBeamSearchDecoder::GetDecoderProj(
+    const std::vector<Hypothesis> &hyps, int32_t *num_decoder_calls) {
   int32_t num_hyps = static_cast<int32_t>(hyps.size());
 
-  ncnn::Mat decoder_input(context_size_, num_hyps);
-  auto p = static_cast<int32_t *>(decoder_input);
+  std::map<std::vector<int32_t>, ncnn::Mat> cache;
+  ncnn::Mat ans;
+
+  for (int32_t i = 0; i != num_hyps; ++i) {
+    const auto &ys = hyps[i].ys;
+    std::vector<int32_t> context(ys.end() - context_size_, ys.end());
+
+    auto it = cache.find(context);
+    if (it == cache.end()) {
+      ncnn::Mat decoder_proj;
+
+      auto prev = decoder_proj_cache_.find(context);
+      if (prev != decoder_proj_cache_.end()) {
+        decoder_proj = prev->second;
+      } else {
+        // The decoder model contains an embedding layer, which only
+        // supports 1-D input, so we run it for each context separately
+        ncnn::Mat decoder_input(context_size_);
+        std::copy(context.begin(), context.end(),
+                  static_cast<int32_t *>(decoder_input));
+
+        ncnn::Mat decoder_out = root_model_->RunDecoder(decoder_input);
+        decoder_proj = root_model_->RunJoinerDecoderProj(decoder_out);
+        ++*num_decoder_calls;
+      }
+
+      it = cache.emplace(std::move(context), decoder_proj).first;
+    }
 
-  for (const auto &hyp : hyps) {
-    const auto &ys = hyp.ys;
-    std::copy(ys.end() - context_size_, ys.end(), p);
-    p += context_size_;
+    const ncnn::Mat &decoder_proj = it->second;
+    if (i == 0) {
+      ans.create(decoder_proj.w, num_hyps);
+    }
+
+    const float *p = decoder_proj;
+    std::copy(p, p + decoder_proj.w, ans.row(i));
   }
 
-  return decoder_input;
+  decoder_proj_cache_ = std::move(cache);
+
+  return ans;
 }
 
 void ModifiedBeamSearchDecoder::ResetResult() {
   result_.text.clear();
+  result_.tokens.clear();
+  result_.timestamps.clear();
+  result_.num_stable_tokens = 0;
+  result_.stable_text_length = 0;
   std::vector<int32_t> blanks(context_size_, blank_id_);
   Hypotheses blank_hyp({{blanks, 0}});
-  result_.hyps = std::move(blank_hyp);
+  hyps_ = std::move(blank_hyp);
   result_.num_trailing_blanks = 0;
 }
 
@@ -129,34 +156,49 @@ void ModifiedBeamSearchDecoder::Decode() {
   while (feature_extractor_.NumFramesReady() - num_processed_ >= segment_) {
     ncnn::Mat features = feature_extractor_.GetFrames(num_processed_, segment_);
     ncnn::Mat encoder_out;
-    std::tie(encoder_out, encoder_state_) =
-        model_->RunEncoder(features, encoder_state_);
+    {
+      ScopedMetricsTimer timer(&Metrics::Get().encoder_latency);
+      std::tie(encoder_out, encoder_state_) =
+          model_->RunEncoder(features, encoder_state_);
+    }
+
+    int32_t num_decoder_calls = 0;
 
-    Hypotheses cur = std::move(result_.hyps);
+    // Project all frames of the chunk at once so that only the add, tanh
+    // and output layers of the joiner run per frame below
+    ncnn::Mat encoder_proj = root_model_->RunJoinerEncoderProj(encoder_out);
+
+    Hypotheses cur = std::move(hyps_);
     /* encoder_out.w == encoder_out_dim, encoder_out.h == num_frames. */
     for (int32_t t = 0; t != encoder_out.h; ++t) {
+      // If adaptive_beam is true, cur contains at most num_active_paths
+      // paths selected for the previous frame, so the decoder and joiner
+      // below run with a batch size that follows the beam width.
       std::vector<Hypothesis> prev =
           cur.GetTopK(config_.num_active_paths, true);
 
       cur.Clear();
 
-      ncnn::Mat decoder_input = BuildDecoderInput(prev);
-
-      ncnn::Mat decoder_out = RunDecoder2D(model_, decoder_input);
+      ncnn::Mat decoder_proj = GetDecoderProj(prev, &num_decoder_calls);
 
-      // decoder_out.w == decoder_dim
-      // decoder_out.h == num_active_paths
+      // decoder_proj.w == joiner_dim
+      // decoder_proj.h == num_active_paths
 
-      ncnn::Mat encoder_out_t(encoder_out.w, encoder_out.row(t));
-      encoder_out_t = RepeatEncoderOut(encoder_out_t, decoder_out.h);
+      ncnn::Mat encoder_proj_t(encoder_proj.w, encoder_proj.row(t));
+      encoder_proj_t = RepeatEncoderOut(encoder_proj_t, decoder_proj.h);
 
-      ncnn::Mat joiner_out = model_->RunJoiner(encoder_out_t, decoder_out);
+      ncnn::Mat joiner_out =
+          root_model_->RunJoinerOutput(encoder_proj_t, decoder_proj);
       // joiner_out.w == vocab_size
       // joiner_out.h == num_active_paths
       LogSoftmax(&joiner_out);
-      auto topk =
-          TopkIndex(static_cast<float *>(joiner_out),
-                    joiner_out.w * joiner_out.h, config_.num_active_paths);
+
+      // prev is sorted, so row 0 belongs to the best path
+      int32_t num_active_paths =
+          NumActivePaths(joiner_out.row(0), joiner_out.w);
+
+      auto topk = TopkIndex(static_cast<float *>(joiner_out),
+                            joiner_out.w * joiner_out.h, num_active_paths);
 
       for (auto i : topk) {
         int32_t hyp_index = i / joiner_out.w;
@@ -168,6 +210,7 @@ void ModifiedBeamSearchDecoder::Decode() {
 
         if (new_token != blank_id_) {
           new_hyp.ys.push_back(new_token);
+          new_hyp.timestamps.push_back(num_output_frames_ + t);
           new_hyp.num_trailing_blanks = 0;
         } else {
           ++new_hyp.num_trailing_blanks;
@@ -178,27 +221,158 @@ void ModifiedBeamSearchDecoder::Decode() {
     }  // for (int32_t t = 0; t != encoder_out.h; ++t) {
 
     num_processed_ += offset_;
-    result_.hyps = std::move(cur);
+    num_output_frames_ += encoder_out.h;
+    hyps_ = std::move(cur);
+
+    if (Metrics::Enabled()) {
+      auto &metrics = Metrics::Get();
+      metrics.encoder_calls.Inc();
+      metrics.frames_decoded.Add(encoder_out.h);
+      // The joiner runs once per frame on a batch of active paths
+      metrics.joiner_calls.Add(encoder_out.h);
+      metrics.decoder_calls.Add(num_decoder_calls);
+    }
+
+    if (config_.emit_segments) {
+      EmitSegmentOnEndpoint();
+    }
   }
 }
 
-RecognitionResult ModifiedBeamSearchDecoder::GetResult() {
+void ModifiedBeamSearchDecoder::EmitSegmentOnEndpoint() {
+  if (!IsEndpoint()) return;
+
+  int32_t start_frame = segment_start_frame_;
+
+  // It resets the result since we are at an endpoint
+  RecognitionResult r = GetResult();
+
+  if (config_.reset_state_on_endpoint) {
+    encoder_state_.clear();
+  }
+
+  if (r.timestamps.empty()) return;
+
+  RecognitionSegment segment;
+  segment.id = num_segments_++;
+  segment.start_frame = start_frame;
+  segment.end_frame = num_output_frames_;
+  segment.text = std::move(r.text);
+  segment.tokens.assign(r.tokens.begin() + context_size_, r.tokens.end());
+  segment.timestamps = std::move(r.timestamps);
+
+  segments_.push_back(std::move(segment));
+}
+
+bool ModifiedBeamSearchDecoder::PopSegment(RecognitionSegment *segment) {
+  if (segments_.empty()) return false;
+
+  *segment = std::move(segments_.front());
+  segments_.pop_front();
+  return true;
+}
+
+bool ModifiedBeamSearchDecoder::SetLatencyMode(int32_t mode) {
+  if (!root_model_->GetLatencyMode(mode)) return false;
+
+  pending_latency_mode_ = mode;
+
+  // Nothing has been decoded yet, so we can switch now
+  if (num_processed_ == 0) ApplyLatencyMode();
+
+  return true;
+}
+
+void ModifiedBeamSearchDecoder::ApplyLatencyMode() {
+  if (pending_latency_mode_ == latency_mode_) return;
+
+  latency_mode_ = pending_latency_mode_;
+  model_ = root_model_->GetLatencyMode(latency_mode_);
+  segment_ = model_->Segment();
+  offset_ = model_->Offset();
+
+  // Encoders with different chunk sizes have incompatible states
+  encoder_state_.clear();
+  decoder_proj_cache_.clear();
+}
+
+void ModifiedBeamSearchDecoder::GetResult(RecognitionResult *result) {
   // return best result
-  auto best_hyp = result_.hyps.GetMostProbable(true);
-  std::string best_hyp_text;
-  for (const auto &token : best_hyp.ys) {
-    if (token != blank_id_) {
-      best_hyp_text += (*sym_)[token];
-    }
+  const auto &best_hyp = hyps_.GetMostProbable(true);
+  const auto &ys = best_hyp.ys;
+  int32_t num_tokens = static_cast<int32_t>(ys.size());
+
+  // Tokens shared by all active paths won't change any more
+  int32_t num_stable = num_tokens;
+  for (const auto &p : hyps_) {
+    const auto &other = p.second.ys;
+    int32_t n = std::min(num_stable, static_cast<int32_t>(other.size()));
+    int32_t k = context_size_;
+    while (k < n && other[k] == ys[k]) ++k;
+    num_stable = k;
   }
-  result_.text = std::move(best_hyp_text);
+
+  // The first context_size_ tokens are blanks and blanks are never
+  // appended to ys, so we can detokenize the remaining tokens directly
+  result_.text.clear();
+  sym_->Detokenize(ys.data() + context_size_, num_stable - context_size_,
+                   &result_.text);
+  result_.stable_text_length = static_cast<int32_t>(result_.text.size());
+  sym_->Detokenize(ys.data() + num_stable, num_tokens - num_stable,
+                   &result_.text);
+
+  result_.num_stable_tokens = num_stable - context_size_;
+  result_.tokens = ys;
+  result_.timestamps = best_hyp.timestamps;
   result_.num_trailing_blanks = best_hyp.num_trailing_blanks;
-  auto ans = result_;
+  *result = result_;
+
+  if (IsEndpoint()) ResetOnEndpoint();
+}
+
+void ModifiedBeamSearchDecoder::ResetOnEndpoint() {
+  if (Metrics::Enabled()) Metrics::Get().endpoints.Inc();
+  ResetResult();
+  ApplyLatencyMode();
+  endpoint_start_frame_ = num_processed_;
+  segment_start_frame_ = num_output_frames_;
+}
 
-  if (config_.enable_endpoint && IsEndpoint()) {
-    ResetResult();
-    endpoint_start_frame_ = num_processed_;
+Hypotheses ModifiedBeamSearchDecoder::GetBeam() const { return hyps_; }
+
+RecognitionResult ModifiedBeamSearchDecoder::DrainResult() {
+  bool is_endpoint = IsEndpoint();
+
+  // It resets hyps_ on endpoints
+  RecognitionResult ans = GetResult();
+  if (is_endpoint) {
+    // Nothing of this segment will change any more
+    ans.num_stable_tokens = static_cast<int32_t>(ans.timestamps.size());
+    ans.stable_text_length = static_cast<int32_t>(ans.text.size());
+    return ans;
+  }
+
+  int32_t n = ans.num_stable_tokens;
+
+  ans.tokens.resize(context_size_ + n);
+  ans.timestamps.resize(n);
+  ans.text.resize(ans.stable_text_length);
+
+  if (n == 0) return ans;
+
+  // All paths share the stable tokens. Remove them from every path but
+  // keep the last context_size_ of them as the decoder context. Since the
+  // same prefix is removed, paths that were different stay different.
+  std::vector<Hypothesis> hyps;
+  hyps.reserve(hyps_.Size());
+  for (const auto &p : hyps_) {
+    Hypothesis hyp = p.second;
+    hyp.ys.erase(hyp.ys.begin(), hyp.ys.begin() + n);
+    hyp.timestamps.erase(hyp.timestamps.begin(), hyp.timestamps.begin() + n);
+    hyps.push_back(std::move(hyp));
   }
+  hyps_ = Hypotheses(std::move(hyps));
+
   return ans;
 }
 
@@ -209,17 +383,47 @@ void ModifiedBeamSearchDecoder::InputFinished() {
 bool ModifiedBeamSearchDecoder::IsEndpoint() {
   if (!config_.enable_endpoint) return false;
 
-  auto best_hyp = result_.hyps.GetMostProbable(true);
+  const auto &best_hyp = hyps_.GetMostProbable(true);
   result_.num_trailing_blanks = best_hyp.num_trailing_blanks;
   return endpoint_->IsEndpoint(num_processed_ - endpoint_start_frame_,
                                result_.num_trailing_blanks * 4, 10 / 1000.0);
 }
 
+StreamMemoryStats ModifiedBeamSearchDecoder::GetMemoryStats() const {
+  StreamMemoryStats ans;
+  ans.feature_bytes = feature_extractor_.NumBytes();
+  ans.encoder_state_bytes = NumBytes(encoder_state_);
+  for (const auto &p : decoder_proj_cache_) {
+    ans.encoder_state_bytes += p.first.capacity() * sizeof(int32_t) +
+                               NumBytes({p.second});
+  }
+
+  int64_t hyp_bytes = result_.text.capacity();
+  for (const auto &p : hyps_) {
+    const auto &hyp = p.second;
+    hyp_bytes += p.first.capacity() + sizeof(hyp) +
+                 hyp.ys.capacity() * sizeof(int32_t) +
+                 hyp.timestamps.capacity() * sizeof(int32_t);
+  }
+  ans.hyp_bytes = hyp_bytes;
+
+  return ans;
+}
+
 void ModifiedBeamSearchDecoder::Reset() {
+  // Callers may reset the stream on an endpoint without getting the result
+  if (IsEndpoint()) ResetOnEndpoint();
+
   ResetResult();
   feature_extractor_.Reset();
   num_processed_ = 0;
+  num_output_frames_ = 0;
   endpoint_start_frame_ = 0;
+  segment_start_frame_ = 0;
+  num_segments_ = 0;
+  segments_.clear();
+  ApplyLatencyMode();
+  decoder_proj_cache_.clear();
 }
 
 }  // namespace sherpa_ncnn
@@ -20,6 +20,8 @@
 #ifndef SHERPA_NCNN_CSRC_MODIFIED_BEAM_SEARCH_DECODER_H_
 #define SHERPA_NCNN_CSRC_MODIFIED_BEAM_SEARCH_DECODER_H_
 
+#include <deque>
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -35,15 +37,21 @@ class ModifiedBeamSearchDecoder : public Decoder {
                             const sherpa_ncnn::SymbolTable *sym,
                             const Endpoint *endpoint)
       : config_(config),
-        model_(model),
+        root_model_(model),
+        model_(model->GetLatencyMode(config.latency_mode)),
         feature_extractor_(fbank_opts),
         sym_(sym),
-        blank_id_(model_->BlankId()),
-        context_size_(model_->ContextSize()),
-        segment_(model->Segment()),
+        blank_id_(root_model_->BlankId()),
+        context_size_(root_model_->ContextSize()),
+        segment_(model_->Segment()),
         offset_(model_->Offset()),
         num_processed_(0),
+        num_output_frames_(0),
         endpoint_start_frame_(0),
+        segment_start_frame_(0),
+        num_segments_(0),
+        latency_mode_(config.latency_mode),
+        pending_latency_mode_(config.latency_mode),
         endpoint_(endpoint) {
     ResetResult();
   }
@@ -53,7 +61,14 @@ class ModifiedBeamSearchDecoder : public Decoder {
 
   void Decode() override;
 
-  RecognitionResult GetResult() override;
+  using Decoder::GetResult;
+  void GetResult(RecognitionResult *result) override;
+
+  Hypotheses GetBeam() const override;
+
+  RecognitionResult DrainResult() override;
+
+  bool PopSegment(RecognitionSegment *segment) override;
 
   void ResetResult() override;
 
@@ -63,21 +78,81 @@ class ModifiedBeamSearchDecoder : public Decoder {
 
   void InputFinished() override;
 
+  StreamMemoryStats GetMemoryStats() const override;
+
+  int32_t NumPendingFrames() const override {
+    return feature_extractor_.NumFramesReady() - num_processed_;
+  }
+
+  int32_t Segment() const override { return segment_; }
+
+  bool SetLatencyMode(int32_t mode) override;
+
+  int32_t LatencyMode() const override { return latency_mode_; }
+
  private:
-  ncnn::Mat BuildDecoderInput(const std::vector<Hypothesis> &hyps) const;
+  // Emit a segment if an endpoint is detected. Used only if
+  // config_.emit_segments is true.
+  void EmitSegmentOnEndpoint();
+
+  // Switch to pending_latency_mode_ if it differs from latency_mode_.
+  // It resets the encoder state, so it is called only at the start of the
+  // stream or at an endpoint.
+  void ApplyLatencyMode();
+
+  // Start a new segment at an endpoint. Every endpoint ends up here, so it
+  // is also where endpoints are counted.
+  void ResetOnEndpoint();
+
+  // Return the decoder output of each of the given paths projected by the
+  // joiner. Each row of the returned mat belongs to a path.
+  //
+  // The decoder runs only for contexts that were not seen in the previous
+  // call, e.g., paths that emitted a blank reuse their previous result.
+  //
+  // @param hyps The paths.
+  // @param num_decoder_calls It is incremented by the number of decoder runs.
+  ncnn::Mat GetDecoderProj(const std::vector<Hypothesis> &hyps,
+                           int32_t *num_decoder_calls);
+
+  // Return the number of paths to keep for the current frame.
+  //
+  // @param log_probs Log-probabilities of the best path for the current
+  //                  frame.
+  // @param vocab_size Number of entries in log_probs.
+  int32_t NumActivePaths(const float *log_probs, int32_t vocab_size) const;
 
   const DecoderConfig config_;
-  Model *model_;
+  Model *root_model_;  // runs the decoder and joiner of all latency modes
+  Model *model_;       // runs the encoder of the current latency mode
   sherpa_ncnn::FeatureExtractor feature_extractor_;
   const sherpa_ncnn::SymbolTable *sym_;
   const int32_t blank_id_;
   const int32_t context_size_;
-  const int32_t segment_;
-  const int32_t offset_;
+  int32_t segment_;
+  int32_t offset_;
   std::vector<ncnn::Mat> encoder_state_;
+
+  // Map the last context_size_ tokens of a path to its decoder output
+  // projected by the joiner. It contains only contexts of the paths passed
+  // to the last call of GetDecoderProj().
+  std::map<std::vector<int32_t>, ncnn::Mat> decoder_proj_cache_;
   int32_t num_processed_;
+  int32_t num_output_frames_;  // number of encoder output frames so far
   int32_t endpoint_start_frame_;
+
+  // In encoder output frames
+  int32_t segment_start_frame_;
+  int32_t num_segments_;
+  std::deque<RecognitionSegment> segments_;
+
+  int32_t latency_mode_;
+  int32_t pending_latency_mode_;  // to switch to at the next endpoint
+
   const Endpoint *endpoint_;
+
+  // Active paths of the search. result_ is computed from the best one.
+  Hypotheses hyps_;
   RecognitionResult result_;
 };
 
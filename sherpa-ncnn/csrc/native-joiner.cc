@@ -0,0 +1,478 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sherpa-ncnn/csrc/native-joiner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "layer/innerproduct.h"
+#include "sherpa-ncnn/csrc/metrics.h"
+
+namespace sherpa_ncnn {
+
+// Number of weight rows converted to fp32 at a time for fp16 weights
+static constexpr int32_t kBlockSize = 64;
+
+// Number of subspace iterations to approximate the weight for the shortlist
+static constexpr int32_t kNumShortlistIterations = 6;
+
+// Buffers of Run() that are reused by later calls in the same thread, so
+// that decoding a frame does not allocate once they are large enough.
+// A NativeJoiner is shared by streams in different threads, so they cannot
+// be members.
+struct NativeJoinerScratch {
+  std::vector<float> hidden;
+  std::vector<int32_t> rows;
+
+  // Used only with the shortlist
+  std::vector<float> z;
+  std::vector<int32_t> shortlist;
+
+  // Weight rows converted to fp32
+  std::vector<float> buf;
+};
+
+static NativeJoinerScratch &GetScratch() {
+  static thread_local NativeJoinerScratch scratch;
+  return scratch;
+}
+
+// Option of the layer converting fp16 weights to fp32
+static ncnn::Option CastOption() {
+  ncnn::Option opt;
+  opt.num_threads = 1;
+  return opt;
+}
+
+// Return the dot product of w and x, both of which have n entries.
+//
+// It uses 8 independent partial sums so that the compiler can vectorize
+// the loop without -ffast-math.
+template <typename T>
+static float Dot(const T *w, const float *x, int32_t n) {
+  float sum[8] = {0};
+
+  int32_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int32_t k = 0; k != 8; ++k) {
+      sum[k] += w[i + k] * x[i + k];
+    }
+  }
+
+  float ans = 0;
+  for (int32_t k = 0; k != 8; ++k) {
+    ans += sum[k];
+  }
+
+  for (; i < n; ++i) {
+    ans += w[i] * x[i];
+  }
+
+  return ans;
+}
+
+// Orthonormalize the rows of q with the modified Gram-Schmidt process.
+//
+// @param q A matrix of shape (rank, dim) in row major.
+static void Orthonormalize(float *q, int32_t rank, int32_t dim) {
+  for (int32_t j = 0; j != rank; ++j) {
+    float *qj = q + j * dim;
+    for (int32_t k = 0; k != j; ++k) {
+      const float *qk = q + k * dim;
+      float d = Dot(qk, qj, dim);
+      for (int32_t i = 0; i != dim; ++i) {
+        qj[i] -= d * qk[i];
+      }
+    }
+
+    float norm = std::sqrt(Dot(qj, qj, dim));
+    if (norm > 0) {
+      for (int32_t i = 0; i != dim; ++i) {
+        qj[i] /= norm;
+      }
+    }
+  }
+}
+
+std::unique_ptr<NativeJoiner> NativeJoiner::Create(
+    const ncnn::Net &joiner, int32_t encoder_proj_index,
+    int32_t joiner_out_index, const std::string &precision) {
+  const auto &blobs = joiner.blobs();
+  const auto &layers = joiner.layers();
+
+  // Check that the joiner ends with add -> tanh -> InnerProduct, where
+  // the add consumes the output of encoder_proj
+  int32_t linear_index = blobs[joiner_out_index].producer;
+  if (linear_index < 0 || layers[linear_index]->type != "InnerProduct") {
+    return nullptr;
+  }
+
+  const auto *linear = (const ncnn::InnerProduct *)layers[linear_index];
+  if (linear->activation_type != 0 || linear->weight_data.empty()) {
+    return nullptr;
+  }
+
+  int32_t tanh_index = blobs[linear->bottoms[0]].producer;
+  if (tanh_index < 0 || layers[tanh_index]->type != "TanH") {
+    return nullptr;
+  }
+
+  int32_t add_index = blobs[layers[tanh_index]->bottoms[0]].producer;
+  if (add_index < 0 || add_index != blobs[encoder_proj_index].consumer) {
+    return nullptr;
+  }
+
+  std::unique_ptr<NativeJoiner> ans(new NativeJoiner);
+  int32_t vocab_size = linear->num_output;
+  int32_t joiner_dim = linear->weight_data_size / vocab_size;
+  int32_t size = vocab_size * joiner_dim;
+
+  ans->vocab_size_ = vocab_size;
+  ans->joiner_dim_ = joiner_dim;
+
+  ans->bias_.assign(vocab_size, 0);
+  if (linear->bias_term) {
+    const float *p = linear->bias_data;
+    std::copy(p, p + vocab_size, ans->bias_.begin());
+  }
+
+  const ncnn::Mat &weight = linear->weight_data;
+  if (weight.elemsize == 1) {
+    // The model is quantized by ncnn2int8. weight_data_int8_scales maps
+    // fp32 weights to int8.
+    const int8_t *p = weight;
+    const float *scales = linear->weight_data_int8_scales;
+
+    ans->type_ = Type::kInt8;
+    ans->weight_i8_.assign(p, p + size);
+    ans->scales_.resize(vocab_size);
+    for (int32_t i = 0; i != vocab_size; ++i) {
+      ans->scales_[i] = 1.0f / scales[i];
+    }
+  } else if (precision == "int8") {
+    // Symmetric quantization with a scale per row
+    const float *p = weight;
+
+    ans->type_ = Type::kInt8;
+    ans->weight_i8_.resize(size);
+    ans->scales_.resize(vocab_size);
+    for (int32_t i = 0; i != vocab_size; ++i) {
+      const float *row = p + i * joiner_dim;
+      float absmax = 0;
+      for (int32_t k = 0; k != joiner_dim; ++k) {
+        absmax = std::max(absmax, std::abs(row[k]));
+      }
+
+      float scale = absmax > 0 ? absmax / 127 : 1;
+      ans->scales_[i] = scale;
+
+      int8_t *out = ans->weight_i8_.data() + i * joiner_dim;
+      for (int32_t k = 0; k != joiner_dim; ++k) {
+        out[k] = static_cast<int8_t>(std::round(row[k] / scale));
+      }
+    }
+  } else if (precision == "fp16-storage" || precision == "fp16-arithmetic") {
+    const float *p = weight;
+
+    ans->type_ = Type::kFloat16;
+    ans->weight_f16_.resize(size);
+    for (int32_t i = 0; i != size; ++i) {
+      ans->weight_f16_[i] = ncnn::float32_to_float16(p[i]);
+    }
+
+    // Unlike ncnn::cast_float16_to_float32(), the layer is created once
+    ncnn::ParamDict pd;
+    pd.set(0, 2);  // from fp16
+    pd.set(1, 1);  // to fp32
+
+    ans->cast_ = ncnn::create_layer(ncnn::LayerType::Cast);
+    ans->cast_->load_param(pd);
+    ans->cast_->create_pipeline(CastOption());
+  } else {
+    const float *p = weight;
+
+    ans->type_ = Type::kFloat32;
+    ans->weight_f32_.assign(p, p + size);
+  }
+
+  return ans;
+}
+
+NativeJoiner::~NativeJoiner() {
+  if (cast_) {
+    cast_->destroy_pipeline(CastOption());
+    delete cast_;
+  }
+}
+
+const float *NativeJoiner::GetRows(int32_t begin, int32_t n,
+                                   std::vector<float> *buf) const {
+  if (type_ == Type::kFloat32) {
+    return weight_f32_.data() + begin * joiner_dim_;
+  }
+
+  // type_ is kFloat16. ncnn converts it with SIMD where available.
+  uint16_t *p = const_cast<uint16_t *>(weight_f16_.data());
+  ncnn::Mat src(n * joiner_dim_, p + begin * joiner_dim_, 2u);
+
+  // dst already has the shape of the output, so ncnn writes to buf
+  // instead of allocating
+  buf->resize(n * joiner_dim_);
+  ncnn::Mat dst(n * joiner_dim_, buf->data(), 4u);
+
+  cast_->forward(src, dst, CastOption());
+
+  return buf->data();
+}
+
+void NativeJoiner::InitShortlist(int32_t size, int32_t rank,
+                                 float fallback_prob, int32_t blank_id) {
+  int32_t dim = joiner_dim_;
+  rank = std::min({rank, dim, vocab_size_});
+
+  // A shortlist of the whole vocabulary saves nothing
+  if (size <= 0 || rank <= 0 || size >= vocab_size_) {
+    shortlist_size_ = 0;
+    return;
+  }
+
+  // The weight in fp32
+  std::vector<float> w(vocab_size_ * dim);
+  if (type_ == Type::kInt8) {
+    for (int32_t v = 0; v != vocab_size_; ++v) {
+      for (int32_t i = 0; i != dim; ++i) {
+        w[v * dim + i] = weight_i8_[v * dim + i] * scales_[v];
+      }
+    }
+  } else {
+    std::vector<float> buf;
+    for (int32_t begin = 0; begin < vocab_size_; begin += kBlockSize) {
+      int32_t n = std::min(kBlockSize, vocab_size_ - begin);
+      const float *rows = GetRows(begin, n, &buf);
+      std::copy(rows, rows + n * dim, w.begin() + begin * dim);
+    }
+  }
+
+  // Subspace iteration for the top right singular vectors of w. They are
+  // generated deterministically so that results are reproducible.
+  std::vector<float> q(rank * dim);
+  uint32_t seed = 20230101;
+  for (auto &x : q) {
+    seed = seed * 1664525u + 1013904223u;
+    x = -1.0f + 2.0f * (seed >> 8) / static_cast<float>(1 << 24);
+  }
+  Orthonormalize(q.data(), rank, dim);
+
+  std::vector<float> y(vocab_size_ * rank);
+  for (int32_t iter = 0; iter != kNumShortlistIterations; ++iter) {
+    // y = w q^T
+    for (int32_t v = 0; v != vocab_size_; ++v) {
+      for (int32_t j = 0; j != rank; ++j) {
+        y[v * rank + j] = Dot(&w[v * dim], &q[j * dim], dim);
+      }
+    }
+
+    // q = y^T w
+    std::fill(q.begin(), q.end(), 0);
+    for (int32_t v = 0; v != vocab_size_; ++v) {
+      const float *wv = &w[v * dim];
+      for (int32_t j = 0; j != rank; ++j) {
+        float c = y[v * rank + j];
+        float *qj = &q[j * dim];
+        for (int32_t i = 0; i != dim; ++i) {
+          qj[i] += c * wv[i];
+        }
+      }
+    }
+
+    Orthonormalize(q.data(), rank, dim);
+  }
+
+  // w is approximated by (w q^T) q
+  shortlist_u_.resize(vocab_size_ * rank);
+  for (int32_t v = 0; v != vocab_size_; ++v) {
+    for (int32_t j = 0; j != rank; ++j) {
+      shortlist_u_[v * rank + j] = Dot(&w[v * dim], &q[j * dim], dim);
+    }
+  }
+  shortlist_v_ = std::move(q);
+
+  shortlist_size_ = size;
+  shortlist_rank_ = rank;
+  shortlist_fallback_prob_ = fallback_prob;
+  blank_id_ = blank_id;
+}
+
+ncnn::Mat NativeJoiner::Run(const ncnn::Mat &encoder_proj,
+                            const ncnn::Mat &decoder_proj) const {
+  int32_t num_rows = encoder_proj.dims == 1 ? 1 : encoder_proj.h;
+  int32_t dim = joiner_dim_;
+  NativeJoinerScratch &scratch = GetScratch();
+
+  // tanh(encoder_proj + decoder_proj) of all rows
+  std::vector<float> &hidden = scratch.hidden;
+  hidden.resize(num_rows * dim);
+  for (int32_t r = 0; r != num_rows; ++r) {
+    const float *e = encoder_proj.row(r);
+    const float *d = decoder_proj.row(r);
+    float *h = hidden.data() + r * dim;
+    for (int32_t i = 0; i != dim; ++i) {
+      h[i] = std::tanh(e[i] + d[i]);
+    }
+  }
+
+  ncnn::Mat ans = encoder_proj.dims == 1 ? ncnn::Mat(vocab_size_)
+                                         : ncnn::Mat(vocab_size_, num_rows);
+
+  // Rows to compute exactly
+  std::vector<int32_t> &rows = scratch.rows;
+  rows.clear();
+  if (shortlist_size_ > 0) {
+    for (int32_t r = 0; r != num_rows; ++r) {
+      if (!ComputeShortlist(hidden.data() + r * dim, ans.row(r), &scratch)) {
+        rows.push_back(r);
+      }
+    }
+
+    if (Metrics::Enabled()) {
+      auto &metrics = Metrics::Get();
+      metrics.joiner_shortlist_rows.Add(num_rows);
+      metrics.joiner_shortlist_fallbacks.Add(rows.size());
+    }
+  } else {
+    rows.resize(num_rows);
+    std::iota(rows.begin(), rows.end(), 0);
+  }
+
+  if (!rows.empty()) {
+    ComputeRows(hidden, rows, &scratch.buf, &ans);
+  }
+
+  return ans;
+}
+
+void NativeJoiner::ComputeRows(const std::vector<float> &hidden,
+                               const std::vector<int32_t> &rows,
+                               std::vector<float> *buf,
+                               ncnn::Mat *ans) const {
+  int32_t dim = joiner_dim_;
+
+  // Each row of the weight is multiplied with all rows of hidden before
+  // moving to the next one, so the weight is read only once per call
+  if (type_ == Type::kInt8) {
+    for (int32_t v = 0; v != vocab_size_; ++v) {
+      const int8_t *w = weight_i8_.data() + v * dim;
+      for (int32_t r : rows) {
+        ans->row(r)[v] =
+            Dot(w, hidden.data() + r * dim, dim) * scales_[v] + bias_[v];
+      }
+    }
+    return;
+  }
+
+  for (int32_t begin = 0; begin < vocab_size_; begin += kBlockSize) {
+    int32_t n = std::min(kBlockSize, vocab_size_ - begin);
+    const float *w = GetRows(begin, n, buf);
+
+    for (int32_t k = 0; k != n; ++k) {
+      int32_t v = begin + k;
+      for (int32_t r : rows) {
+        ans->row(r)[v] =
+            Dot(w + k * dim, hidden.data() + r * dim, dim) + bias_[v];
+      }
+    }
+  }
+}
+
+bool NativeJoiner::ComputeShortlist(const float *hidden, float *out,
+                                    NativeJoinerScratch *scratch) const {
+  int32_t dim = joiner_dim_;
+  int32_t rank = shortlist_rank_;
+
+  // Approximate scores of all tokens
+  std::vector<float> &z = scratch->z;
+  z.resize(rank);
+  for (int32_t j = 0; j != rank; ++j) {
+    z[j] = Dot(shortlist_v_.data() + j * dim, hidden, dim);
+  }
+
+  // The best tokens are kept in a min-heap of shortlist_size_ entries
+  // while scoring, so the vocabulary is visited only once
+  std::vector<int32_t> &shortlist = scratch->shortlist;
+  shortlist.clear();
+  auto greater = [out](int32_t a, int32_t b) { return out[a] > out[b]; };
+
+  for (int32_t v = 0; v != vocab_size_; ++v) {
+    out[v] = Dot(shortlist_u_.data() + v * rank, z.data(), rank) + bias_[v];
+
+    if (static_cast<int32_t>(shortlist.size()) < shortlist_size_) {
+      shortlist.push_back(v);
+      std::push_heap(shortlist.begin(), shortlist.end(), greater);
+    } else if (out[v] > out[shortlist.front()]) {
+      std::pop_heap(shortlist.begin(), shortlist.end(), greater);
+      shortlist.back() = v;
+      std::push_heap(shortlist.begin(), shortlist.end(), greater);
+    }
+  }
+
+  if (std::find(shortlist.begin(), shortlist.end(), blank_id_) ==
+      shortlist.end()) {
+    shortlist.push_back(blank_id_);
+  }
+
+  // Exact scores of the shortlist
+  for (int32_t v : shortlist) {
+    if (type_ == Type::kInt8) {
+      const int8_t *w = weight_i8_.data() + v * dim;
+      out[v] = Dot(w, hidden, dim) * scales_[v] + bias_[v];
+    } else {
+      out[v] = Dot(GetRows(v, 1, &scratch->buf), hidden, dim) + bias_[v];
+    }
+  }
+
+  // Probability of tokens outside the shortlist according to their
+  // approximate scores. Tokens in the shortlist are distinct, so it is the
+  // total minus that of the shortlist.
+  float max_score = *std::max_element(out, out + vocab_size_);
+  double total = 0;
+  for (int32_t v = 0; v != vocab_size_; ++v) {
+    total += std::exp(out[v] - max_score);
+  }
+
+  double inside = 0;
+  for (int32_t v : shortlist) {
+    inside += std::exp(out[v] - max_score);
+  }
+
+  return total - inside <= shortlist_fallback_prob_ * total;
+}
+
+int64_t NativeJoiner::NumBytes() const {
+  return weight_f32_.size() * sizeof(float) +
+         weight_f16_.size() * sizeof(uint16_t) + weight_i8_.size() +
+         (scales_.size() + bias_.size() + shortlist_u_.size() +
+          shortlist_v_.size()) *
+             sizeof(float);
+}
+
+}  // namespace sherpa_ncnn
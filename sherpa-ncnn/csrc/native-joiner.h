@@ -0,0 +1,156 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHERPA_NCNN_CSRC_NATIVE_JOINER_H_
+#define SHERPA_NCNN_CSRC_NATIVE_JOINER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "net.h"  // NOLINT
+
+namespace sherpa_ncnn {
+
+struct NativeJoinerScratch;
+
+/** Compute the part of the joiner after the two projections, i.e.,
+ *
+ *    output_linear(tanh(encoder_proj + decoder_proj))
+ *
+ * without going through ncnn::Extractor. The add and tanh are computed once
+ * per row and each row of the output weight is multiplied with all input
+ * rows while it is in cache.
+ *
+ * The output weight is kept in fp32, fp16, or int8 with a scale per row.
+ * It is read-only after construction, so a NativeJoiner can be used from
+ * multiple threads. Temporary buffers are kept per thread and reused.
+ */
+class NativeJoiner {
+ public:
+  NativeJoiner(const NativeJoiner &) = delete;
+  NativeJoiner &operator=(const NativeJoiner &) = delete;
+
+  ~NativeJoiner();
+
+  /** Create a native joiner from a joiner network.
+   *
+   * @param joiner  The joiner network. It must be loaded with lightmode
+   *                disabled so that the weights of its layers are kept.
+   * @param encoder_proj_index  Index of the output blob of encoder_proj.
+   * @param joiner_out_index  Index of the output blob of the joiner.
+   * @param precision  "fp16-storage" and "fp16-arithmetic" keep the weight
+   *                   in fp16, "int8" keeps it in int8, and others in fp32.
+   *                   If the network is already quantized to int8, the
+   *                   weight is kept in int8 regardless of it.
+   *
+   * @return Return nullptr if the joiner does not end with
+   *         add -> tanh -> InnerProduct.
+   */
+  static std::unique_ptr<NativeJoiner> Create(const ncnn::Net &joiner,
+                                              int32_t encoder_proj_index,
+                                              int32_t joiner_out_index,
+                                              const std::string &precision);
+
+  /**
+   * @param encoder_proj  A mat of shape (num_rows, joiner_dim) or
+   *                      (joiner_dim,)
+   * @param decoder_proj  A mat of the same shape as encoder_proj
+   *
+   * @return Return a mat of shape (num_rows, vocab_size) or (vocab_size,)
+   */
+  ncnn::Mat Run(const ncnn::Mat &encoder_proj,
+                const ncnn::Mat &decoder_proj) const;
+
+  /** Compute the output layer only for a shortlist of tokens.
+   *
+   * A rank `rank` approximation of the output weight is computed here
+   * by subspace iteration. In Run(), it scores all tokens cheaply and
+   * only the `size` best ones and blank are computed exactly. Other tokens
+   * keep their approximate scores. If they still hold more than
+   * `fallback_prob` of the probability, the whole row is computed exactly.
+   *
+   * It is not thread-safe and must be called before Run() is used.
+   */
+  void InitShortlist(int32_t size, int32_t rank, float fallback_prob,
+                     int32_t blank_id);
+
+  // Number of bytes used by the weights
+  int64_t NumBytes() const;
+
+ private:
+  enum class Type { kFloat32, kFloat16, kInt8 };
+
+  NativeJoiner() = default;
+
+  // Return rows [begin, begin + n) of the weight in fp32. buf is used
+  // for rows that are not stored in fp32.
+  const float *GetRows(int32_t begin, int32_t n,
+                       std::vector<float> *buf) const;
+
+  // Compute the given rows of the output exactly.
+  //
+  // @param hidden tanh(encoder_proj + decoder_proj) of all rows
+  // @param rows Indexes of the rows to compute
+  // @param buf Used by GetRows()
+  // @param ans The output
+  void ComputeRows(const std::vector<float> &hidden,
+                   const std::vector<int32_t> &rows, std::vector<float> *buf,
+                   ncnn::Mat *ans) const;
+
+  // Compute a row of the output with the shortlist.
+  // Return false if the shortlist is not confident enough, in which case
+  // out has to be recomputed with ComputeRows().
+  bool ComputeShortlist(const float *hidden, float *out,
+                        NativeJoinerScratch *scratch) const;
+
+  Type type_ = Type::kFloat32;
+  int32_t joiner_dim_ = 0;
+  int32_t vocab_size_ = 0;
+
+  // Only one of them is used depending on type_.
+  // Each contains vocab_size_ rows of joiner_dim_ entries.
+  std::vector<float> weight_f32_;
+  std::vector<uint16_t> weight_f16_;
+  std::vector<int8_t> weight_i8_;
+
+  // Used only for kInt8. A row of the weight is weight_i8_ * scale
+  std::vector<float> scales_;
+
+  std::vector<float> bias_;  // of size vocab_size_
+
+  // Converts rows of weight_f16_ to fp32. Used only for kFloat16.
+  // Its forward() is const, so it can be used from multiple threads.
+  ncnn::Layer *cast_ = nullptr;
+
+  // See InitShortlist(). The shortlist is disabled if shortlist_size_ is 0.
+  // The output weight is approximated by shortlist_u_ * shortlist_v_, which
+  // are of shape (vocab_size_, shortlist_rank_) and
+  // (shortlist_rank_, joiner_dim_) respectively.
+  int32_t shortlist_size_ = 0;
+  int32_t shortlist_rank_ = 0;
+  float shortlist_fallback_prob_ = 0;
+  int32_t blank_id_ = 0;
+  std::vector<float> shortlist_u_;
+  std::vector<float> shortlist_v_;
+};
+
+}  // namespace sherpa_ncnn
+
+#endif  // SHERPA_NCNN_CSRC_NATIVE_JOINER_H_
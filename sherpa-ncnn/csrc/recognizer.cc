@@ -21,10 +21,13 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "sherpa-ncnn/csrc/greedy-search-decoder.h"
+#include "sherpa-ncnn/csrc/metrics.h"
 #include "sherpa-ncnn/csrc/modified-beam-search-decoder.h"
+#include "sherpa-ncnn/csrc/thread-pool.h"
 
 namespace sherpa_ncnn {
 
@@ -34,63 +37,222 @@ std::string DecoderConfig::ToString() const {
   os << "DecoderConfig(";
   os << "method=\"" << method << "\", ";
   os << "num_active_paths=" << num_active_paths << ", ";
+  os << "adaptive_beam=" << (adaptive_beam ? "True" : "False") << ", ";
+  os << "min_active_paths=" << min_active_paths << ", ";
+  os << "adaptive_beam_low_entropy=" << adaptive_beam_low_entropy << ", ";
+  os << "adaptive_beam_high_entropy=" << adaptive_beam_high_entropy << ", ";
   os << "enable_endpoint=" << (enable_endpoint ? "True" : "False") << ", ";
-  os << "endpoint_config=" << endpoint_config.ToString() << ")";
+  os << "emit_segments=" << (emit_segments ? "True" : "False") << ", ";
+  os << "reset_state_on_endpoint="
+     << (reset_state_on_endpoint ? "True" : "False") << ", ";
+  os << "endpoint_config=" << endpoint_config.ToString() << ", ";
+  os << "latency_mode=" << latency_mode << ")";
 
   return os.str();
 }
 
+std::string MemoryStats::ToString() const {
+  std::ostringstream os;
+
+  os << "MemoryStats(";
+  os << "model=" << model.ToString() << ", ";
+  os << "stream=StreamMemoryStats(";
+  os << "feature_bytes=" << stream.feature_bytes << ", ";
+  os << "encoder_state_bytes=" << stream.encoder_state_bytes << ", ";
+  os << "hyp_bytes=" << stream.hyp_bytes << ", ";
+  os << "total_bytes=" << stream.TotalBytes() << "))";
+
+  return os.str();
+}
+
+// Return model_conf with the feature dim of the given fbank options
+static ModelConfig WithFeatureDim(const ModelConfig &model_conf,
+                                  const knf::FbankOptions &fbank_opts) {
+  ModelConfig ans = model_conf;
+  ans.feature_dim = fbank_opts.mel_opts.num_bins;
+  return ans;
+}
+
 Recognizer::Recognizer(const DecoderConfig &decoder_conf,
                        const ModelConfig &model_conf,
                        const knf::FbankOptions &fbank_opts)
-    : model_(Model::Create(model_conf)),
-      sym_(std::make_unique<SymbolTable>(model_conf.tokens)),
-      endpoint_(std::make_unique<Endpoint>(decoder_conf.endpoint_config)) {
-  if (decoder_conf.method == "modified_beam_search") {
-    decoder_ = std::make_unique<ModifiedBeamSearchDecoder>(
-        decoder_conf, model_.get(), fbank_opts, sym_.get(), endpoint_.get());
-  } else if (decoder_conf.method == "greedy_search") {
-    decoder_ = std::make_unique<GreedySearchDecoder>(
-        decoder_conf, model_.get(), fbank_opts, sym_.get(), endpoint_.get());
-  } else {
-    NCNN_LOGE("Unsupported decoding method: %s\n", decoder_conf.method.c_str());
-    exit(-1);
-  }
+    : decoder_conf_(decoder_conf),
+      fbank_opts_(fbank_opts),
+      model_(Model::Create(WithFeatureDim(model_conf, fbank_opts))),
+      sym_(std::make_shared<SymbolTable>(model_conf.tokens)) {
+  InitDecoder();
 }
 
 #if __ANDROID_API__ >= 9
 Recognizer::Recognizer(AAssetManager *mgr, const DecoderConfig &decoder_conf,
                        const ModelConfig &model_conf,
                        const knf::FbankOptions &fbank_opts)
-    : model_(Model::Create(mgr, model_conf)),
-      sym_(std::make_unique<SymbolTable>(mgr, model_conf.tokens)),
-      endpoint_(std::make_unique<Endpoint>(decoder_conf.endpoint_config)) {
-  if (decoder_conf.method == "modified_beam_search") {
+    : decoder_conf_(decoder_conf),
+      fbank_opts_(fbank_opts),
+      model_(Model::Create(mgr, WithFeatureDim(model_conf, fbank_opts))),
+      sym_(std::make_shared<SymbolTable>(mgr, model_conf.tokens)) {
+  InitDecoder();
+}
+#endif
+
+Recognizer::Recognizer(const DecoderConfig &decoder_conf,
+                       std::shared_ptr<Model> model,
+                       std::shared_ptr<const SymbolTable> sym,
+                       const knf::FbankOptions &fbank_opts)
+    : decoder_conf_(decoder_conf),
+      fbank_opts_(fbank_opts),
+      model_(std::move(model)),
+      sym_(std::move(sym)) {
+  InitDecoder();
+}
+
+void Recognizer::InitDecoder() {
+  if (!model_) {
+    NCNN_LOGE("Failed to create the model");
+    exit(-1);
+  }
+
+  if (sym_->NumSymbols() == 0) {
+    NCNN_LOGE("Failed to load tokens");
+    exit(-1);
+  }
+
+  if (!model_->GetLatencyMode(decoder_conf_.latency_mode)) {
+    NCNN_LOGE("Invalid latency mode: %d. The model has %d latency mode(s)\n",
+              decoder_conf_.latency_mode, model_->NumLatencyModes());
+    exit(-1);
+  }
+
+  endpoint_ = std::make_unique<Endpoint>(decoder_conf_.endpoint_config);
+
+  if (decoder_conf_.method == "modified_beam_search") {
     decoder_ = std::make_unique<ModifiedBeamSearchDecoder>(
-        decoder_conf, model_.get(), fbank_opts, sym_.get(), endpoint_.get());
-  } else if (decoder_conf.method == "greedy_search") {
+        decoder_conf_, model_.get(), fbank_opts_, sym_.get(), endpoint_.get());
+  } else if (decoder_conf_.method == "greedy_search") {
     decoder_ = std::make_unique<GreedySearchDecoder>(
-        decoder_conf, model_.get(), fbank_opts, sym_.get(), endpoint_.get());
+        decoder_conf_, model_.get(), fbank_opts_, sym_.get(), endpoint_.get());
   } else {
-    NCNN_LOGE("Unsupported decoding method: %s\n", decoder_conf.method.c_str());
+    NCNN_LOGE("Unsupported decoding method: %s\n",
+              decoder_conf_.method.c_str());
     exit(-1);
   }
+
+  UpdateMetrics();
+}
+
+std::unique_ptr<Recognizer> Recognizer::CreateStream() const {
+  return CreateStream(decoder_conf_);
+}
+
+std::unique_ptr<Recognizer> Recognizer::CreateStream(
+    const DecoderConfig &decoder_conf) const {
+  return std::make_unique<Recognizer>(decoder_conf, model_, sym_, fbank_opts_);
+}
+
+Recognizer::~Recognizer() {
+  if (counted_in_metrics_) {
+    auto &metrics = Metrics::Get();
+    metrics.streams_active.Add(-1);
+    metrics.queue_depth.Add(-queue_depth_);
+  }
 }
-#endif
 
 void Recognizer::AcceptWaveform(float sample_rate, const float *input_buffer,
                                 int32_t frames_per_buffer) {
+  if (Metrics::Enabled()) {
+    Metrics::Get().audio_us.Add(
+        static_cast<int64_t>(frames_per_buffer * 1e6 / sample_rate));
+  }
+
   decoder_->AcceptWaveform(sample_rate, input_buffer, frames_per_buffer);
+  UpdateMetrics();
+}
+
+void Recognizer::Decode() {
+  {
+    ScopedMetricsTimer timer(nullptr, &Metrics::Get().decode_us);
+    decoder_->Decode();
+  }
+  UpdateMetrics();
 }
 
-void Recognizer::Decode() { decoder_->Decode(); }
+void Recognizer::UpdateMetrics() {
+  if (!Metrics::Enabled()) return;
+
+  auto &metrics = Metrics::Get();
+  if (!counted_in_metrics_) {
+    metrics.streams_active.Add(1);
+    counted_in_metrics_ = true;
+  }
+
+  int64_t n = decoder_->NumPendingFrames();
+  metrics.queue_depth.Add(n - queue_depth_);
+  queue_depth_ = n;
+}
+
+bool Recognizer::IsReady() const {
+  return decoder_->NumPendingFrames() >= decoder_->Segment();
+}
 
 RecognitionResult Recognizer::GetResult() { return decoder_->GetResult(); }
 
+void Recognizer::GetResult(RecognitionResult *result) {
+  decoder_->GetResult(result);
+}
+
+Hypotheses Recognizer::GetBeam() const { return decoder_->GetBeam(); }
+
+RecognitionResult Recognizer::DrainResult() { return decoder_->DrainResult(); }
+
+bool Recognizer::PopSegment(RecognitionSegment *segment) {
+  return decoder_->PopSegment(segment);
+}
+
+bool Recognizer::SetLatencyMode(int32_t mode) {
+  return decoder_->SetLatencyMode(mode);
+}
+
+int32_t Recognizer::GetLatencyMode() const { return decoder_->LatencyMode(); }
+
 bool Recognizer::IsEndpoint() { return decoder_->IsEndpoint(); }
 
-void Recognizer::Reset() { return decoder_->Reset(); }
+void Recognizer::Reset() {
+  decoder_->Reset();
+  UpdateMetrics();
+}
 
-void Recognizer::InputFinished() { return decoder_->InputFinished(); }
+void Recognizer::InputFinished() {
+  decoder_->InputFinished();
+  UpdateMetrics();
+}
+
+std::string Recognizer::GetEncoderProfilingReport() const {
+  // Each latency mode has its own encoder
+  const Model *model = model_->GetLatencyMode(GetLatencyMode());
+  const LayerProfiler *profiler = model->GetEncoderProfiler();
+  return profiler ? profiler->Report() : "";
+}
+
+MemoryStats Recognizer::GetMemoryStats() const {
+  MemoryStats ans;
+  ans.model = model_->GetMemoryStats();
+  ans.stream = decoder_->GetMemoryStats();
+  return ans;
+}
+
+void DecodeMultipleStreams(Recognizer **recognizers, int32_t n,
+                           int32_t num_threads /*= 0*/) {
+  std::vector<Recognizer *> ready;
+  ready.reserve(n);
+  for (int32_t i = 0; i != n; ++i) {
+    if (recognizers[i]->IsReady()) {
+      ready.push_back(recognizers[i]);
+    }
+  }
+
+  ThreadPool::Get().ParallelFor(static_cast<int32_t>(ready.size()),
+                                num_threads,
+                                [&ready](int32_t i) { ready[i]->Decode(); });
+}
 
 }  // namespace sherpa_ncnn
@@ -32,15 +32,46 @@
 
 namespace sherpa_ncnn {
 
-// TODO(fangjun): Add timestamps
 struct RecognitionResult {
+  // Note: It starts with ContextSize() context tokens, which are blanks
+  // at the start of a stream or right after an endpoint
   std::vector<int32_t> tokens;
   std::string text;
 
+  // timestamps[i] is the index of the encoder output frame, counted from
+  // the start of the stream, at which the i-th non-blank token was decoded.
+  // Its size is tokens.size() - ContextSize().
+  // Multiply it by kSecondsPerOutputFrame to get seconds.
+  std::vector<int32_t> timestamps;
+
+  // The first num_stable_tokens non-blank tokens and the first
+  // stable_text_length bytes of text won't change in later results
+  // (until the result is reset). For greedy search, everything is stable.
+  int32_t num_stable_tokens = 0;
+  int32_t stable_text_length = 0;
+
   int32_t num_trailing_blanks = 0;
+};
+
+// Feature frame shift is 10 ms and the encoder subsamples by 4
+constexpr float kSecondsPerOutputFrame = 0.04;
 
-  // used only for modified_beam_search
-  Hypotheses hyps;
+// A segment of the stream between two endpoints.
+// See DecoderConfig::emit_segments.
+struct RecognitionSegment {
+  // 0 for the first segment of the stream, 1 for the second one, etc.
+  int32_t id = 0;
+
+  // Encoder output frames, counted from the start of the stream. The
+  // segment covers [start_frame, end_frame).
+  int32_t start_frame = 0;
+  int32_t end_frame = 0;
+
+  std::string text;
+
+  // Non-blank tokens and the output frame at which each one is decoded
+  std::vector<int32_t> tokens;
+  std::vector<int32_t> timestamps;
 };
 
 struct DecoderConfig {
@@ -48,10 +79,45 @@ struct DecoderConfig {
 
   int32_t num_active_paths = 4;  // for modified beam search
 
+  // Used only for modified beam search.
+  //
+  // If true, the number of active paths is chosen per frame from the
+  // entropy of the joiner output of the best path. A peaked distribution
+  // (entropy <= adaptive_beam_low_entropy) keeps only min_active_paths
+  // paths, a flat one (entropy >= adaptive_beam_high_entropy) keeps
+  // num_active_paths paths, and values in between are interpolated linearly.
+  bool adaptive_beam = false;
+  int32_t min_active_paths = 1;
+  float adaptive_beam_low_entropy = 0.5;   // in nats
+  float adaptive_beam_high_entropy = 2.0;  // in nats
+
   bool enable_endpoint = false;
 
+  // Used only when enable_endpoint is true.
+  //
+  // If true, endpoints are detected in Decode() after each encoder chunk.
+  // The finished segment is moved to a queue read by
+  // Recognizer::PopSegment() and the result is reset, so IsEndpoint()
+  // and GetResult() only see the current segment. Segments without any
+  // token are dropped.
+  bool emit_segments = false;
+
+  // Used only when emit_segments is true.
+  //
+  // If true, the encoder state and the decoder context are reset at each
+  // endpoint so that segments are decoded independently of each other.
+  // Otherwise, they are kept, which is usually more accurate at segment
+  // boundaries. Feature frames are always kept since frames after the
+  // endpoint may not have been decoded yet.
+  bool reset_state_on_endpoint = false;
+
   EndpointConfig endpoint_config;
 
+  // Index of the encoder to use. See ModelConfig::extra_encoder_params.
+  // Encoders with smaller chunks have lower latency and those with larger
+  // chunks have higher throughput.
+  int32_t latency_mode = 0;
+
   DecoderConfig() = default;
 
   DecoderConfig(const std::string &method, int32_t num_active_paths,
@@ -64,6 +130,25 @@ struct DecoderConfig {
   std::string ToString() const;
 };
 
+// Memory used by a single stream, i.e., by a Recognizer excluding the
+// model it uses
+struct StreamMemoryStats {
+  int64_t feature_bytes = 0;        // feature frames kept in memory
+  int64_t encoder_state_bytes = 0;  // encoder states and outputs
+  int64_t hyp_bytes = 0;            // hypotheses and the decoded result
+
+  int64_t TotalBytes() const {
+    return feature_bytes + encoder_state_bytes + hyp_bytes;
+  }
+};
+
+struct MemoryStats {
+  ModelMemoryStats model;
+  StreamMemoryStats stream;
+
+  std::string ToString() const;
+};
+
 class Decoder {
  public:
   virtual ~Decoder() = default;
@@ -73,7 +158,26 @@ class Decoder {
 
   virtual void Decode() = 0;
 
-  virtual RecognitionResult GetResult() = 0;
+  // Fill result in place. Its strings and vectors are assigned, so the
+  // memory they already hold is reused.
+  virtual void GetResult(RecognitionResult *result) = 0;
+
+  RecognitionResult GetResult() {
+    RecognitionResult ans;
+    GetResult(&ans);
+    return ans;
+  }
+
+  // Return a copy of the active paths
+  virtual Hypotheses GetBeam() const = 0;
+
+  // Return the stable part of the result and remove it from the decoder.
+  // See Recognizer::DrainResult().
+  virtual RecognitionResult DrainResult() = 0;
+
+  // Pop the oldest segment emitted since the last call. Return false if
+  // there is none. See DecoderConfig::emit_segments.
+  virtual bool PopSegment(RecognitionSegment *segment) = 0;
 
   virtual void ResetResult() = 0;
 
@@ -82,6 +186,19 @@ class Decoder {
   virtual bool IsEndpoint() = 0;
 
   virtual void Reset() = 0;
+
+  virtual StreamMemoryStats GetMemoryStats() const = 0;
+
+  // Number of feature frames not yet processed by the encoder
+  virtual int32_t NumPendingFrames() const = 0;
+
+  // Number of feature frames the encoder of the current latency mode takes
+  virtual int32_t Segment() const = 0;
+
+  // See Recognizer::SetLatencyMode()
+  virtual bool SetLatencyMode(int32_t mode) = 0;
+
+  virtual int32_t LatencyMode() const = 0;
 };
 
 class Recognizer {
@@ -97,27 +214,138 @@ class Recognizer {
              const knf::FbankOptions &fbank_opts);
 #endif
 
-  ~Recognizer() = default;
+  /** Construct a recognizer that shares the given model and symbol table
+   * with other recognizers.
+   *
+   * Recognizers sharing a model can be used from different threads at the
+   * same time, but a single recognizer must not be used from multiple
+   * threads concurrently.
+   */
+  Recognizer(const DecoderConfig &decoder_conf, std::shared_ptr<Model> model,
+             std::shared_ptr<const SymbolTable> sym,
+             const knf::FbankOptions &fbank_opts);
+
+  ~Recognizer();
+
+  /** Create a new stream, i.e., a recognizer with its own feature extractor
+   * and decoding state that shares the model and symbol table of this
+   * recognizer. It is much cheaper than loading the model again.
+   */
+  std::unique_ptr<Recognizer> CreateStream() const;
+
+  // Like CreateStream() above but uses a different decoder config
+  std::unique_ptr<Recognizer> CreateStream(
+      const DecoderConfig &decoder_conf) const;
 
   void AcceptWaveform(float sample_rate, const float *input_buffer,
                       int32_t frames_per_buffer);
 
   void Decode();
 
+  // Return true if there are enough feature frames for Decode() to
+  // run the encoder at least once
+  bool IsReady() const;
+
   RecognitionResult GetResult();
 
+  // Like GetResult() but fill a result owned by the caller, reusing the
+  // memory it holds, so that polling the result does not allocate once its
+  // buffers are large enough
+  void GetResult(RecognitionResult *result);
+
+  /** Return the tokens and text that have become stable since the previous
+   * call and free them inside the recognizer, so that the kept result stays
+   * small no matter how long the stream is. Unlike GetResult(), it does not
+   * copy what has already been returned.
+   *
+   * On an endpoint, the whole remaining result is returned and the result
+   * is reset as in GetResult().
+   *
+   * The timestamps of the returned result are still counted from the start
+   * of the stream.
+   */
+  RecognitionResult DrainResult();
+
+  // Pop the oldest segment finished by an endpoint and return true.
+  // Return false if there is none. Segments are emitted only if
+  // DecoderConfig::emit_segments is true. Don't mix it with DrainResult().
+  bool PopSegment(RecognitionSegment *segment);
+
+  // Return a copy of the active paths of the search, e.g., to get an n-best
+  // list. It contains a single path for greedy_search. Unlike GetResult(),
+  // it copies the tokens and timestamps of every path, so call it only
+  // when needed.
+  Hypotheses GetBeam() const;
+
+  /** Switch to the encoder of the given latency mode.
+   *
+   * Encoders with different chunk sizes have incompatible states, so it
+   * takes effect right away only if nothing has been decoded since the
+   * stream was created or reset. Otherwise, it takes effect at the next
+   * endpoint, i.e., when GetResult() resets the result, or in Reset(). The
+   * encoder state is reset when switching but pending audio is kept.
+   *
+   * @return Return false if mode is not a valid latency mode of the model.
+   */
+  bool SetLatencyMode(int32_t mode);
+
+  // Return the latency mode in use
+  int32_t GetLatencyMode() const;
+
   void InputFinished();
 
   bool IsEndpoint();
 
   void Reset();
 
+  // Return the time and output size of each layer of the encoder of the
+  // current latency mode, accumulated over all recognizers using it.
+  // It is empty unless ModelConfig::enable_encoder_profiling is true.
+  std::string GetEncoderProfilingReport() const;
+
+  // Return the memory used by the model and by this recognizer.
+  // Statistics of the model cover all of its latency modes and are shared
+  // by all recognizers using it.
+  MemoryStats GetMemoryStats() const;
+
  private:
-  std::unique_ptr<Model> model_;
-  std::unique_ptr<SymbolTable> sym_;
+  void InitDecoder();
+
+  // If metrics are enabled, count this stream in Metrics::streams_active
+  // and update Metrics::queue_depth with the number of pending frames.
+  // Nothing is updated while metrics are disabled. A stream created before
+  // metrics are enabled is counted at its next update.
+  void UpdateMetrics();
+
+  DecoderConfig decoder_conf_;
+  knf::FbankOptions fbank_opts_;
+
+  std::shared_ptr<Model> model_;
+  std::shared_ptr<const SymbolTable> sym_;
   std::unique_ptr<Endpoint> endpoint_;
   std::unique_ptr<Decoder> decoder_;
+
+  // What this stream has added to Metrics::streams_active and
+  // Metrics::queue_depth. They are removed in the destructor.
+  bool counted_in_metrics_ = false;
+  int64_t queue_depth_ = 0;
 };
 
+/** Call Decode() on the ready ones of the given recognizers in parallel.
+ *
+ * ncnn models have a fixed batch size of 1, so streams are not stacked into
+ * one batch. Instead, each ready stream is decoded by one of num_threads
+ * threads, all of which share the model. The threads are taken from
+ * ThreadPool::Get(), so they are not created again for each call. For the
+ * best throughput, create the model with a single thread per network.
+ *
+ * @param recognizers Recognizers to decode. Each one must appear only once.
+ * @param n Number of entries in recognizers.
+ * @param num_threads Number of threads to use, including the calling thread.
+ *                    If it is not positive, the number of CPU cores is used.
+ */
+void DecodeMultipleStreams(Recognizer **recognizers, int32_t n,
+                           int32_t num_threads = 0);
+
 }  // namespace sherpa_ncnn
 #endif  // SHERPA_NCNN_CSRC_RECOGNIZER_H_
@@ -18,6 +18,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <algorithm>
 #include <chrono>  // NOLINT
@@ -44,6 +45,14 @@ Usage:
 Please refer to
 https://k2-fsa.github.io/sherpa/ncnn/pretrained_models/index.html
 for a list of pre-trained models to download.
+
+Set the environment variable SHERPA_NCNN_PROFILE_ENCODER=1 to print
+the time spent in each encoder layer.
+
+Set the environment variable SHERPA_NCNN_NATIVE_JOINER=1 to compute the
+output layer of the joiner with a native kernel instead of ncnn. With it,
+set SHERPA_NCNN_JOINER_SHORTLIST=N to compute only the N most likely tokens
+of each frame exactly.
 )usage";
     std::cerr << usage << "\n";
 
@@ -65,6 +74,15 @@ for a list of pre-trained models to download.
   model_conf.decoder_opt.num_threads = num_threads;
   model_conf.joiner_opt.num_threads = num_threads;
 
+  const char *profile = getenv("SHERPA_NCNN_PROFILE_ENCODER");
+  model_conf.enable_encoder_profiling = profile && atoi(profile) != 0;
+
+  const char *native_joiner = getenv("SHERPA_NCNN_NATIVE_JOINER");
+  model_conf.use_native_joiner = native_joiner && atoi(native_joiner) != 0;
+
+  const char *shortlist = getenv("SHERPA_NCNN_JOINER_SHORTLIST");
+  model_conf.joiner_shortlist_size = shortlist ? atoi(shortlist) : 0;
+
   float expected_sampling_rate = 16000;
   sherpa_ncnn::DecoderConfig decoder_conf;
   if (argc == 11) {
@@ -126,5 +144,9 @@ for a list of pre-trained models to download.
   fprintf(stderr, "Real time factor (RTF): %.3f / %.3f = %.3f\n",
           elapsed_seconds, duration, rtf);
 
+  if (model_conf.enable_encoder_profiling) {
+    fprintf(stderr, "%s\n", recognizer.GetEncoderProfilingReport().c_str());
+  }
+
   return 0;
 }
@@ -18,10 +18,13 @@
 
 #include "sherpa-ncnn/csrc/symbol-table.h"
 
-#include <cassert>
+#include <string.h>
+
+#include <algorithm>
 #include <fstream>
 #include <sstream>
-#include <strstream>
+#include <stdexcept>
+#include <utility>
 
 #if __ANDROID_API__ >= 9
 #include "android/asset_manager.h"
@@ -32,71 +35,266 @@
 namespace sherpa_ncnn {
 
 SymbolTable::SymbolTable(const std::string &filename) {
-  std::ifstream is(filename);
-  Init(is);
+  std::ifstream is(filename, std::ios::binary);
+  std::string buf((std::istreambuf_iterator<char>(is)),
+                  std::istreambuf_iterator<char>());
+  Init(buf.data(), buf.size());
 }
 
 #if __ANDROID_API__ >= 9
 SymbolTable::SymbolTable(AAssetManager *mgr, const std::string &filename) {
   AAsset *asset = AAssetManager_open(mgr, filename.c_str(), AASSET_MODE_BUFFER);
   if (!asset) {
-    __android_log_print(ANDROID_LOG_FATAL, "sherpa-ncnn",
+    // Leave the table empty. Callers check NumSymbols().
+    __android_log_print(ANDROID_LOG_ERROR, "sherpa-ncnn",
                         "SymbolTable: Load %s failed", filename.c_str());
-    exit(-1);
+    return;
   }
 
   auto p = reinterpret_cast<const char *>(AAsset_getBuffer(asset));
   size_t asset_length = AAsset_getLength(asset);
-  std::istrstream is(p, asset_length);
-  Init(is);
+  Init(p, asset_length);
   AAsset_close(asset);
 }
 #endif
 
-void SymbolTable::Init(std::istream &is) {
-  std::string sym;
-  int32_t id;
-  while (is >> sym >> id) {
-    if (sym.size() >= 3) {
-      // For BPE-based models, we replace ▁ with a space
-      // Unicode 9601, hex 0x2581, utf8 0xe29681
-      const uint8_t *p = reinterpret_cast<const uint8_t *>(sym.c_str());
-      if (p[0] == 0xe2 && p[1] == 0x96 && p[2] == 0x81) {
-        sym = sym.replace(0, 3, " ");
-      }
+static bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+// FNV-1a
+static uint32_t Hash(const char *p, int32_t n) {
+  uint32_t h = 2166136261u;
+  for (int32_t i = 0; i != n; ++i) {
+    h ^= static_cast<uint8_t>(p[i]);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+void SymbolTable::Init(const char *p, size_t n) {
+  struct Entry {
+    int32_t id;
+    uint32_t offset;  // into tmp
+    int32_t len;
+  };
+
+  // Symbols in the order of the file
+  std::string tmp;
+  tmp.reserve(n);
+  std::vector<Entry> entries;
+
+  const char *end = p + n;
+  int32_t max_id = -1;
+  while (true) {
+    // Each entry contains two fields separated by whitespace: sym ID
+    while (p != end && IsSpace(*p)) ++p;
+    const char *sym = p;
+    while (p != end && !IsSpace(*p)) ++p;
+    int32_t len = static_cast<int32_t>(p - sym);
+
+    while (p != end && IsSpace(*p)) ++p;
+    if (len == 0 || p == end) break;
+
+    bool negative = *p == '-';
+    if (negative) ++p;
+    if (p == end || *p < '0' || *p > '9') break;
+
+    int32_t id = 0;
+    while (p != end && *p >= '0' && *p <= '9') {
+      id = id * 10 + (*p - '0');
+      ++p;
+    }
+    // IDs are never negative in the models we support
+    if (negative) continue;
+
+    Entry e;
+    e.id = id;
+    e.offset = static_cast<uint32_t>(tmp.size());
+
+    // For BPE-based models, we replace ▁ with a space
+    // Unicode 9601, hex 0x2581, utf8 0xe29681
+    const uint8_t *u = reinterpret_cast<const uint8_t *>(sym);
+    if (len >= 3 && u[0] == 0xe2 && u[1] == 0x96 && u[2] == 0x81) {
+      tmp.push_back(' ');
+      tmp.append(sym + 3, len - 3);
+      e.len = len - 2;
+    } else {
+      tmp.append(sym, len);
+      e.len = len;
+    }
+
+    entries.push_back(e);
+    max_id = std::max(max_id, id);
+  }
+
+  // Lay out the symbols in the order of their IDs. If an ID appears more
+  // than once, the first one is kept. Symbols are never empty, so a
+  // non-zero length means the ID has been seen.
+  offsets_.assign(max_id + 2, 0);
+  size_t k = 0;
+  for (const auto &e : entries) {
+    if (offsets_[e.id + 1] != 0) continue;
+
+    offsets_[e.id + 1] = e.len;
+    entries[k++] = e;
+  }
+  entries.resize(k);
+
+  for (int32_t i = 1; i != offsets_.size(); ++i) {
+    offsets_[i] += offsets_[i - 1];
+  }
+
+  pool_.resize(offsets_.back());
+  for (const auto &e : entries) {
+    std::copy(tmp.data() + e.offset, tmp.data() + e.offset + e.len,
+              &pool_[offsets_[e.id]]);
+  }
+
+  num_symbols_ = static_cast<int32_t>(entries.size());
+
+  BuildHashTable();
+}
+
+void SymbolTable::BuildHashTable() {
+  // Keep the load factor at most 0.5 so that lookups need few probes
+  size_t size = 16;
+  while (size < 2 * static_cast<size_t>(num_symbols_)) {
+    size *= 2;
+  }
+
+  hash_table_.assign(size, -1);
+  uint32_t mask = static_cast<uint32_t>(size - 1);
+
+  int32_t num_ids = static_cast<int32_t>(offsets_.size()) - 1;
+  for (int32_t id = 0; id < num_ids; ++id) {
+    int32_t len = 0;
+    const char *sym = GetSymbol(id, &len);
+    if (!sym) continue;
+
+    // A symbol that appears more than once maps to its smallest ID
+    if (Find(sym, len) != -1) continue;
+
+    uint32_t i = Hash(sym, len) & mask;
+    while (hash_table_[i] != -1) {
+      i = (i + 1) & mask;
+    }
+    hash_table_[i] = id;
+  }
+}
+
+int32_t SymbolTable::Find(const char *sym, int32_t len) const {
+  if (hash_table_.empty()) return -1;
+
+  uint32_t mask = static_cast<uint32_t>(hash_table_.size() - 1);
+  uint32_t i = Hash(sym, len) & mask;
+
+  while (hash_table_[i] != -1) {
+    int32_t id = hash_table_[i];
+    if (static_cast<int32_t>(offsets_[id + 1] - offsets_[id]) == len &&
+        memcmp(pool_.data() + offsets_[id], sym, len) == 0) {
+      return id;
     }
+    i = (i + 1) & mask;
+  }
 
-    assert(!sym.empty());
-    assert(sym2id_.count(sym) == 0);
-    assert(id2sym_.count(id) == 0);
+  return -1;
+}
 
-    sym2id_.insert({sym, id});
-    id2sym_.insert({id, sym});
+const char *SymbolTable::GetSymbol(int32_t id, int32_t *len) const {
+  if (id < 0 || id + 1 >= static_cast<int32_t>(offsets_.size())) {
+    return nullptr;
   }
-  assert(is.eof());
+
+  uint32_t begin = offsets_[id];
+  uint32_t end = offsets_[id + 1];
+  if (begin == end) return nullptr;
+
+  *len = static_cast<int32_t>(end - begin);
+  return pool_.data() + begin;
 }
 
 std::string SymbolTable::ToString() const {
   std::ostringstream os;
   char sep = ' ';
-  for (const auto &p : sym2id_) {
-    os << p.first << sep << p.second << "\n";
+  int32_t num_ids = static_cast<int32_t>(offsets_.size()) - 1;
+  for (int32_t id = 0; id < num_ids; ++id) {
+    int32_t len = 0;
+    const char *sym = GetSymbol(id, &len);
+    if (!sym) continue;
+
+    os.write(sym, len);
+    os << sep << id << "\n";
   }
   return os.str();
 }
 
-const std::string &SymbolTable::operator[](int32_t id) const {
-  return id2sym_.at(id);
+std::string SymbolTable::operator[](int32_t id) const {
+  int32_t len = 0;
+  const char *sym = GetSymbol(id, &len);
+  if (!sym) {
+    throw std::out_of_range("SymbolTable: Unknown ID " + std::to_string(id));
+  }
+
+  return std::string(sym, len);
 }
 
 int32_t SymbolTable::operator[](const std::string &sym) const {
-  return sym2id_.at(sym);
+  int32_t id = Find(sym.data(), static_cast<int32_t>(sym.size()));
+  if (id == -1) {
+    throw std::out_of_range("SymbolTable: Unknown symbol " + sym);
+  }
+
+  return id;
 }
 
-bool SymbolTable::contains(int32_t id) const { return id2sym_.count(id) != 0; }
+bool SymbolTable::contains(int32_t id) const {
+  int32_t len = 0;
+  return GetSymbol(id, &len) != nullptr;
+}
 
 bool SymbolTable::contains(const std::string &sym) const {
-  return sym2id_.count(sym) != 0;
+  return Find(sym.data(), static_cast<int32_t>(sym.size())) != -1;
+}
+
+void SymbolTable::Detokenize(const int32_t *ids, int32_t n,
+                             std::string *out) const {
+  for (int32_t i = 0; i != n; ++i) {
+    int32_t len = 0;
+    const char *sym = GetSymbol(ids[i], &len);
+    if (sym) out->append(sym, len);
+  }
+}
+
+int32_t SymbolTable::Detokenize(const int32_t *ids, int32_t n, char *buf,
+                                int32_t buf_size) const {
+  int32_t num_bytes = 0;
+  int32_t num_written = 0;
+  for (int32_t i = 0; i != n; ++i) {
+    int32_t len = 0;
+    const char *sym = GetSymbol(ids[i], &len);
+    if (!sym) continue;
+
+    // Symbols are never split so that the output is valid UTF-8
+    if (num_written == num_bytes && num_bytes + len < buf_size) {
+      std::copy(sym, sym + len, buf + num_bytes);
+      num_written += len;
+    }
+    num_bytes += len;
+  }
+
+  if (buf_size > 0) {
+    buf[num_written] = 0;
+  }
+
+  return num_bytes;
+}
+
+int64_t SymbolTable::NumBytes() const {
+  return sizeof(*this) + pool_.capacity() +
+         offsets_.capacity() * sizeof(uint32_t) +
+         hash_table_.capacity() * sizeof(int32_t);
 }
 
 std::ostream &operator<<(std::ostream &os, const SymbolTable &symbol_table) {
@@ -20,7 +20,7 @@
 #define SHERPA_NCNN_CSRC_SYMBOL_TABLE_H_
 
 #include <string>
-#include <unordered_map>
+#include <vector>
 
 #if __ANDROID_API__ >= 9
 #include "android/asset_manager.h"
@@ -30,6 +30,9 @@
 namespace sherpa_ncnn {
 
 /// It manages mapping between symbols and integer IDs.
+///
+/// All symbols are stored in a single buffer indexed by ID. Symbols are
+/// looked up by an open-addressing hash table that stores only IDs.
 class SymbolTable {
  public:
   SymbolTable() = default;
@@ -39,6 +42,13 @@ class SymbolTable {
   ///    sym ID
   ///
   /// Fields are separated by space(s).
+  ///
+  /// IDs need not be contiguous. If an ID appears more than once, the
+  /// first line is used. If a symbol appears more than once, it maps
+  /// to its smallest ID.
+  ///
+  /// If the file cannot be read, the table is empty, i.e., NumSymbols()
+  /// returns 0.
   explicit SymbolTable(const std::string &filename);
 
 #if __ANDROID_API__ >= 9
@@ -49,7 +59,9 @@ class SymbolTable {
   std::string ToString() const;
 
   /// Return the symbol corresponding to the given ID.
-  const std::string &operator[](int32_t id) const;
+  /// Prefer Detokenize() in performance critical code since it does not
+  /// allocate memory.
+  std::string operator[](int32_t id) const;
   /// Return the ID corresponding to the given symbol.
   int32_t operator[](const std::string &sym) const;
 
@@ -59,12 +71,51 @@ class SymbolTable {
   /// Return true if there is a given symbol in the symbol table.
   bool contains(const std::string &sym) const;
 
+  /// Number of symbols in this table
+  int32_t NumSymbols() const { return num_symbols_; }
+
+  /// Return a pointer to the symbol with the given ID. It is not
+  /// null-terminated. Its length is returned in len.
+  /// Return nullptr if there is no such ID.
+  const char *GetSymbol(int32_t id, int32_t *len) const;
+
+  /// Append the symbols of the given IDs to out. Unknown IDs are ignored.
+  void Detokenize(const int32_t *ids, int32_t n, std::string *out) const;
+
+  /// Write the symbols of the given IDs to buf. At most buf_size - 1 bytes
+  /// are written and buf is always null-terminated if buf_size > 0.
+  /// A symbol is either written completely or not at all.
+  /// Unknown IDs are ignored.
+  ///
+  /// @return Return the number of bytes needed, excluding the terminating
+  ///         null. If it is not less than buf_size, the output is truncated.
+  int32_t Detokenize(const int32_t *ids, int32_t n, char *buf,
+                     int32_t buf_size) const;
+
+  /// Number of bytes used by this object
+  int64_t NumBytes() const;
+
  private:
-  void Init(std::istream &is);
+  void Init(const char *p, size_t n);
+
+  void BuildHashTable();
+
+  // Return the ID of the given symbol or -1 if it does not exist
+  int32_t Find(const char *sym, int32_t len) const;
 
  private:
-  std::unordered_map<std::string, int32_t> sym2id_;
-  std::unordered_map<int32_t, std::string> id2sym_;
+  // Symbols of all IDs, concatenated
+  std::string pool_;
+
+  // The symbol of ID i is pool_[offsets_[i], offsets_[i+1]).
+  // An empty range means there is no symbol for that ID.
+  std::vector<uint32_t> offsets_;
+
+  // Open addressing hash table from symbols to IDs. Its size is a power
+  // of 2 and empty slots are -1.
+  std::vector<int32_t> hash_table_;
+
+  int32_t num_symbols_ = 0;
 };
 
 std::ostream &operator<<(std::ostream &os, const SymbolTable &symbol_table);
@@ -0,0 +1,210 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "sherpa-ncnn/csrc/symbol-table.h"
+
+#define CHECK(x)                                                       \
+  do {                                                                 \
+    if (!(x)) {                                                        \
+      fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, \
+              #x);                                                     \
+      exit(-1);                                                        \
+    }                                                                  \
+  } while (0)
+
+static const char *kFilename = "test-symbol-table-tokens.txt";
+
+static sherpa_ncnn::SymbolTable Load(const std::string &content) {
+  {
+    std::ofstream os(kFilename, std::ios::binary);
+    os << content;
+  }
+
+  sherpa_ncnn::SymbolTable ans(kFilename);
+  remove(kFilename);
+  return ans;
+}
+
+static std::string Detokenize(const sherpa_ncnn::SymbolTable &sym,
+                              const std::vector<int32_t> &ids,
+                              int32_t buf_size, int32_t *num_bytes) {
+  std::vector<char> buf(buf_size + 1, 'x');
+  *num_bytes = sym.Detokenize(ids.data(), static_cast<int32_t>(ids.size()),
+                              buf.data(), buf_size);
+  // Nothing is written after the buffer
+  CHECK(buf[buf_size] == 'x');
+
+  return buf_size > 0 ? std::string(buf.data()) : std::string();
+}
+
+static void TestRoundTrip() {
+  auto sym = Load(
+      "<blk> 0\n"
+      "\xe2\x96\x81HE 1\n"
+      "LLO 2\n"
+      "\xe2\x96\x81WORLD 3\n"
+      "\xe2\x96\x81 4\n"
+      "\xe4\xbd\xa0\xe5\xa5\xbd 5\n");
+
+  CHECK(sym.NumSymbols() == 6);
+
+  // ▁ at the beginning of a symbol is replaced with a space
+  CHECK(sym[1] == " HE");
+  CHECK(sym[3] == " WORLD");
+  CHECK(sym[4] == " ");
+  CHECK(sym[2] == "LLO");
+  CHECK(!sym.contains("\xe2\x96\x81HE"));
+
+  for (int32_t id = 0; id != 6; ++id) {
+    CHECK(sym.contains(id));
+    CHECK(sym.contains(sym[id]));
+    CHECK(sym[sym[id]] == id);
+  }
+  CHECK(!sym.contains(6));
+  CHECK(!sym.contains(-1));
+  CHECK(!sym.contains("HELLO"));
+
+  std::vector<int32_t> ids = {1, 2, 3};
+  std::string text;
+  sym.Detokenize(ids.data(), static_cast<int32_t>(ids.size()), &text);
+  CHECK(text == " HELLO WORLD");
+
+  // It appends to the output
+  sym.Detokenize(ids.data(), 1, &text);
+  CHECK(text == " HELLO WORLD HE");
+}
+
+static void TestSparseIds() {
+  // Windows line endings and no newline at the end
+  auto sym = Load("a 0\r\nb 5\r\nc 100");
+
+  CHECK(sym.NumSymbols() == 3);
+  CHECK(sym[5] == "b");
+  CHECK(sym["c"] == 100);
+  CHECK(!sym.contains(1));
+  CHECK(!sym.contains(99));
+  CHECK(!sym.contains(101));
+
+  int32_t len = 0;
+  CHECK(sym.GetSymbol(50, &len) == nullptr);
+  CHECK(sym.GetSymbol(100, &len) != nullptr && len == 1);
+
+  // Unknown IDs are ignored
+  std::vector<int32_t> ids = {0, 50, 5, 1000, -1, 100};
+  std::string text;
+  sym.Detokenize(ids.data(), static_cast<int32_t>(ids.size()), &text);
+  CHECK(text == "abc");
+
+  int32_t num_bytes = 0;
+  CHECK(Detokenize(sym, ids, 16, &num_bytes) == "abc");
+  CHECK(num_bytes == 3);
+
+  // The output of ToString() can be loaded again
+  CHECK(sym.ToString() == "a 0\nb 5\nc 100\n");
+  CHECK(Load(sym.ToString()).ToString() == sym.ToString());
+}
+
+static void TestDuplicates() {
+  auto sym = Load(
+      "a 1\n"
+      "b 1\n"
+      "c 2\n"
+      "a 3\n");
+
+  // The first line of an ID is kept
+  CHECK(sym.NumSymbols() == 3);
+  CHECK(sym[1] == "a");
+  CHECK(!sym.contains("b"));
+
+  // A symbol maps to its smallest ID
+  CHECK(sym[3] == "a");
+  CHECK(sym["a"] == 1);
+  CHECK(sym["c"] == 2);
+}
+
+static void TestTruncation() {
+  auto sym = Load(
+      "\xe2\x96\x81HE 1\n"
+      "LLO 2\n"
+      "\xe2\x96\x81WORLD 3\n"
+      "\xe4\xbd\xa0\xe5\xa5\xbd 4\n");
+
+  std::vector<int32_t> ids = {1, 2, 3};
+  int32_t num_bytes = 0;
+
+  CHECK(Detokenize(sym, ids, 13, &num_bytes) == " HELLO WORLD");
+  CHECK(num_bytes == 12);
+
+  // There is no room for the terminating null, so the last symbol is
+  // dropped
+  CHECK(Detokenize(sym, ids, 12, &num_bytes) == " HELLO");
+  CHECK(num_bytes == 12);
+
+  CHECK(Detokenize(sym, ids, 7, &num_bytes) == " HELLO");
+  CHECK(num_bytes == 12);
+
+  CHECK(Detokenize(sym, ids, 6, &num_bytes) == " HE");
+  CHECK(num_bytes == 12);
+
+  CHECK(Detokenize(sym, ids, 1, &num_bytes).empty());
+  CHECK(num_bytes == 12);
+
+  // Only the size is returned
+  CHECK(sym.Detokenize(ids.data(), 3, nullptr, 0) == 12);
+
+  // Symbols after a truncated one are not written even if they fit, so
+  // the output is always a prefix of the full text
+  ids = {3, 1};
+  CHECK(Detokenize(sym, ids, 5, &num_bytes).empty());
+  CHECK(num_bytes == 9);
+
+  // A multi-byte UTF-8 symbol is never split
+  ids = {4};
+  CHECK(Detokenize(sym, ids, 6, &num_bytes).empty());
+  CHECK(num_bytes == 6);
+  CHECK(Detokenize(sym, ids, 7, &num_bytes) == "\xe4\xbd\xa0\xe5\xa5\xbd");
+}
+
+static void TestEmpty() {
+  // Model loading relies on an unreadable file giving an empty table
+  sherpa_ncnn::SymbolTable sym("/non-existent/tokens.txt");
+  CHECK(sym.NumSymbols() == 0);
+  CHECK(!sym.contains(0));
+  CHECK(!sym.contains("a"));
+
+  CHECK(Load("").NumSymbols() == 0);
+}
+
+int32_t main() {
+  TestRoundTrip();
+  TestSparseIds();
+  TestDuplicates();
+  TestTruncation();
+  TestEmpty();
+
+  fprintf(stderr, "Passed!\n");
+
+  return 0;
+}
@@ -0,0 +1,134 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sherpa-ncnn/csrc/thread-pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace sherpa_ncnn {
+
+namespace {
+
+// State of a ParallelFor() call shared by the caller and the helper tasks.
+// Helpers may start after the caller has returned, e.g., if the pool is
+// busy with tasks of other callers. Such helpers find no work left and
+// only touch this struct, which they keep alive.
+struct ParallelForJob {
+  ParallelForJob(int32_t n, const std::function<void(int32_t)> &fn)
+      : n(n), fn(fn) {}
+
+  // Run calls until there are none left
+  void Work() {
+    int32_t k = 0;
+    for (int32_t i = next++; i < n; i = next++) {
+      fn(i);
+      ++k;
+    }
+
+    if (k == 0) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    num_done += k;
+    if (num_done == n) cond.notify_all();
+  }
+
+  int32_t n;
+  const std::function<void(int32_t)> &fn;
+  std::atomic<int32_t> next{0};
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  int32_t num_done = 0;
+};
+
+}  // namespace
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+
+  for (auto &t : threads_) {
+    t.join();
+  }
+}
+
+ThreadPool &ThreadPool::Get() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::EnsureThreads(int32_t n) {
+  // mutex_ is held by the caller
+  while (static_cast<int32_t>(threads_.size()) < n) {
+    threads_.emplace_back([this]() { Run(); });
+  }
+}
+
+void ThreadPool::Run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty()) return;
+
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    task();
+  }
+}
+
+void ThreadPool::ParallelFor(int32_t n, int32_t num_threads,
+                             const std::function<void(int32_t)> &fn) {
+  if (n <= 0) return;
+
+  if (num_threads <= 0) {
+    num_threads = static_cast<int32_t>(std::thread::hardware_concurrency());
+  }
+  num_threads = std::max(1, std::min(num_threads, n));
+
+  if (num_threads == 1) {
+    for (int32_t i = 0; i != n; ++i) fn(i);
+    return;
+  }
+
+  auto job = std::make_shared<ParallelForJob>(n, fn);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EnsureThreads(num_threads - 1);
+    for (int32_t i = 1; i < num_threads; ++i) {
+      tasks_.emplace_back([job]() { job->Work(); });
+    }
+  }
+  cond_.notify_all();
+
+  job->Work();
+
+  std::unique_lock<std::mutex> lock(job->mutex);
+  job->cond.wait(lock, [&job]() { return job->num_done == job->n; });
+}
+
+}  // namespace sherpa_ncnn
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHERPA_NCNN_CSRC_THREAD_POOL_H_
+#define SHERPA_NCNN_CSRC_THREAD_POOL_H_
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace sherpa_ncnn {
+
+/** A pool of threads that are created once and reused, so that running
+ * small tasks in parallel does not pay for creating threads each time.
+ *
+ * Threads are added on demand and never removed. Tasks from different
+ * callers share the pool.
+ */
+class ThreadPool {
+ public:
+  ThreadPool() = default;
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool();
+
+  // Return the pool shared by all recognizers in the current process
+  static ThreadPool &Get();
+
+  /** Call fn(i) for i in [0, n) using num_threads threads, including the
+   * calling thread. It returns after all calls have finished.
+   *
+   * @param n Number of calls
+   * @param num_threads If it is not positive, the number of CPU cores is
+   *                    used. It is capped by n.
+   * @param fn The function to call. It must not call ParallelFor() of
+   *           the same pool.
+   */
+  void ParallelFor(int32_t n, int32_t num_threads,
+                   const std::function<void(int32_t)> &fn);
+
+ private:
+  // Make sure there are at least n threads in the pool
+  void EnsureThreads(int32_t n);
+
+  void Run();
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::thread> threads_;
+  bool stop_ = false;
+};
+
+}  // namespace sherpa_ncnn
+
+#endif  // SHERPA_NCNN_CSRC_THREAD_POOL_H_
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sherpa-ncnn/csrc/tracking-allocator.h"
+
+#include <stdint.h>
+
+namespace sherpa_ncnn {
+
+// Size of the header in front of each allocation. It is a multiple of
+// the alignment used by ncnn so the returned pointers keep the alignment
+// of the pool allocator.
+static constexpr size_t kHeaderSize = 64;
+
+TrackingAllocator::TrackingAllocator(float size_compare_ratio) {
+  pool_.set_size_compare_ratio(size_compare_ratio);
+}
+
+void *TrackingAllocator::fastMalloc(size_t size) {
+  auto p = static_cast<unsigned char *>(pool_.fastMalloc(size + kHeaderSize));
+  if (!p) return nullptr;
+
+  *reinterpret_cast<size_t *>(p) = size;
+
+  int64_t bytes = static_cast<int64_t>(size);
+  int64_t current =
+      current_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+  int64_t peak = peak_bytes_.load(std::memory_order_relaxed);
+  while (current > peak && !peak_bytes_.compare_exchange_weak(
+                               peak, current, std::memory_order_relaxed)) {
+  }
+
+  return p + kHeaderSize;
+}
+
+void TrackingAllocator::fastFree(void *ptr) {
+  if (!ptr) return;
+
+  auto p = static_cast<unsigned char *>(ptr) - kHeaderSize;
+  size_t size = *reinterpret_cast<size_t *>(p);
+
+  current_bytes_.fetch_sub(static_cast<int64_t>(size),
+                           std::memory_order_relaxed);
+  pool_.fastFree(p);
+}
+
+}  // namespace sherpa_ncnn
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHERPA_NCNN_CSRC_TRACKING_ALLOCATOR_H_
+#define SHERPA_NCNN_CSRC_TRACKING_ALLOCATOR_H_
+
+#include <atomic>
+
+#include "allocator.h"  // NOLINT
+
+namespace sherpa_ncnn {
+
+/** A thread-safe pool allocator that keeps track of the number of bytes
+ * in use and its high-water mark.
+ *
+ * Each allocation carries a small header storing its size, so the
+ * statistics do not need a lookup table.
+ */
+class TrackingAllocator : public ncnn::Allocator {
+ public:
+  /**
+   * @param size_compare_ratio  See ncnn::PoolAllocator::set_size_compare_ratio
+   */
+  explicit TrackingAllocator(float size_compare_ratio);
+
+  void *fastMalloc(size_t size) override;
+
+  void fastFree(void *ptr) override;
+
+  // Number of bytes allocated and not yet freed
+  int64_t CurrentBytes() const {
+    return current_bytes_.load(std::memory_order_relaxed);
+  }
+
+  // Maximum value of CurrentBytes() so far
+  int64_t PeakBytes() const {
+    return peak_bytes_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  ncnn::PoolAllocator pool_;
+  std::atomic<int64_t> current_bytes_{0};
+  std::atomic<int64_t> peak_bytes_{0};
+};
+
+}  // namespace sherpa_ncnn
+
+#endif  // SHERPA_NCNN_CSRC_TRACKING_ALLOCATOR_H_
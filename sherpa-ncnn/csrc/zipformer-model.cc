@@ -15,15 +15,21 @@
 
 namespace sherpa_ncnn {
 
-ZipformerModel::ZipformerModel(const ModelConfig &config) {
+ZipformerModel::ZipformerModel(const ModelConfig &config, bool encoder_only) {
   encoder_.opt = config.encoder_opt;
   decoder_.opt = config.decoder_opt;
   joiner_.opt = config.joiner_opt;
 
-  encoder_.opt.use_fp16_arithmetic = false;
-  encoder_.opt.use_fp16_storage = false;
+  ApplyPrecision(config.encoder_precision, &encoder_.opt);
+  ApplyPrecision(config.decoder_precision, &decoder_.opt);
+  ApplyPrecision(config.joiner_precision, &joiner_.opt);
 
-  NCNN_LOGE("Disable fp16 for Zipformer encoder");
+  if (config.encoder_precision.empty()) {
+    encoder_.opt.use_fp16_arithmetic = false;
+    encoder_.opt.use_fp16_storage = false;
+
+    NCNN_LOGE("Disable fp16 for Zipformer encoder");
+  }
 
   bool has_gpu = false;
 #if NCNN_VULKAN
@@ -42,24 +48,34 @@ ZipformerModel::ZipformerModel(const ModelConfig &config) {
   }
 
   InitEncoder(config.encoder_param, config.encoder_bin);
+  InitEncoderInputOutputIndexes();
+
+  if (encoder_only) return;
+
   InitDecoder(config.decoder_param, config.decoder_bin);
   InitJoiner(config.joiner_param, config.joiner_bin);
 
-  InitEncoderInputOutputIndexes();
   InitDecoderInputOutputIndexes();
   InitJoinerInputOutputIndexes();
 }
 
 #if __ANDROID_API__ >= 9
-ZipformerModel::ZipformerModel(AAssetManager *mgr, const ModelConfig &config) {
+ZipformerModel::ZipformerModel(AAssetManager *mgr, const ModelConfig &config,
+                               bool encoder_only) {
   encoder_.opt = config.encoder_opt;
   decoder_.opt = config.decoder_opt;
   joiner_.opt = config.joiner_opt;
 
-  encoder_.opt.use_fp16_arithmetic = false;
-  encoder_.opt.use_fp16_storage = false;
+  ApplyPrecision(config.encoder_precision, &encoder_.opt);
+  ApplyPrecision(config.decoder_precision, &decoder_.opt);
+  ApplyPrecision(config.joiner_precision, &joiner_.opt);
 
-  NCNN_LOGE("Disable fp16 for Zipformer encoder on Android");
+  if (config.encoder_precision.empty()) {
+    encoder_.opt.use_fp16_arithmetic = false;
+    encoder_.opt.use_fp16_storage = false;
+
+    NCNN_LOGE("Disable fp16 for Zipformer encoder on Android");
+  }
 
   bool has_gpu = false;
 #if NCNN_VULKAN
@@ -78,10 +94,13 @@ ZipformerModel::ZipformerModel(AAssetManager *mgr, const ModelConfig &config) {
   }
 
   InitEncoder(mgr, config.encoder_param, config.encoder_bin);
+  InitEncoderInputOutputIndexes();
+
+  if (encoder_only) return;
+
   InitDecoder(mgr, config.decoder_param, config.decoder_bin);
   InitJoiner(mgr, config.joiner_param, config.joiner_bin);
 
-  InitEncoderInputOutputIndexes();
   InitDecoderInputOutputIndexes();
   InitJoinerInputOutputIndexes();
 }
@@ -16,9 +16,12 @@ namespace sherpa_ncnn {
 // for how the model is converted from icefall to ncnn
 class ZipformerModel : public Model {
  public:
-  explicit ZipformerModel(const ModelConfig &config);
+  // If encoder_only is true, only the encoder is loaded. It is used for
+  // latency modes. See Model::GetLatencyMode().
+  explicit ZipformerModel(const ModelConfig &config, bool encoder_only = false);
 #if __ANDROID_API__ >= 9
-  ZipformerModel(AAssetManager *mgr, const ModelConfig &config);
+  ZipformerModel(AAssetManager *mgr, const ModelConfig &config,
+                 bool encoder_only = false);
 #endif
 
   ncnn::Net &GetEncoder() override { return encoder_; }
@@ -24,7 +24,16 @@
 // android-ndk/toolchains/llvm/prebuilt/linux-x86_64/sysroot/usr/include
 #include "jni.h"  // NOLINT
 
+#include <algorithm>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
 #include <strstream>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
 
 #if __ANDROID_API__ >= 9
 #include "android/asset_manager.h"
@@ -40,6 +49,15 @@
 
 namespace sherpa_ncnn {
 
+// A loaded model that can be shared by many SherpaNcnn instances
+struct SherpaNcnnModel {
+  std::shared_ptr<Model> model;
+  std::shared_ptr<const SymbolTable> sym;
+};
+
+// If decode_in_background is true, samples are queued and decoded by a
+// native thread owned by this object, so that the caller, e.g., the audio
+// recording thread, is never blocked by the neural network computation.
 class SherpaNcnn {
  public:
   SherpaNcnn(
@@ -47,39 +65,267 @@ class SherpaNcnn {
       AAssetManager *mgr,
 #endif
       const sherpa_ncnn::DecoderConfig &decoder_config,
-      const ModelConfig &model_config, const knf::FbankOptions &fbank_opts)
+      const ModelConfig &model_config, const knf::FbankOptions &fbank_opts,
+      bool decode_in_background)
       : recognizer_(
 #if __ANDROID_API__ >= 9
             mgr,
 #endif
             decoder_config, model_config, fbank_opts),
         tail_padding_(16000 * 0.32, 0) {
+    if (decode_in_background) {
+      worker_ = std::thread([this]() { Run(); });
+    }
+  }
+
+  // Share a loaded model with other instances
+  SherpaNcnn(std::shared_ptr<Model> model,
+             std::shared_ptr<const SymbolTable> sym,
+             const sherpa_ncnn::DecoderConfig &decoder_config,
+             const knf::FbankOptions &fbank_opts, bool decode_in_background)
+      : recognizer_(decoder_config, std::move(model), std::move(sym),
+                    fbank_opts),
+        tail_padding_(16000 * 0.32, 0) {
+    if (decode_in_background) {
+      worker_ = std::thread([this]() { Run(); });
+    }
+  }
+
+  ~SherpaNcnn() {
+    if (!worker_.joinable()) return;
+
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      stop_ = true;
+    }
+    queue_cv_.notify_one();
+    worker_.join();
   }
 
   void DecodeSamples(float sample_rate, const float *samples, int32_t n) {
+    if (worker_.joinable()) {
+      Enqueue({sample_rate, std::vector<float>(samples, samples + n), false});
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(recognizer_mutex_);
+    recognizer_.AcceptWaveform(sample_rate, samples, n);
+    recognizer_.Decode();
+  }
+
+  // samples are 16-bit PCM
+  void DecodeSamples(float sample_rate, const int16_t *samples, int32_t n) {
+    if (worker_.joinable()) {
+      std::vector<float> v(n);
+      for (int32_t i = 0; i != n; ++i) {
+        v[i] = samples[i] / 32768.;
+      }
+      Enqueue({sample_rate, std::move(v), false});
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(recognizer_mutex_);
+    AcceptShortSamples(sample_rate, samples, n);
+    recognizer_.Decode();
+  }
+
+  // Accept the samples without decoding them, so that an array copied in
+  // chunks is decoded only once by Decode().
+  void AcceptSamples(float sample_rate, const float *samples, int32_t n) {
+    if (worker_.joinable()) {
+      DecodeSamples(sample_rate, samples, n);
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(recognizer_mutex_);
     recognizer_.AcceptWaveform(sample_rate, samples, n);
+  }
+
+  // samples are 16-bit PCM
+  void AcceptSamples(float sample_rate, const int16_t *samples, int32_t n) {
+    if (worker_.joinable()) {
+      DecodeSamples(sample_rate, samples, n);
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(recognizer_mutex_);
+    AcceptShortSamples(sample_rate, samples, n);
+  }
+
+  // Decode samples accepted by AcceptSamples()
+  void Decode() {
+    if (worker_.joinable()) return;
+
+    std::lock_guard<std::mutex> lock(recognizer_mutex_);
     recognizer_.Decode();
   }
 
+  // In the background mode, it returns after all queued samples
+  // are decoded.
   void InputFinished() {
+    if (worker_.joinable()) {
+      Enqueue({16000, {}, true});
+
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      idle_cv_.wait(lock, [this]() { return num_pending_ == 0; });
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(recognizer_mutex_);
+    FinishInput();
+  }
+
+  // The Java string is created directly from the result, which is refilled
+  // in place, so that no temporary strings are needed.
+  jstring GetText(JNIEnv *env) {
+    std::lock_guard<std::mutex> lock(recognizer_mutex_);
+    recognizer_.GetResult(&result_);
+    return env->NewStringUTF(result_.text.c_str());
+  }
+
+  // Return nullptr if the text is the same as the one seen by the previous
+  // call. Otherwise, the new text is the first *offset UTF-16 code units
+  // of the previous text followed by the returned string.
+  jstring GetTextDelta(JNIEnv *env, int32_t *offset) {
+    std::lock_guard<std::mutex> lock(recognizer_mutex_);
+    recognizer_.GetResult(&result_);
+    const std::string &text = result_.text;
+    if (text == last_text_) return nullptr;
+
+    size_t k = 0;
+    size_t n = std::min(text.size(), last_text_.size());
+    while (k < n && text[k] == last_text_[k]) ++k;
+
+    // Don't split a UTF-8 character
+    while (k > 0 && k < text.size() && (text[k] & 0xc0) == 0x80) --k;
+
+    // Java strings count characters outside of the BMP, which use 4 bytes
+    // in UTF-8, as 2 code units
+    int32_t num_units = 0;
+    for (size_t i = 0; i != k; ++i) {
+      uint8_t c = text[i];
+      if ((c & 0xc0) != 0x80) num_units += c >= 0xf0 ? 2 : 1;
+    }
+
+    *offset = num_units;
+
+    // It reuses the memory of last_text_
+    last_text_ = text;
+
+    return env->NewStringUTF(text.c_str() + k);
+  }
+
+  bool IsEndpoint() {
+    std::lock_guard<std::mutex> lock(recognizer_mutex_);
+    return recognizer_.IsEndpoint();
+  }
+
+  // Samples queued but not decoded yet are discarded
+  void Reset() {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      num_pending_ -= static_cast<int32_t>(queue_.size());
+      queue_.clear();
+    }
+    idle_cv_.notify_all();
+
+    std::lock_guard<std::mutex> lock(recognizer_mutex_);
+    recognizer_.Reset();
+  }
+
+ private:
+  struct Chunk {
+    float sample_rate;
+    std::vector<float> samples;
+    bool input_finished;
+  };
+
+  void Enqueue(Chunk &&chunk) {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      queue_.push_back(std::move(chunk));
+      ++num_pending_;
+    }
+    queue_cv_.notify_one();
+  }
+
+  // Convert 16-bit PCM samples to float in small chunks.
+  // Must be called with recognizer_mutex_ held
+  void AcceptShortSamples(float sample_rate, const int16_t *samples,
+                          int32_t n) {
+    constexpr int32_t kChunkSize = 1024;
+    float buf[kChunkSize];
+
+    for (int32_t i = 0; i < n; i += kChunkSize) {
+      int32_t m = std::min(kChunkSize, n - i);
+      for (int32_t k = 0; k != m; ++k) {
+        buf[k] = samples[i + k] / 32768.;
+      }
+      recognizer_.AcceptWaveform(sample_rate, buf, m);
+    }
+  }
+
+  // Must be called with recognizer_mutex_ held
+  void FinishInput() {
     recognizer_.AcceptWaveform(16000, tail_padding_.data(),
                                tail_padding_.size());
     recognizer_.InputFinished();
     recognizer_.Decode();
   }
 
-  const std::string GetText() {
-    auto result = recognizer_.GetResult();
-    return result.text;
+  // Entry of the background thread
+  void Run() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (true) {
+      queue_cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (stop_) break;
+
+      Chunk chunk = std::move(queue_.front());
+      queue_.pop_front();
+      lock.unlock();
+
+      {
+        std::lock_guard<std::mutex> guard(recognizer_mutex_);
+        if (chunk.input_finished) {
+          FinishInput();
+        } else {
+          recognizer_.AcceptWaveform(chunk.sample_rate, chunk.samples.data(),
+                                     chunk.samples.size());
+          recognizer_.Decode();
+        }
+      }
+
+      lock.lock();
+      --num_pending_;
+      if (num_pending_ <= 0) {
+        idle_cv_.notify_all();
+      }
+    }
   }
 
-  bool IsEndpoint() { return recognizer_.IsEndpoint(); }
-
-  void Reset() { return recognizer_.Reset(); }
-
- private:
   sherpa_ncnn::Recognizer recognizer_;
   std::vector<float> tail_padding_;
+
+  // Refilled in place on each poll so that polling does not allocate
+  // once its buffers are large enough
+  sherpa_ncnn::RecognitionResult result_;
+
+  // Text returned by the previous call to GetTextDelta()
+  std::string last_text_;
+
+  // Protects recognizer_, result_ and last_text_
+  std::mutex recognizer_mutex_;
+
+  // The following members are used only if decode_in_background is true
+  std::thread worker_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  std::condition_variable idle_cv_;
+  std::deque<Chunk> queue_;
+
+  // Chunks queued or being decoded
+  int32_t num_pending_ = 0;
+  bool stop_ = false;
 };
 
 static ModelConfig GetModelConfig(JNIEnv *env, jobject config) {
@@ -304,12 +550,27 @@ static knf::FbankOptions GetFbankOptions(JNIEnv *env, jobject opts) {
   return fbank_opts;
 }
 
+// Throw an IllegalArgumentException if [offset, offset + n) is not within
+// [0, size). Return false if it is thrown, in which case the caller must
+// return without calling other JNI functions.
+static bool CheckRange(JNIEnv *env, jint offset, jint n, jlong size) {
+  if (offset >= 0 && n >= 0 && offset <= size - n) return true;
+
+  std::string msg = "Invalid range: offset " + std::to_string(offset) +
+                    ", n " + std::to_string(n) + ", size " +
+                    std::to_string(size);
+  env->ThrowNew(env->FindClass("java/lang/IllegalArgumentException"),
+                msg.c_str());
+  return false;
+}
+
 }  // namespace sherpa_ncnn
 
 SHERPA_EXTERN_C
 JNIEXPORT jlong JNICALL Java_com_k2fsa_sherpa_ncnn_SherpaNcnn_new(
     JNIEnv *env, jobject /*obj*/, jobject asset_manager, jobject _model_config,
-    jobject _decoder_config, jobject _fbank_config) {
+    jobject _decoder_config, jobject _fbank_config,
+    jboolean decode_in_background) {
 #if __ANDROID_API__ >= 9
   AAssetManager *mgr = AAssetManager_fromJava(env, asset_manager);
   if (!mgr) {
@@ -331,11 +592,77 @@ JNIEXPORT jlong JNICALL Java_com_k2fsa_sherpa_ncnn_SherpaNcnn_new(
 #if __ANDROID_API__ >= 9
       mgr,
 #endif
-      decoder_config, model_config, fbank_opts);
+      decoder_config, model_config, fbank_opts, decode_in_background);
 
   return (jlong)model;
 }
 
+SHERPA_EXTERN_C
+JNIEXPORT jlong JNICALL Java_com_k2fsa_sherpa_ncnn_SherpaNcnnModel_new(
+    JNIEnv *env, jobject /*obj*/, jobject asset_manager,
+    jobject _model_config) {
+#if __ANDROID_API__ >= 9
+  AAssetManager *mgr = AAssetManager_fromJava(env, asset_manager);
+  if (!mgr) {
+    NCNN_LOGE("Failed to get asset manager: %p", mgr);
+  }
+#endif
+
+  auto model_config = sherpa_ncnn::GetModelConfig(env, _model_config);
+  NCNN_LOGE("------model_config------\n%s\n", model_config.ToString().c_str());
+
+  // Return 0 on error so that the Kotlin class throws instead of the app
+  // being killed
+  auto model = std::make_unique<sherpa_ncnn::SherpaNcnnModel>();
+#if __ANDROID_API__ >= 9
+  model->sym =
+      std::make_shared<sherpa_ncnn::SymbolTable>(mgr, model_config.tokens);
+#else
+  model->sym = std::make_shared<sherpa_ncnn::SymbolTable>(model_config.tokens);
+#endif
+
+  if (model->sym->NumSymbols() == 0) {
+    NCNN_LOGE("Failed to load %s", model_config.tokens.c_str());
+    return 0;
+  }
+
+#if __ANDROID_API__ >= 9
+  model->model = sherpa_ncnn::Model::Create(mgr, model_config);
+#else
+  model->model = sherpa_ncnn::Model::Create(model_config);
+#endif
+
+  if (!model->model) {
+    NCNN_LOGE("Failed to create the model");
+    return 0;
+  }
+
+  return (jlong)model.release();
+}
+
+SHERPA_EXTERN_C
+JNIEXPORT void JNICALL Java_com_k2fsa_sherpa_ncnn_SherpaNcnnModel_delete(
+    JNIEnv *env, jobject /*obj*/, jlong ptr) {
+  delete reinterpret_cast<sherpa_ncnn::SherpaNcnnModel *>(ptr);
+}
+
+SHERPA_EXTERN_C
+JNIEXPORT jlong JNICALL Java_com_k2fsa_sherpa_ncnn_SherpaNcnn_newFromModel(
+    JNIEnv *env, jobject /*obj*/, jlong model_ptr, jobject _decoder_config,
+    jobject _fbank_config, jboolean decode_in_background) {
+  auto model = reinterpret_cast<sherpa_ncnn::SherpaNcnnModel *>(model_ptr);
+
+  auto decoder_config = sherpa_ncnn::GetDecoderConfig(env, _decoder_config);
+  knf::FbankOptions fbank_opts =
+      sherpa_ncnn::GetFbankOptions(env, _fbank_config);
+
+  auto ans = new sherpa_ncnn::SherpaNcnn(model->model, model->sym,
+                                         decoder_config, fbank_opts,
+                                         decode_in_background);
+
+  return (jlong)ans;
+}
+
 SHERPA_EXTERN_C
 JNIEXPORT void JNICALL Java_com_k2fsa_sherpa_ncnn_SherpaNcnn_delete(
     JNIEnv *env, jobject /*obj*/, jlong ptr) {
@@ -362,12 +689,89 @@ JNIEXPORT void JNICALL Java_com_k2fsa_sherpa_ncnn_SherpaNcnn_decodeSamples(
     jfloat sample_rate) {
   auto model = reinterpret_cast<sherpa_ncnn::SherpaNcnn *>(ptr);
 
-  jfloat *p = env->GetFloatArrayElements(samples, nullptr);
   jsize n = env->GetArrayLength(samples);
 
-  model->DecodeSamples(sample_rate, p, n);
+  // Copy the array in small chunks instead of pinning it with
+  // GetPrimitiveArrayCritical(), which would keep the GC suspended while
+  // waiting for the lock held by getText() and computing features
+  constexpr int32_t kChunkSize = 1024;
+  jfloat buf[kChunkSize];
+  for (int32_t i = 0; i < n; i += kChunkSize) {
+    int32_t m = std::min(kChunkSize, n - i);
+    env->GetFloatArrayRegion(samples, i, m, buf);
+    model->AcceptSamples(sample_rate, buf, m);
+  }
+
+  model->Decode();
+}
+
+SHERPA_EXTERN_C
+JNIEXPORT void JNICALL
+Java_com_k2fsa_sherpa_ncnn_SherpaNcnn_decodeShortSamples(
+    JNIEnv *env, jobject /*obj*/, jlong ptr, jshortArray samples, jint n,
+    jfloat sample_rate) {
+  auto model = reinterpret_cast<sherpa_ncnn::SherpaNcnn *>(ptr);
+
+  if (!sherpa_ncnn::CheckRange(env, 0, n, env->GetArrayLength(samples))) {
+    return;
+  }
+
+  // Copy in small chunks without pinning the array and decode once
+  constexpr int32_t kChunkSize = 1024;
+  jshort buf[kChunkSize];
+  for (int32_t i = 0; i < n; i += kChunkSize) {
+    int32_t m = std::min(kChunkSize, n - i);
+    env->GetShortArrayRegion(samples, i, m, buf);
+    if (env->ExceptionCheck()) return;
+
+    model->AcceptSamples(sample_rate, buf, m);
+  }
 
-  env->ReleaseFloatArrayElements(samples, p, JNI_ABORT);
+  model->Decode();
+}
+
+// buffer is a direct FloatBuffer in the native byte order. n samples
+// starting at the given offset (in samples) are decoded in place.
+SHERPA_EXTERN_C
+JNIEXPORT void JNICALL
+Java_com_k2fsa_sherpa_ncnn_SherpaNcnn_decodeFloatBuffer(
+    JNIEnv *env, jobject /*obj*/, jlong ptr, jobject buffer, jint offset,
+    jint n, jfloat sample_rate) {
+  auto model = reinterpret_cast<sherpa_ncnn::SherpaNcnn *>(ptr);
+
+  auto p = static_cast<const float *>(env->GetDirectBufferAddress(buffer));
+  if (!p) {
+    NCNN_LOGE("Expect a direct buffer");
+    return;
+  }
+
+  // The capacity is in samples
+  jlong capacity = env->GetDirectBufferCapacity(buffer);
+  if (!sherpa_ncnn::CheckRange(env, offset, n, capacity)) return;
+
+  model->DecodeSamples(sample_rate, p + offset, n);
+}
+
+// Like decodeFloatBuffer but buffer is a direct ShortBuffer of 16-bit PCM
+// samples
+SHERPA_EXTERN_C
+JNIEXPORT void JNICALL
+Java_com_k2fsa_sherpa_ncnn_SherpaNcnn_decodeShortBuffer(
+    JNIEnv *env, jobject /*obj*/, jlong ptr, jobject buffer, jint offset,
+    jint n, jfloat sample_rate) {
+  auto model = reinterpret_cast<sherpa_ncnn::SherpaNcnn *>(ptr);
+
+  auto p = static_cast<const int16_t *>(env->GetDirectBufferAddress(buffer));
+  if (!p) {
+    NCNN_LOGE("Expect a direct buffer");
+    return;
+  }
+
+  // The capacity is in samples
+  jlong capacity = env->GetDirectBufferCapacity(buffer);
+  if (!sherpa_ncnn::CheckRange(env, offset, n, capacity)) return;
+
+  model->DecodeSamples(sample_rate, p + offset, n);
 }
 
 SHERPA_EXTERN_C
@@ -381,8 +785,22 @@ JNIEXPORT jstring JNICALL Java_com_k2fsa_sherpa_ncnn_SherpaNcnn_getText(
     JNIEnv *env, jobject /*obj*/, jlong ptr) {
   // see
   // https://stackoverflow.com/questions/11621449/send-c-string-to-java-via-jni
-  auto text = reinterpret_cast<sherpa_ncnn::SherpaNcnn *>(ptr)->GetText();
-  return env->NewStringUTF(text.c_str());
+  return reinterpret_cast<sherpa_ncnn::SherpaNcnn *>(ptr)->GetText(env);
+}
+
+// Return null if the text has not changed since the previous call.
+// Otherwise, offset[0] is set to the number of characters kept from the
+// previous text and the returned string is the part that follows them.
+SHERPA_EXTERN_C
+JNIEXPORT jstring JNICALL Java_com_k2fsa_sherpa_ncnn_SherpaNcnn_getTextDelta(
+    JNIEnv *env, jobject /*obj*/, jlong ptr, jintArray offset) {
+  int32_t k = 0;
+  jstring delta =
+      reinterpret_cast<sherpa_ncnn::SherpaNcnn *>(ptr)->GetTextDelta(env, &k);
+  if (!delta) return nullptr;
+
+  env->SetIntArrayRegion(offset, 0, 1, &k);
+  return delta;
 }
 
 SHERPA_EXTERN_C
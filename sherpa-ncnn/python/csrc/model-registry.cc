@@ -0,0 +1,90 @@
+/**
+ * Copyright (c)  2023  Xiaomi Corporation (authors: Fangjun Kuang)
+ *
+ * See LICENSE for clarification regarding multiple authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sherpa-ncnn/python/csrc/model-registry.h"
+
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "sherpa-ncnn/csrc/model-registry.h"
+
+namespace sherpa_ncnn {
+
+static constexpr const char *kModelRegistryDoc = R"doc(
+Keep versions of a model so that it can be replaced while streams are
+being decoded.
+
+New streams use the newest loaded version. Streams created earlier keep
+using the version they started with, and an old version is freed once its
+last stream is destroyed.
+)doc";
+
+static constexpr const char *kLoadDoc = R"doc(
+Load a model and make it the newest version. The GIL is released while
+loading, so streams of older versions keep decoding in other threads.
+
+Return the version of the loaded model, which starts from 1. Return -1 on
+error, in which case the current version is kept.
+)doc";
+
+static constexpr const char *kCreateStreamDoc = R"doc(
+Create a recognizer using the newest version of the model.
+
+Return a tuple ``(recognizer, version)``. Raise ``RuntimeError`` if no
+model has been loaded.
+)doc";
+
+void PybindModelRegistry(py::module *m) {
+  using PyClass = ModelRegistry;
+  py::class_<PyClass>(*m, "ModelRegistry", kModelRegistryDoc)
+      .def(py::init([](float sample_rate) -> std::unique_ptr<PyClass> {
+             knf::FbankOptions fbank_opts;
+             fbank_opts.frame_opts.dither = 0;
+             fbank_opts.frame_opts.snip_edges = false;
+             fbank_opts.frame_opts.samp_freq = sample_rate;
+             fbank_opts.mel_opts.num_bins = 80;
+
+             return std::make_unique<PyClass>(fbank_opts);
+           }),
+           py::arg("sample_rate") = 16000)
+      .def(
+          "load",
+          [](PyClass &self, const ModelConfig &model_config) {
+            return self.Load(model_config);
+          },
+          py::arg("model_config"), py::call_guard<py::gil_scoped_release>(),
+          kLoadDoc)
+      .def(
+          "create_stream",
+          [](const PyClass &self, const DecoderConfig &decoder_config) {
+            int32_t version = 0;
+            std::unique_ptr<Recognizer> stream =
+                self.CreateStream(decoder_config, &version);
+            if (!stream) {
+              throw std::runtime_error("No model has been loaded");
+            }
+
+            return py::make_tuple(std::move(stream), version);
+          },
+          py::arg("decoder_config"), kCreateStreamDoc)
+      .def_property_readonly("version", &PyClass::Version)
+      .def_property_readonly("live_versions", &PyClass::LiveVersions);
+}
+
+}  // namespace sherpa_ncnn
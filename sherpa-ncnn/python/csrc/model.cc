@@ -20,6 +20,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "sherpa-ncnn/csrc/model.h"
 
@@ -49,6 +50,39 @@ Args:
     Number of threads to use for neural network computation.
   tokens:
     Path to tokens.txt
+  encoder_precision:
+    Precision of the encoder. Valid values are: "" (use the default),
+    fp32, fp16-storage, fp16-arithmetic, bf16-storage, int8.
+  decoder_precision:
+    Precision of the decoder. See encoder_precision.
+  joiner_precision:
+    Precision of the joiner. See encoder_precision.
+  precision_check_threshold:
+    If positive, networks using fp16 or bf16 are compared with fp32 on a
+    calibration chunk after loading and fall back to fp32 if the maximum
+    relative error exceeds this value.
+  enable_encoder_profiling:
+    True to record the time and output size of each encoder layer. Use
+    ``Recognizer.encoder_profiling_report()`` to get the result.
+  use_native_joiner:
+    True to compute the add, tanh, and output layers of the joiner with a
+    native CPU kernel instead of ncnn. The output weight is kept in the
+    precision given by joiner_precision (fp32, fp16, or int8).
+  joiner_shortlist_size:
+    Used only if use_native_joiner is True. If positive, only this number
+    of the most likely tokens and blank, as predicted by a low-rank
+    approximation of the output layer, are computed exactly per frame.
+  joiner_shortlist_rank:
+    Rank of the approximation used to select the shortlist.
+  joiner_shortlist_fallback_prob:
+    If tokens outside the shortlist get more than this probability from
+    the approximation, the full vocabulary is computed for that frame.
+  extra_encoder_params:
+    Paths to encoder.ncnn.param of the same model exported with other chunk
+    sizes. Each of them is a latency mode that a stream can choose with
+    ``latency_mode`` of its decoder config. Mode 0 uses ``encoder_param``.
+  extra_encoder_bins:
+    Paths to encoder.ncnn.bin corresponding to ``extra_encoder_params``.
 )doc";
 
 static void PybindModelConfig(py::module *m) {
@@ -60,7 +94,18 @@ static void PybindModelConfig(py::module *m) {
                        const std::string &decoder_bin,
                        const std::string &joiner_param,
                        const std::string &joiner_bin, int32_t num_threads,
-                       const std::string &tokens) -> std::unique_ptr<PyClass> {
+                       const std::string &tokens,
+                       const std::string &encoder_precision,
+                       const std::string &decoder_precision,
+                       const std::string &joiner_precision,
+                       float precision_check_threshold,
+                       bool enable_encoder_profiling, bool use_native_joiner,
+                       int32_t joiner_shortlist_size,
+                       int32_t joiner_shortlist_rank,
+                       float joiner_shortlist_fallback_prob,
+                       const std::vector<std::string> &extra_encoder_params,
+                       const std::vector<std::string> &extra_encoder_bins)
+                        -> std::unique_ptr<PyClass> {
              auto ans = std::make_unique<PyClass>();
              ans->encoder_param = encoder_param;
              ans->encoder_bin = encoder_bin;
@@ -69,6 +114,18 @@ static void PybindModelConfig(py::module *m) {
              ans->joiner_param = joiner_param;
              ans->joiner_bin = joiner_bin;
              ans->tokens = tokens;
+             ans->encoder_precision = encoder_precision;
+             ans->decoder_precision = decoder_precision;
+             ans->joiner_precision = joiner_precision;
+             ans->precision_check_threshold = precision_check_threshold;
+             ans->enable_encoder_profiling = enable_encoder_profiling;
+             ans->use_native_joiner = use_native_joiner;
+             ans->joiner_shortlist_size = joiner_shortlist_size;
+             ans->joiner_shortlist_rank = joiner_shortlist_rank;
+             ans->joiner_shortlist_fallback_prob =
+                 joiner_shortlist_fallback_prob;
+             ans->extra_encoder_params = extra_encoder_params;
+             ans->extra_encoder_bins = extra_encoder_bins;
 
              ans->use_vulkan_compute = false;
 
@@ -81,7 +138,18 @@ static void PybindModelConfig(py::module *m) {
            py::arg("encoder_param"), py::arg("encoder_bin"),
            py::arg("decoder_param"), py::arg("decoder_bin"),
            py::arg("joiner_param"), py::arg("joiner_bin"),
-           py::arg("num_threads"), py::arg("tokens"), kModelConfigInitDoc);
+           py::arg("num_threads"), py::arg("tokens"),
+           py::arg("encoder_precision") = "", py::arg("decoder_precision") = "",
+           py::arg("joiner_precision") = "",
+           py::arg("precision_check_threshold") = 0.05,
+           py::arg("enable_encoder_profiling") = false,
+           py::arg("use_native_joiner") = false,
+           py::arg("joiner_shortlist_size") = 0,
+           py::arg("joiner_shortlist_rank") = 32,
+           py::arg("joiner_shortlist_fallback_prob") = 0.02,
+           py::arg("extra_encoder_params") = std::vector<std::string>{},
+           py::arg("extra_encoder_bins") = std::vector<std::string>{},
+           kModelConfigInitDoc);
 }
 
 void PybindModel(py::module *m) { PybindModelConfig(m); }
@@ -18,10 +18,16 @@
 
 #include "sherpa-ncnn/python/csrc/recognizer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "sherpa-ncnn/csrc/recognizer.h"
+#include "sherpa-ncnn/csrc/thread-pool.h"
+#include "sherpa-ncnn/csrc/wave-reader.h"
 
 namespace sherpa_ncnn {
 
@@ -38,39 +44,395 @@ Args:
     True to enable endpoint detection. False to disable endpoint detection.
   endpoint_config:
     Used only when ``enable_endpoint`` is True.
+  adaptive_beam:
+    Used only when method is modified_beam_search. True to choose the number
+    of active paths of each frame from the entropy of the joiner output,
+    between ``min_active_paths`` and ``num_active_paths``.
+  min_active_paths:
+    Used only when ``adaptive_beam`` is True. Number of active paths to keep
+    when the entropy is below ``adaptive_beam_low_entropy``.
+  adaptive_beam_low_entropy:
+    Used only when ``adaptive_beam`` is True. Entropy (in nats) at or below
+    which only ``min_active_paths`` paths are kept.
+  adaptive_beam_high_entropy:
+    Used only when ``adaptive_beam`` is True. Entropy (in nats) at or above
+    which ``num_active_paths`` paths are kept.
+  emit_segments:
+    Used only when ``enable_endpoint`` is True. If True, endpoints are
+    detected while decoding and each finished segment is put into a queue
+    that is read by ``Recognizer.pop_segment()``.
+  reset_state_on_endpoint:
+    Used only when ``emit_segments`` is True. True to reset the encoder
+    state at each endpoint so that segments are decoded independently.
+  latency_mode:
+    Index of the encoder to use if the model is created with
+    ``extra_encoder_params``. 0 uses ``encoder_param``.
 )doc";
 
 static void PybindRecognitionResult(py::module *m) {
   using PyClass = RecognitionResult;
   py::class_<PyClass>(*m, "RecognitionResult")
       .def_property_readonly(
-          "text", [](PyClass &self) -> std::string { return self.text; });
+          "text", [](PyClass &self) -> std::string { return self.text; })
+      .def_property_readonly("tokens",
+                             [](PyClass &self) {
+                               // Skip the leading blanks
+                               return std::vector<int32_t>(
+                                   self.tokens.end() - self.timestamps.size(),
+                                   self.tokens.end());
+                             })
+      .def_property_readonly("timestamps",
+                             [](PyClass &self) {
+                               std::vector<float> ans(self.timestamps.size());
+                               for (size_t i = 0; i != ans.size(); ++i) {
+                                 ans[i] = self.timestamps[i] *
+                                          kSecondsPerOutputFrame;
+                               }
+                               return ans;
+                             })
+      .def_readonly("num_stable_tokens", &PyClass::num_stable_tokens)
+      .def_readonly("stable_text_length", &PyClass::stable_text_length);
+}
+
+static void PybindMemoryStats(py::module *m) {
+  {
+    using PyClass = NetMemoryStats;
+    py::class_<PyClass>(*m, "NetMemoryStats")
+        .def_readonly("weight_bytes", &PyClass::weight_bytes)
+        .def_readonly("blob_bytes", &PyClass::blob_bytes)
+        .def_readonly("peak_blob_bytes", &PyClass::peak_blob_bytes)
+        .def_readonly("workspace_bytes", &PyClass::workspace_bytes)
+        .def_readonly("peak_workspace_bytes", &PyClass::peak_workspace_bytes);
+  }
+
+  {
+    using PyClass = ModelMemoryStats;
+    py::class_<PyClass>(*m, "ModelMemoryStats")
+        .def_readonly("encoder", &PyClass::encoder)
+        .def_readonly("decoder", &PyClass::decoder)
+        .def_readonly("joiner", &PyClass::joiner)
+        .def_property_readonly("total_bytes", &PyClass::TotalBytes)
+        .def("__str__", &PyClass::ToString);
+  }
+
+  {
+    using PyClass = StreamMemoryStats;
+    py::class_<PyClass>(*m, "StreamMemoryStats")
+        .def_readonly("feature_bytes", &PyClass::feature_bytes)
+        .def_readonly("encoder_state_bytes", &PyClass::encoder_state_bytes)
+        .def_readonly("hyp_bytes", &PyClass::hyp_bytes)
+        .def_property_readonly("total_bytes", &PyClass::TotalBytes);
+  }
+
+  {
+    using PyClass = MemoryStats;
+    py::class_<PyClass>(*m, "MemoryStats")
+        .def_readonly("model", &PyClass::model)
+        .def_readonly("stream", &PyClass::stream)
+        .def("__str__", &PyClass::ToString);
+  }
+}
+
+static void PybindRecognitionSegment(py::module *m) {
+  using PyClass = RecognitionSegment;
+  py::class_<PyClass>(*m, "RecognitionSegment")
+      .def_readonly("id", &PyClass::id)
+      .def_readonly("start_frame", &PyClass::start_frame)
+      .def_readonly("end_frame", &PyClass::end_frame)
+      .def_property_readonly(
+          "start_time",
+          [](const PyClass &self) {
+            return self.start_frame * kSecondsPerOutputFrame;
+          })
+      .def_property_readonly(
+          "end_time",
+          [](const PyClass &self) {
+            return self.end_frame * kSecondsPerOutputFrame;
+          })
+      .def_readonly("text", &PyClass::text)
+      .def_readonly("tokens", &PyClass::tokens)
+      .def_property_readonly("timestamps", [](const PyClass &self) {
+        std::vector<float> ans(self.timestamps.size());
+        for (size_t i = 0; i != ans.size(); ++i) {
+          ans[i] = self.timestamps[i] * kSecondsPerOutputFrame;
+        }
+        return ans;
+      });
 }
 
 static void PybindDecoderConfig(py::module *m) {
   using PyClass = DecoderConfig;
   py::class_<PyClass>(*m, "DecoderConfig")
-      .def(py::init<const std::string &, int32_t, bool,
-                    const EndpointConfig &>(),
+      .def(py::init([](const std::string &method, int32_t num_active_paths,
+                       bool enable_endpoint,
+                       const EndpointConfig &endpoint_config,
+                       bool adaptive_beam, int32_t min_active_paths,
+                       float adaptive_beam_low_entropy,
+                       float adaptive_beam_high_entropy, bool emit_segments,
+                       bool reset_state_on_endpoint, int32_t latency_mode) {
+             DecoderConfig config(method, num_active_paths, enable_endpoint,
+                                  endpoint_config);
+             config.adaptive_beam = adaptive_beam;
+             config.min_active_paths = min_active_paths;
+             config.adaptive_beam_low_entropy = adaptive_beam_low_entropy;
+             config.adaptive_beam_high_entropy = adaptive_beam_high_entropy;
+             config.emit_segments = emit_segments;
+             config.reset_state_on_endpoint = reset_state_on_endpoint;
+             config.latency_mode = latency_mode;
+             return config;
+           }),
            py::arg("method"), py::arg("num_active_paths"),
            py::arg("enable_endpoint"), py::arg("endpoint_config"),
-           kDecoderConfigInitDoc)
+           py::arg("adaptive_beam") = false, py::arg("min_active_paths") = 1,
+           py::arg("adaptive_beam_low_entropy") = 0.5,
+           py::arg("adaptive_beam_high_entropy") = 2.0,
+           py::arg("emit_segments") = false,
+           py::arg("reset_state_on_endpoint") = false,
+           py::arg("latency_mode") = 0, kDecoderConfigInitDoc)
       .def("__str__", &PyClass::ToString)
       .def_property_readonly("method",
                              [](const PyClass &self) { return self.method; })
       .def_property_readonly(
           "num_active_paths",
           [](const PyClass &self) { return self.num_active_paths; })
+      .def_property_readonly(
+          "adaptive_beam",
+          [](const PyClass &self) { return self.adaptive_beam; })
+      .def_property_readonly(
+          "min_active_paths",
+          [](const PyClass &self) { return self.min_active_paths; })
+      .def_property_readonly(
+          "adaptive_beam_low_entropy",
+          [](const PyClass &self) { return self.adaptive_beam_low_entropy; })
+      .def_property_readonly(
+          "adaptive_beam_high_entropy",
+          [](const PyClass &self) { return self.adaptive_beam_high_entropy; })
       .def_property_readonly(
           "enable_endpoint",
           [](const PyClass &self) { return self.enable_endpoint; })
+      .def_property_readonly(
+          "emit_segments",
+          [](const PyClass &self) { return self.emit_segments; })
+      .def_property_readonly(
+          "reset_state_on_endpoint",
+          [](const PyClass &self) { return self.reset_state_on_endpoint; })
+      .def_property_readonly(
+          "latency_mode",
+          [](const PyClass &self) { return self.latency_mode; })
       .def_property_readonly("endpoint_config", [](const PyClass &self) {
         return self.endpoint_config;
       });
 }
 
+static constexpr const char *kDrainResultDoc = R"doc(
+Return the result that has become stable since the previous call and
+free it inside the recognizer. Use it instead of ``result`` for long
+streams so that the cost of each call does not grow with the length of the
+stream. On an endpoint, the whole remaining result is returned.
+)doc";
+
+static constexpr const char *kPopSegmentDoc = R"doc(
+Return the oldest segment finished by an endpoint, or None if there is
+none. Segments are emitted only if ``emit_segments`` of the decoder config
+is True.
+)doc";
+
+static constexpr const char *kSetLatencyModeDoc = R"doc(
+Switch to the encoder of the given latency mode. It takes effect right away
+if nothing has been decoded yet and at the next endpoint or reset otherwise,
+since encoders with different chunk sizes have incompatible states.
+Return False if the mode is invalid.
+)doc";
+
+static constexpr const char *kCreateStreamDoc = R"doc(
+Create a new recognizer that shares the model of this one.
+
+The returned recognizer has its own features and decoding state, so it can
+decode a different audio stream. Creating it does not load the model again.
+Different recognizers can be used from different threads at the same time.
+)doc";
+
+static constexpr const char *kDecodeStreamsDoc = R"doc(
+Call ``decode()`` on each of the given recognizers using a pool of
+native threads. The GIL is released while decoding.
+
+Args:
+  streams:
+    A list of recognizers, usually created by ``create_stream()``. A
+    recognizer must not appear more than once in the list.
+  num_threads:
+    Number of threads to use. If it is not positive, the number of CPU
+    cores is used. It is capped by the number of streams.
+)doc";
+
+static constexpr const char *kAcceptWaveformDoc = R"doc(
+Accept audio samples. The samples are read in place without making a copy
+in Python.
+
+Args:
+  sample_rate:
+    Sample rate of the input samples.
+  waveform:
+    A 1-D object supporting the buffer protocol, e.g., a numpy array or
+    ``bytes``. Supported element types are:
+
+      - float32, with samples in the range ``[-1, 1]``
+      - int16, with samples in the range ``[-32768, 32767]``
+      - bytes, e.g., the return value of ``wave.Wave_read.readframes()``,
+        which are interpreted as little-endian 16-bit PCM samples
+
+    Non-contiguous arrays are accepted. Other element types are
+    converted to float32 first.
+)doc";
+
+// Convert n samples of type T, which are stride bytes apart, to float
+// and pass them to the recognizer chunk by chunk. The feature extractor is
+// streaming, so the result is the same as passing all samples at once.
+template <typename T>
+static void AcceptSamples(Recognizer *recognizer, float sample_rate,
+                          const char *p, int64_t n, int64_t stride,
+                          float scale) {
+  constexpr int32_t kChunkSize = 4096;
+  float buf[kChunkSize];
+
+  for (int64_t i = 0; i < n; i += kChunkSize) {
+    int32_t m = static_cast<int32_t>(std::min<int64_t>(kChunkSize, n - i));
+    for (int32_t k = 0; k != m; ++k) {
+      T v;
+      // p may not be aligned, e.g., for bytes objects
+      std::memcpy(&v, p + (i + k) * stride, sizeof(T));
+      buf[k] = v * scale;
+    }
+    recognizer->AcceptWaveform(sample_rate, buf, m);
+  }
+}
+
+static void AcceptBuffer(Recognizer &self, float sample_rate,  // NOLINT
+                         py::buffer waveform) {
+  py::buffer_info info = waveform.request();
+
+  // bytes and bytearray have 1 dimension and an item size of 1
+  bool is_bytes = info.itemsize == 1 && (info.format == "B" ||
+                                         info.format == "b" ||
+                                         info.format == "c");
+
+  if (info.ndim != 1) {
+    throw py::value_error("Expect a 1-D waveform. Given: " +
+                          std::to_string(info.ndim) + "-D");
+  }
+
+  if (is_bytes && info.strides[0] != 1) {
+    throw py::value_error("Expect contiguous bytes");
+  }
+
+  if (is_bytes && info.size % 2 != 0) {
+    throw py::value_error(
+        "Expect 16-bit samples, but the number of bytes is odd: " +
+        std::to_string(info.size));
+  }
+
+  const char *p = static_cast<const char *>(info.ptr);
+  int64_t stride = info.strides[0];
+
+  if (info.format == py::format_descriptor<float>::format()) {
+    py::gil_scoped_release release;
+    if (stride == sizeof(float)) {
+      self.AcceptWaveform(sample_rate, reinterpret_cast<const float *>(p),
+                          static_cast<int32_t>(info.size));
+    } else {
+      AcceptSamples<float>(&self, sample_rate, p, info.size, stride, 1);
+    }
+  } else if (info.format == py::format_descriptor<int16_t>::format()) {
+    py::gil_scoped_release release;
+    AcceptSamples<int16_t>(&self, sample_rate, p, info.size, stride,
+                           1 / 32768.);
+  } else if (is_bytes) {
+    py::gil_scoped_release release;
+    AcceptSamples<int16_t>(&self, sample_rate, p, info.size / 2, 2,
+                           1 / 32768.);
+  } else {
+    auto samples = py::array_t<float, py::array::c_style |
+                                          py::array::forcecast>::ensure(
+        waveform);
+    if (!samples) {
+      throw py::type_error("Unsupported waveform type: " + info.format);
+    }
+    const float *f = samples.data();
+    int32_t n = static_cast<int32_t>(samples.size());
+
+    py::gil_scoped_release release;
+    self.AcceptWaveform(sample_rate, f, n);
+  }
+}
+
+static constexpr const char *kDecodeBatchDoc = R"doc(
+Decode a list of waveforms in parallel and return their results in the
+same order. The model of the given recognizer is shared by all threads
+and each waveform is decoded by a new stream created from it, so the
+state of the given recognizer is not changed. The GIL is released while
+decoding.
+
+Args:
+  recognizer:
+    It provides the model and the decoder config.
+  waveforms:
+    A list of 1-D float32 arrays with samples in the range ``[-1, 1]``.
+  sample_rate:
+    Sample rate of the waveforms.
+  num_threads:
+    Number of threads to use. If it is not positive, the number of CPU
+    cores is used.
+  tail_padding:
+    Seconds of silence appended to each waveform so that the last frames
+    are decoded.
+Returns:
+  Return a list of RecognitionResult.
+)doc";
+
+static constexpr const char *kDecodeFilesDoc = R"doc(
+Like :func:`decode_batch` but reads the waveforms from wave files in the
+worker threads. The files must be single channel, 16-bit PCM encoded and
+have the given sample rate.
+
+Args:
+  recognizer:
+    It provides the model and the decoder config.
+  filenames:
+    A list of paths to wave files.
+  sample_rate:
+    Expected sample rate of the wave files.
+  num_threads:
+    Number of threads to use. If it is not positive, the number of CPU
+    cores is used.
+  tail_padding:
+    Seconds of silence appended to each waveform.
+Returns:
+  Return a list of RecognitionResult.
+)doc";
+
+// Decode a complete utterance with a new stream sharing the model
+// of the given recognizer
+static RecognitionResult DecodeSamples(const Recognizer &recognizer,
+                                       float sample_rate,
+                                       const float *samples, int32_t n,
+                                       float tail_padding) {
+  std::unique_ptr<Recognizer> stream = recognizer.CreateStream();
+  stream->AcceptWaveform(sample_rate, samples, n);
+
+  std::vector<float> tail_paddings(
+      static_cast<int32_t>(tail_padding * sample_rate));
+  stream->AcceptWaveform(sample_rate, tail_paddings.data(),
+                         static_cast<int32_t>(tail_paddings.size()));
+  stream->InputFinished();
+  stream->Decode();
+
+  return stream->GetResult();
+}
+
 void PybindRecognizer(py::module *m) {
   PybindRecognitionResult(m);
+  PybindRecognitionSegment(m);
+  PybindMemoryStats(m);
   PybindDecoderConfig(m);
 
   using PyClass = Recognizer;
@@ -89,16 +451,118 @@ void PybindRecognizer(py::module *m) {
            }),
            py::arg("decoder_config"), py::arg("model_config"),
            py::arg("sample_rate") = 16000)
+      .def(
+          "create_stream",
+          [](const PyClass &self) { return self.CreateStream(); },
+          kCreateStreamDoc)
+      .def(
+          "create_stream",
+          [](const PyClass &self, const DecoderConfig &decoder_config) {
+            return self.CreateStream(decoder_config);
+          },
+          py::arg("decoder_config"))
+      .def("accept_waveform", &AcceptBuffer, py::arg("sample_rate"),
+           py::arg("waveform"), kAcceptWaveformDoc)
+      // For inputs without the buffer protocol, e.g., a list of floats
       .def("accept_waveform",
            [](PyClass &self, float sample_rate, py::array_t<float> waveform) {
-             self.AcceptWaveform(sample_rate, waveform.data(), waveform.size());
+             const float *p = waveform.data();
+             int32_t n = static_cast<int32_t>(waveform.size());
+
+             // waveform keeps the buffer alive while the GIL is released
+             py::gil_scoped_release release;
+             self.AcceptWaveform(sample_rate, p, n);
            })
-      .def("input_finished", &PyClass::InputFinished)
-      .def("decode", &PyClass::Decode)
+      .def("input_finished", &PyClass::InputFinished,
+           py::call_guard<py::gil_scoped_release>())
+      .def("decode", &PyClass::Decode,
+           py::call_guard<py::gil_scoped_release>())
       .def_property_readonly("result",
                              [](PyClass &self) { return self.GetResult(); })
+      .def("drain_result", &PyClass::DrainResult, kDrainResultDoc)
+      .def(
+          "pop_segment",
+          [](PyClass &self) -> py::object {
+            RecognitionSegment segment;
+            if (!self.PopSegment(&segment)) return py::none();
+            return py::cast(std::move(segment));
+          },
+          kPopSegmentDoc)
       .def("is_endpoint", &PyClass::IsEndpoint)
-      .def("reset", &PyClass::Reset);
+      .def("set_latency_mode", &PyClass::SetLatencyMode, py::arg("mode"),
+           kSetLatencyModeDoc)
+      .def_property_readonly("latency_mode", &PyClass::GetLatencyMode)
+      .def("reset", &PyClass::Reset, py::call_guard<py::gil_scoped_release>())
+      .def("encoder_profiling_report", &PyClass::GetEncoderProfilingReport)
+      .def_property_readonly("memory_stats", &PyClass::GetMemoryStats);
+
+  m->def(
+      "decode_streams",
+      [](std::vector<PyClass *> streams, int32_t num_threads) {
+        py::gil_scoped_release release;
+        DecodeMultipleStreams(streams.data(),
+                              static_cast<int32_t>(streams.size()),
+                              num_threads);
+      },
+      py::arg("streams"), py::arg("num_threads") = 0, kDecodeStreamsDoc);
+
+  m->def(
+      "decode_batch",
+      [](const PyClass &recognizer,
+         const std::vector<py::array_t<float, py::array::c_style |
+                                                 py::array::forcecast>>
+             &waveforms,
+         float sample_rate, int32_t num_threads, float tail_padding) {
+        int32_t n = static_cast<int32_t>(waveforms.size());
+        std::vector<RecognitionResult> ans(n);
+
+        py::gil_scoped_release release;
+        ThreadPool::Get().ParallelFor(n, num_threads, [&](int32_t i) {
+          ans[i] = DecodeSamples(recognizer, sample_rate, waveforms[i].data(),
+                                 static_cast<int32_t>(waveforms[i].size()),
+                                 tail_padding);
+        });
+
+        return ans;
+      },
+      py::arg("recognizer"), py::arg("waveforms"),
+      py::arg("sample_rate") = 16000, py::arg("num_threads") = 0,
+      py::arg("tail_padding") = 0.3, kDecodeBatchDoc);
+
+  m->def(
+      "decode_files",
+      [](const PyClass &recognizer, const std::vector<std::string> &filenames,
+         float sample_rate, int32_t num_threads, float tail_padding) {
+        int32_t n = static_cast<int32_t>(filenames.size());
+        std::vector<RecognitionResult> ans(n);
+        std::atomic<int32_t> failed{-1};
+
+        {
+          py::gil_scoped_release release;
+          ThreadPool::Get().ParallelFor(n, num_threads, [&](int32_t i) {
+            bool is_ok = false;
+            std::vector<float> samples =
+                ReadWave(filenames[i], sample_rate, &is_ok);
+            if (!is_ok) {
+              failed = i;
+              return;
+            }
+
+            ans[i] = DecodeSamples(recognizer, sample_rate, samples.data(),
+                                   static_cast<int32_t>(samples.size()),
+                                   tail_padding);
+          });
+        }
+
+        if (failed != -1) {
+          throw py::value_error("Failed to read " + filenames[failed]);
+        }
+
+        return ans;
+      },
+      py::arg("recognizer"), py::arg("filenames"),
+      py::arg("sample_rate") = 16000, py::arg("num_threads") = 0,
+      py::arg("tail_padding") = 0.3, kDecodeFilesDoc);
 }
 
 }  // namespace sherpa_ncnn
@@ -19,6 +19,7 @@
 #include "sherpa-ncnn/python/csrc/sherpa-ncnn.h"
 
 #include "sherpa-ncnn/python/csrc/endpoint.h"
+#include "sherpa-ncnn/python/csrc/model-registry.h"
 #include "sherpa-ncnn/python/csrc/model.h"
 #include "sherpa-ncnn/python/csrc/recognizer.h"
 
@@ -30,6 +31,7 @@ PYBIND11_MODULE(_sherpa_ncnn, m) {
   PybindEndpoint(&m);
   PybindModel(&m);
   PybindRecognizer(&m);
+  PybindModelRegistry(&m);
 }
 
 }  // namespace sherpa_ncnn
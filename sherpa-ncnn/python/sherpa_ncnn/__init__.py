@@ -1 +1,7 @@
-from .recognizer import Recognizer
+from .model_registry import ModelRegistry
+from .recognizer import (
+    Recognizer,
+    decode_batch,
+    decode_files,
+    decode_streams,
+)
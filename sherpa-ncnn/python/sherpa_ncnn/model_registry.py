@@ -0,0 +1,127 @@
+from typing import List
+
+from _sherpa_ncnn import DecoderConfig, EndpointConfig, ModelConfig
+from _sherpa_ncnn import ModelRegistry as _ModelRegistry
+
+from .recognizer import Recognizer, _assert_file_exists
+
+
+class ModelRegistry(object):
+    """Replace the model in a running process without dropping streams.
+
+    Each successful :meth:`load` creates a new version of the model.
+    :meth:`create_stream` uses the newest version, while recognizers
+    created earlier keep the version they started with until they are
+    deleted. An old version is freed once it has no recognizers left.
+
+    **Usage example**
+
+    .. code-block:: python3
+
+        registry = sherpa_ncnn.ModelRegistry()
+        registry.load(tokens=..., encoder_param=..., ...)
+
+        stream = registry.create_stream()
+
+        # Later, e.g., in another thread. stream is not affected.
+        registry.load(tokens=..., encoder_param=..., ...)
+    """
+
+    def __init__(self):
+        # all of our current models are using 16 kHz audio samples
+        self.sample_rate = 16000
+        self.registry = _ModelRegistry(sample_rate=self.sample_rate)
+
+    def load(
+        self,
+        tokens: str,
+        encoder_param: str,
+        encoder_bin: str,
+        decoder_param: str,
+        decoder_bin: str,
+        joiner_param: str,
+        joiner_bin: str,
+        num_threads: int = 4,
+    ) -> int:
+        """Load a model and make it the newest version.
+
+        The arguments are the same as those of :class:`Recognizer`. The GIL
+        is released while loading.
+
+        Returns:
+          Return the version of the loaded model, which starts from 1, or
+          -1 on error. On error, the current version is kept.
+        """
+        _assert_file_exists(tokens)
+        _assert_file_exists(encoder_param)
+        _assert_file_exists(encoder_bin)
+        _assert_file_exists(decoder_param)
+        _assert_file_exists(decoder_bin)
+        _assert_file_exists(joiner_param)
+        _assert_file_exists(joiner_bin)
+
+        assert num_threads > 0, num_threads
+
+        model_config = ModelConfig(
+            encoder_param=encoder_param,
+            encoder_bin=encoder_bin,
+            decoder_param=decoder_param,
+            decoder_bin=decoder_bin,
+            joiner_param=joiner_param,
+            joiner_bin=joiner_bin,
+            num_threads=num_threads,
+            tokens=tokens,
+        )
+
+        return self.registry.load(model_config)
+
+    def create_stream(
+        self,
+        decoding_method: str = "greedy_search",
+        num_active_paths: int = 4,
+        enable_endpoint_detection: bool = False,
+        rule1_min_trailing_silence: int = 2.4,
+        rule2_min_trailing_silence: int = 1.2,
+        rule3_min_utterance_length: int = 20,
+    ) -> Recognizer:
+        """Create a recognizer using the newest version of the model.
+
+        The arguments are the same as those of :class:`Recognizer`. The
+        version of the model it uses is saved in its ``model_version``
+        attribute.
+        """
+        assert decoding_method in (
+            "greedy_search",
+            "modified_beam_search",
+        ), decoding_method
+
+        endpoint_config = EndpointConfig(
+            rule1_min_trailing_silence=rule1_min_trailing_silence,
+            rule2_min_trailing_silence=rule2_min_trailing_silence,
+            rule3_min_utterance_length=rule3_min_utterance_length,
+        )
+
+        decoder_config = DecoderConfig(
+            method=decoding_method,
+            num_active_paths=num_active_paths,
+            enable_endpoint=enable_endpoint_detection,
+            endpoint_config=endpoint_config,
+        )
+
+        stream, version = self.registry.create_stream(decoder_config)
+
+        ans = object.__new__(Recognizer)
+        ans.sample_rate = self.sample_rate
+        ans.recognizer = stream
+        ans.model_version = version
+        return ans
+
+    @property
+    def version(self) -> int:
+        """The newest version, or 0 if no model has been loaded."""
+        return self.registry.version
+
+    @property
+    def live_versions(self) -> List[int]:
+        """Versions that are still in memory, in ascending order."""
+        return self.registry.live_versions
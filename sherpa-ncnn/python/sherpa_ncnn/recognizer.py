@@ -1,4 +1,5 @@
 from pathlib import Path
+from typing import List, Union
 
 import numpy as np
 from _sherpa_ncnn import (
@@ -8,6 +9,10 @@ from _sherpa_ncnn import (
     ModelConfig,
 )
 from _sherpa_ncnn import Recognizer as _Recognizer
+from _sherpa_ncnn import RecognitionResult
+from _sherpa_ncnn import decode_batch as _decode_batch
+from _sherpa_ncnn import decode_files as _decode_files
+from _sherpa_ncnn import decode_streams as _decode_streams
 
 
 def _assert_file_exists(f: str):
@@ -54,12 +59,9 @@ class Recognizer(object):
                 assert f.getsampwidth() == 2, f.getsampwidth()  # it is in bytes
                 num_samples = f.getnframes()
                 samples = f.readframes(num_samples)
-                samples_int16 = np.frombuffer(samples, dtype=np.int16)
-                samples_float32 = samples_int16.astype(np.float32)
 
-                samples_float32 = samples_float32 / 32768
-
-            recognizer.accept_waveform(recognizer.sample_rate, samples_float32)
+            # 16-bit PCM bytes are accepted directly without conversion
+            recognizer.accept_waveform(recognizer.sample_rate, samples)
 
             tail_paddings = np.zeros(int(recognizer.sample_rate * 0.5), dtype=np.float32)
             recognizer.accept_waveform(recognizer.sample_rate, tail_paddings)
@@ -187,23 +189,58 @@ class Recognizer(object):
             sample_rate=self.sample_rate,
         )
 
-    def accept_waveform(self, sample_rate: float, waveform: np.array):
+    def create_stream(self) -> "Recognizer":
+        """Create a new recognizer sharing the model with this one.
+
+        The new recognizer has its own decoding state and can decode a
+        different audio stream, possibly in a different thread. The model
+        is not loaded again.
+        """
+        ans = object.__new__(Recognizer)
+        ans.sample_rate = self.sample_rate
+        ans.recognizer = self.recognizer.create_stream()
+        return ans
+
+    def accept_waveform(
+        self,
+        sample_rate: float,
+        waveform: Union[np.ndarray, bytes],
+        decode: bool = True,
+    ):
         """Decode audio samples.
 
         Args:
           sample_rate:
             Sample rate of the input audio samples. It should be 16000.
           waveform:
-            A 1-D float32 array containing audio samples in the
-            range ``[-1, 1]``.
+            Audio samples. It can be a 1-D float32 array with samples in
+            the range ``[-1, 1]``, a 1-D int16 array, or ``bytes``
+            containing little-endian 16-bit PCM samples, e.g., the return
+            value of ``wave.Wave_read.readframes()``. They are read in
+            place without copying.
+          decode:
+            True to decode the available frames before returning. Set it to
+            False if you use :func:`decode_streams` to decode several
+            recognizers at once.
         """
         assert sample_rate == self.sample_rate, (sample_rate, self.sample_rate)
         self.recognizer.accept_waveform(sample_rate, waveform)
-        self.recognizer.decode()
+        if decode:
+            self.recognizer.decode()
+
+    def input_finished(self, decode: bool = True):
+        """Signal that no more audio samples are available.
 
-    def input_finished(self):
-        """Signal that no more audio samples are available."""
+        Args:
+          decode:
+            See :meth:`accept_waveform`.
+        """
         self.recognizer.input_finished()
+        if decode:
+            self.recognizer.decode()
+
+    def decode(self):
+        """Decode the available frames. The GIL is released while decoding."""
         self.recognizer.decode()
 
     @property
@@ -213,3 +250,104 @@ class Recognizer(object):
     @property
     def is_endpoint(self):
         return self.recognizer.is_endpoint()
+
+    @property
+    def memory_stats(self):
+        """Return the memory used by the model and by this recognizer.
+
+        Its ``model`` field is shared by all recognizers using the same
+        model, while its ``stream`` field is the cost of this recognizer.
+        """
+        return self.recognizer.memory_stats
+
+
+def decode_streams(recognizers: List[Recognizer], num_threads: int = 0):
+    """Decode several recognizers in parallel using native threads.
+
+    The GIL is released while decoding, so other Python threads keep
+    running.
+
+    Args:
+      recognizers:
+        A list of recognizers, usually created by
+        :meth:`Recognizer.create_stream`. Each one must appear only once.
+      num_threads:
+        Number of threads to use. If it is not positive, the number of CPU
+        cores is used.
+    """
+    _decode_streams([r.recognizer for r in recognizers], num_threads)
+
+
+def decode_batch(
+    recognizer: Recognizer,
+    waveforms: List[np.ndarray],
+    num_threads: int = 0,
+    tail_padding: float = 0.3,
+) -> List[RecognitionResult]:
+    """Decode a list of complete utterances in parallel.
+
+    All threads share the model of the given recognizer. Each waveform is
+    decoded by a new stream, so the state of ``recognizer`` is not changed.
+    The GIL is released while decoding.
+
+    Since utterances are already decoded in parallel, it is usually best to
+    create ``recognizer`` with ``num_threads=1``.
+
+    Args:
+      recognizer:
+        It provides the model and the decoding method.
+      waveforms:
+        A list of 1-D float32 arrays with samples in the range ``[-1, 1]``.
+        Their sample rate must be ``recognizer.sample_rate``.
+      num_threads:
+        Number of threads to use. If it is not positive, the number of CPU
+        cores is used.
+      tail_padding:
+        Seconds of silence appended to each waveform.
+    Returns:
+      Return a list of results in the same order as ``waveforms``. Each
+      result has the fields ``text``, ``tokens`` and ``timestamps``.
+    """
+    return _decode_batch(
+        recognizer.recognizer,
+        waveforms,
+        sample_rate=recognizer.sample_rate,
+        num_threads=num_threads,
+        tail_padding=tail_padding,
+    )
+
+
+def decode_files(
+    recognizer: Recognizer,
+    filenames: List[str],
+    num_threads: int = 0,
+    tail_padding: float = 0.3,
+) -> List[RecognitionResult]:
+    """Like :func:`decode_batch` but reads the audio from wave files.
+
+    The files are read in the worker threads. They must be single channel,
+    16-bit PCM encoded and have the sample rate ``recognizer.sample_rate``.
+
+    Args:
+      recognizer:
+        It provides the model and the decoding method.
+      filenames:
+        A list of paths to wave files.
+      num_threads:
+        Number of threads to use. If it is not positive, the number of CPU
+        cores is used.
+      tail_padding:
+        Seconds of silence appended to each file.
+    Returns:
+      Return a list of results in the same order as ``filenames``.
+    """
+    for f in filenames:
+        _assert_file_exists(f)
+
+    return _decode_files(
+        recognizer.recognizer,
+        filenames,
+        sample_rate=recognizer.sample_rate,
+        num_threads=num_threads,
+        tail_padding=tail_padding,
+    )
@@ -140,6 +140,23 @@ class SherpaNcnnRecongitionResult {
   }
 }
 
+/// A loaded model that can be shared by many recognizers.
+class SherpaNcnnModel {
+  /// A pointer to the underlying counterpart in C
+  let model: OpaquePointer!
+
+  /// Constructor taking a model config.
+  init(modelConfig: UnsafePointer<SherpaNcnnModelConfig>!) {
+    model = CreateModel(modelConfig)
+  }
+
+  deinit {
+    if let model {
+      DestroyModel(model)
+    }
+  }
+}
+
 class SherpaNcnnRecognizer {
   /// A pointer to the underlying counterpart in C
   let recognizer: OpaquePointer!
@@ -152,6 +169,15 @@ class SherpaNcnnRecognizer {
     recognizer = CreateRecognizer(modelConfig, decoderConfig)
   }
 
+  /// Constructor sharing a loaded model with other recognizers.
+  /// It is much cheaper than loading the model again.
+  init(
+    model: SherpaNcnnModel,
+    decoderConfig: UnsafePointer<SherpaNcnnDecoderConfig>!
+  ) {
+    recognizer = CreateStream(model.model, decoderConfig)
+  }
+
   deinit {
     if let recognizer {
       DestroyRecognizer(recognizer)